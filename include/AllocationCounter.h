@@ -0,0 +1,13 @@
+#pragma once
+
+// Process-wide count of heap allocations made through operator new, so a
+// run can check that its hot loop leaves the heap alone (`--check-allocs`).
+// src/AllocationCounter.cpp replaces the global operator new and delete;
+// counting costs one relaxed atomic increment per allocation.
+
+#include <cstdint>
+
+namespace AllocationCounter {
+    // Allocations so far, on every thread
+    uint64_t count();
+}
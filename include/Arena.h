@@ -0,0 +1,121 @@
+#pragma once
+
+// Linear scratch memory for the temporaries of a step: per-worker force
+// accumulators, reduction blocks and the like. take() bumps a pointer
+// through the current block and Scope hands everything taken inside it
+// back on exit, so scratch costs no heap traffic once the arena has grown
+// to the largest step it served.
+//
+// A request that does not fit opens another block; the memory taken so far
+// never moves. When the outermost scope closes, a chain of blocks is merged
+// into a single block of the combined size, so the steady state is one
+// block and zero allocations. Not thread-safe: take() belongs to the thread
+// that owns the arena, workers only use the memory it handed out.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+class ScratchArena {
+public:
+    // Everything taken while a Scope is alive is released when it ends
+    class Scope {
+    public:
+        explicit Scope(ScratchArena& arena) : arena(arena), block(arena.current), offset(arena.offset) {}
+        ~Scope() { arena.rewind(block, offset); }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        ScratchArena& arena;
+        size_t block;
+        size_t offset;
+    };
+
+    ScratchArena() = default;
+    ScratchArena(const ScratchArena&) = delete;
+    ScratchArena& operator=(const ScratchArena&) = delete;
+
+    // count elements of uninitialised storage
+    template <typename T>
+    T* take(size_t count) {
+        static_assert(std::is_trivially_destructible<T>::value, "Scratch is released without destructors");
+        static_assert(alignof(T) <= MAX_ALIGN, "Alignment beyond what blocks provide");
+        return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+    }
+
+    // count copies of value
+    template <typename T>
+    T* take(size_t count, const T& value) {
+        T* data = take<T>(count);
+        std::uninitialized_fill_n(data, count, value);
+        return data;
+    }
+
+    // Bytes the arena holds, used or not
+    size_t capacity() const {
+        size_t bytes = 0;
+        for (const Block& block : blocks) bytes += block.size;
+        return bytes;
+    }
+    // Heap blocks allocated over the arena's lifetime
+    uint64_t allocations() const { return growths; }
+
+private:
+    static constexpr size_t MIN_BLOCK = size_t(64) << 10;
+    // Largest alignment take() serves; blocks start at this alignment
+    static constexpr size_t MAX_ALIGN = 64;
+
+    struct Block {
+        std::unique_ptr<unsigned char[]> memory;
+        size_t size = 0;
+        unsigned char* begin() const {
+            const uintptr_t raw = reinterpret_cast<uintptr_t>(memory.get());
+            return reinterpret_cast<unsigned char*>((raw + MAX_ALIGN - 1) & ~uintptr_t(MAX_ALIGN - 1));
+        }
+    };
+
+    std::vector<Block> blocks;
+    size_t current = 0;     // Block taken from
+    size_t offset = 0;      // Bytes used in it
+    uint64_t growths = 0;
+
+    void* allocate(size_t bytes, size_t alignment) {
+        size_t at = (offset + alignment - 1) & ~(alignment - 1);
+        if (blocks.empty() || at + bytes > blocks[current].size) {
+            // The next block is reused if big enough; anything after it is stale
+            if (!blocks.empty()) ++current;
+            if (current >= blocks.size() || blocks[current].size < bytes) {
+                blocks.resize(current);
+                addBlock(std::max(bytes, std::max(MIN_BLOCK, capacity())));
+            }
+            offset = 0;
+            at = 0;
+        }
+        offset = at + bytes;
+        return blocks[current].begin() + at;
+    }
+
+    void addBlock(size_t size) {
+        Block block;
+        block.memory.reset(new unsigned char[size + MAX_ALIGN - 1]);
+        block.size = size;
+        blocks.push_back(std::move(block));
+        ++growths;
+    }
+
+    void rewind(size_t block, size_t at) {
+        if (block == 0 && at == 0 && blocks.size() > 1) {
+            // Nothing is taken any more: one block that fits the whole chain next time
+            const size_t total = capacity();
+            blocks.clear();
+            addBlock(total);
+        }
+        current = std::min(block, blocks.empty() ? size_t(0) : blocks.size() - 1);
+        offset = at;
+    }
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+// Initial conditions from external generators, as NumPy .npy files or raw
+// little-endian arrays, one file per quantity:
+//
+//   pos, vel                 N x 3 positions / velocities
+//   px py pz vx vy vz        N values each, instead of pos / vel
+//   mass, density, radius    N values (density defaults to 3344, radius is
+//                            derived from mass and density when absent)
+//   color                    N x 4 RGBA floats
+//   id                       N unsigned 64-bit ids (default 1 .. N)
+//
+// positions and mass are required; velocities default to zero. Units are
+// the engine's own (scene kilometres, kilograms).
+//
+// Files are mapped copy-on-write (MappedFile.h), and every array already in
+// the BodyStore's layout (float32 vectors, Fortran-order N x 3 arrays, C-order
+// N x 4 colours, uint64 ids) is adopted as a column without reading it.
+// Only C-order N x 3 arrays, which interleave x, y, z, and float64 data are
+// copied, in parallel on the engine's threads.
+//
+// Raw files hold float32 values (uint64 for id) unless a dtype follows the
+// field name; the body count comes from the file size. On the command line
+// sources are given as one comma-separated list:
+//
+//   pos=pos.npy,vel=vel.npy,mass=mass.npy
+//   px:f8=x.bin,py:f8=y.bin,pz:f8=z.bin,mass=m.bin
+
+#include <string>
+#include <vector>
+
+namespace ArrayImport {
+    struct Source {
+        std::string field;
+        std::string dtype;      // Raw files only: "f4" (default), "f8" or "u8"
+        std::string path;
+    };
+
+    // Splits "field[:dtype]=path,..." into sources
+    bool parseSources(const std::string& spec, std::vector<Source>& out);
+}
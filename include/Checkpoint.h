@@ -0,0 +1,55 @@
+#pragma once
+
+// Binary checkpoint layout used by SimulationEngine::saveState/loadState.
+//
+//   CheckpointHeader
+//   CheckpointColumn[columnCount]
+//   column data, each starting on a COLUMN_ALIGNMENT boundary
+//
+// Columns are the raw BodyStore arrays in native byte order, so a mapped
+// file is used in place: loading touches the header and column table only.
+// Columns are looked up by name; readers skip names they do not know, so
+// later versions can append columns without breaking older files.
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Checkpoint {
+    constexpr char MAGIC[8] = {'G', 'R', 'A', 'V', 'C', 'K', 'P', 'T'};
+    constexpr uint32_t VERSION = 1;
+    constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+    constexpr uint64_t COLUMN_ALIGNMENT = 64;
+    constexpr size_t NAME_LENGTH = 16;
+}
+
+struct CheckpointHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;         // BYTE_ORDER_MARK as written by the saving machine
+    uint32_t headerSize;        // sizeof(CheckpointHeader)
+    uint32_t columnCount;
+    uint64_t bodyCount;
+
+    // BodyStore bookkeeping
+    uint64_t nextId;
+
+    // Integrator state
+    uint64_t stepCount;
+    float timeScale;
+    float gravitationalConstant;
+    uint8_t deterministic;
+    uint8_t enableCollisions;
+    uint8_t isPaused;
+    uint8_t reserved[29];
+};
+
+struct CheckpointColumn {
+    char name[Checkpoint::NAME_LENGTH];     // Zero padded
+    uint32_t elementSize;
+    uint32_t reserved;
+    uint64_t offset;                        // From the start of the file
+    uint64_t bytes;
+};
+
+static_assert(sizeof(CheckpointHeader) == 88, "Checkpoint header layout changed");
+static_assert(sizeof(CheckpointColumn) == 40, "Checkpoint column layout changed");
@@ -0,0 +1,31 @@
+#pragma once
+
+// Column codec for trajectory chunks. A column is frames x bodies floats,
+// frame-major, e.g. px of every body for 16 consecutive frames.
+//
+//   1. Quantize: q = round((x - origin) / quantum), with origin the column
+//      minimum and quantum the tolerance, so every decoded value is within
+//      the tolerance of the original. A tolerance of 0 (or one below the
+//      float spacing of the column) keeps the exact float bits instead,
+//      mapped to integers that order like the floats.
+//   2. Predict each body's value from its previous two frames (linear
+//      extrapolation) and keep only the residual.
+//   3. Zig-zag the residuals and bit-pack them in blocks of BLOCK values,
+//      each block at the width of its largest residual.
+//
+// Decoding is branch-light integer work over contiguous arrays and runs at
+// several GB/s, well above disk read speed.
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Codec {
+    constexpr size_t BLOCK = 128;
+
+    // Appends the encoded column to out
+    void encodeColumn(const float* values, size_t frames, size_t bodies, double tolerance, std::vector<uint8_t>& out);
+
+    // Fills values (frames x bodies); false if the stream is malformed
+    bool decodeColumn(const uint8_t* data, size_t bytes, size_t frames, size_t bodies, float* values);
+}
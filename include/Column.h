@@ -0,0 +1,148 @@
+#pragma once
+
+// One BodyStore column. Normally it owns a std::vector, but after a
+// checkpoint load it can view a region of a copy-on-write file mapping
+// instead, so nothing is read or copied until a page is touched. In-place
+// writes go to private pages; anything that grows the column moves the
+// data into owned storage first.
+
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "MappedFile.h"
+
+template <typename T>
+class Column {
+    static_assert(std::is_trivially_copyable<T>::value, "Columns hold plain data");
+
+public:
+    using value_type = T;
+
+    Column() = default;
+    Column(const Column& other) : owned(other.begin(), other.end()) { sync(); }
+    Column(Column&& other) noexcept
+        : owned(std::move(other.owned)), mapping(std::move(other.mapping)), first(other.first), count(other.count) {
+        other.owned.clear();
+        other.sync();
+    }
+
+    Column& operator=(const Column& other) {
+        if (this != &other) assign(other.begin(), other.end());
+        return *this;
+    }
+    Column& operator=(Column&& other) noexcept {
+        if (this != &other) {
+            owned = std::move(other.owned);
+            mapping = std::move(other.mapping);
+            first = other.first;
+            count = other.count;
+            other.owned.clear();
+            other.sync();
+        }
+        return *this;
+    }
+
+    // Views n elements at data, which must lie inside file. The mapping
+    // stays alive for as long as any column still views it.
+    void adopt(std::shared_ptr<MappedFile> file, T* data, size_t n) {
+        std::vector<T>().swap(owned);
+        mapping = std::move(file);
+        first = data;
+        count = n;
+    }
+    bool isMapped() const { return mapping != nullptr; }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    T* data() { return first; }
+    const T* data() const { return first; }
+    T* begin() { return first; }
+    T* end() { return first + count; }
+    const T* begin() const { return first; }
+    const T* end() const { return first + count; }
+
+    T& operator[](size_t i) { return first[i]; }
+    const T& operator[](size_t i) const { return first[i]; }
+    T& back() { return first[count - 1]; }
+    const T& back() const { return first[count - 1]; }
+
+    void push_back(const T& value) {
+        const T copy = value;   // value may live in the mapping released below
+        materialize();
+        owned.push_back(copy);
+        sync();
+    }
+
+    void reserve(size_t n) {
+        materialize();
+        owned.reserve(n);
+        sync();
+    }
+
+    // Shrinking a mapped column only shortens the view
+    void resize(size_t n, const T& value = T()) {
+        if (mapping && n <= count) {
+            count = n;
+            return;
+        }
+        materialize();
+        owned.resize(n, value);
+        sync();
+    }
+
+    void clear() {
+        mapping.reset();
+        owned.clear();
+        sync();
+    }
+
+    void assign(size_t n, const T& value) {
+        const T copy = value;
+        mapping.reset();
+        owned.assign(n, copy);
+        sync();
+    }
+
+    template <typename It>
+    void assign(It from, It to) {
+        std::vector<T> copy(from, to);
+        owned.swap(copy);
+        mapping.reset();
+        sync();
+    }
+
+    // Copies into the owned capacity, unless the range lies inside it
+    void assign(const T* from, const T* to) {
+        const std::less<const T*> before;
+        if (!owned.empty() && !before(from, owned.data()) && before(from, owned.data() + owned.size())) {
+            std::vector<T> copy(from, to);
+            owned.swap(copy);
+        } else {
+            owned.assign(from, to);
+        }
+        mapping.reset();
+        sync();
+    }
+
+private:
+    std::vector<T> owned;
+    std::shared_ptr<MappedFile> mapping;
+    T* first = nullptr;
+    size_t count = 0;
+
+    void materialize() {
+        if (!mapping) return;
+        std::vector<T> copy(first, first + count);
+        owned.swap(copy);
+        mapping.reset();
+        sync();
+    }
+
+    void sync() {
+        first = owned.data();
+        count = owned.size();
+    }
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Bounded lock-free multi-producer / single-consumer queue (Vyukov's ring
+// with per-slot sequence numbers). push() never blocks and never allocates;
+// it fails when the ring is full. Capacity must be a power of two.
+template <typename T, size_t Capacity>
+class CommandQueue {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    CommandQueue() {
+        for (size_t i = 0; i < Capacity; ++i) slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    CommandQueue(const CommandQueue&) = delete;
+    CommandQueue& operator=(const CommandQueue&) = delete;
+
+    // Any thread
+    bool push(const T& value) {
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& slot = slots[pos & MASK];
+            const size_t seq = slot.sequence.load(std::memory_order_acquire);
+            const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    slot.value = value;
+                    slot.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;   // Full
+            } else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Consumer thread only
+    bool pop(T& value) {
+        Slot& slot = slots[dequeuePos & MASK];
+        const size_t seq = slot.sequence.load(std::memory_order_acquire);
+        if (static_cast<intptr_t>(seq) - static_cast<intptr_t>(dequeuePos + 1) < 0) return false;
+        value = slot.value;
+        slot.sequence.store(dequeuePos + Capacity, std::memory_order_release);
+        ++dequeuePos;
+        return true;
+    }
+
+    // Consumer thread only: pops up to maxCount entries into out, returns how many
+    size_t popBatch(T* out, size_t maxCount) {
+        size_t count = 0;
+        while (count < maxCount && pop(out[count])) ++count;
+        return count;
+    }
+
+private:
+    static constexpr size_t MASK = Capacity - 1;
+
+    struct alignas(64) Slot {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::array<Slot, Capacity> slots;
+    alignas(64) std::atomic<size_t> enqueuePos{0};
+    alignas(64) size_t dequeuePos = 0;
+};
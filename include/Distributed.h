@@ -0,0 +1,97 @@
+#pragma once
+
+// Distributed-memory backend for runs that do not fit on one node:
+//   mpirun -np N Gravitas --headless --mpi [options]
+//
+// Bodies are split along a Morton curve into contiguous pieces of roughly
+// equal measured cost, one per rank. Each step every rank builds a
+// Barnes-Hut tree of its own bodies and sends every other rank the part of
+// it that rank's domain needs (its locally essential tree), so the force
+// walk afterwards is purely local. Only built with GRAVITAS_WITH_MPI.
+
+#ifdef GRAVITAS_WITH_MPI
+
+#include <mpi.h>
+#include <vector>
+#include "Octree.h"
+#include "SimulationEngine.h"
+#include "ThreadPool.h"
+
+struct DistributedConfig {
+    float theta = 0.5f;                 // Barnes-Hut opening angle
+    uint64_t rebalanceInterval = 10;    // Steps between load checks
+    double imbalanceThreshold = 1.1;    // Rebalance when the slowest rank exceeds the mean by this factor
+    unsigned threads = 1;               // Threads per rank for the tree walk
+};
+
+class DistributedSimulation {
+public:
+    // This rank's bodies; also provides the integrator and time scale
+    SimulationEngine engine{1};
+
+    uint64_t stepCount = 0;
+    double lastImbalance = 1.0;     // Slowest / mean force time over ranks, last step
+    uint64_t rebalances = 0;
+    uint64_t migrated = 0;          // Bodies this rank sent elsewhere, cumulative
+    size_t imported = 0;            // Tree particles received in the last force pass
+
+    DistributedSimulation(MPI_Comm comm, const DistributedConfig& config);
+    ~DistributedSimulation();
+
+    int rank() const { return rankIndex; }
+    int ranks() const { return rankCount; }
+
+    // Collective. Spreads the root's bodies over all ranks; other ranks' input is ignored
+    void scatter(const BodyStore& global, int root = 0);
+    // Collective. Reassembles every body on the root, in id order
+    void gather(BodyStore& global, int root = 0);
+
+    // Collective
+    void step();
+    // Collective. Kinetic plus tree potential energy, same units as SimulationEngine
+    double getTotalEnergy();
+    // Collective. engine.diagnostics of the last step summed over all ranks,
+    // with the potential from the tree walk; set engine.trackDiagnostics first
+    Diagnostics getDiagnostics();
+
+private:
+    // Resolution of the cost histogram that places the domain boundaries:
+    // the top 18 Morton bits, i.e. 6 octree levels
+    static constexpr int HISTOGRAM_BITS = 18;
+
+    // Everything a body needs when it changes rank
+    struct BodyRecord {
+        float p[3], v[3];
+        float mass, density, radius;
+        float cost;
+        glm::vec4 color;
+        uint64_t id;
+        uint8_t glow;
+    };
+
+    MPI_Comm comm;
+    int rankIndex = 0;
+    int rankCount = 1;
+    MPI_Datatype recordType;
+    MPI_Datatype particleType;
+    DistributedConfig config;
+    ThreadPool pool;
+
+    Octree localTree;
+    Octree essentialTree;
+    std::vector<TreeParticle> particles;
+    std::vector<TreeParticle> exports;
+    std::vector<uint32_t> overlaps;
+    std::vector<double> potential;
+    std::vector<float> cost;            // Seconds of force work per body, from the last pass
+    std::vector<uint32_t> order;        // Permutation of the last reorder
+    double lastForceSeconds = 0.0;
+
+    void computeForces();
+    void checkBalance();
+    void rebalance();
+    void migrate(const std::vector<int>& owner);
+    void reorder();
+};
+
+#endif
@@ -0,0 +1,56 @@
+#pragma once
+
+// Monte Carlo ensembles: many perturbed copies of one scene run concurrently
+// on the headless engine, one instance per task
+
+#include <string>
+#include <vector>
+#include "SimulationEngine.h"
+
+struct EnsembleConfig {
+    size_t instances = 64;
+    uint64_t steps = 1000;
+    uint64_t seed = 1;
+    float massJitter = 0.01f;       // Relative 1-sigma perturbation of each mass
+    float velocityJitter = 0.01f;   // 1-sigma velocity kick per axis, relative to the body's speed
+    float escapeRadius = 50000.0f;  // Scene units from the centre of mass counted as ejected
+    unsigned threads = 0;           // 0 = all cores
+    bool deterministic = true;
+    bool stopOnEscape = false;      // End an instance as soon as one body passes escapeRadius
+    bool useLanes = true;           // Pack small deterministic systems into SIMD lanes (LaneKernel.h)
+};
+
+// What one instance ended up doing
+struct EnsembleOutcome {
+    double energyDrift = 0.0;       // |E_final - E_initial| / |E_initial|
+    double ejected = 0.0;           // Bodies beyond escapeRadius at the end
+    double minSeparation = 0.0;     // Closest pair at the end, scene units
+    double meanRadius = 0.0;        // Mean distance from the centre of mass at the end
+    double steps = 0.0;             // Ticks actually run
+};
+
+class EnsembleRunner {
+public:
+    // The initial conditions are shared read-only by all instances
+    EnsembleRunner(const BodyStore& initial, const EnsembleConfig& config);
+
+    std::vector<EnsembleOutcome> run();
+
+    // Aggregated statistics (mean, stddev, min, percentiles, max) per outcome metric
+    static bool writeStatistics(const std::string& filename, const std::vector<EnsembleOutcome>& outcomes);
+    static void printStatistics(const std::vector<EnsembleOutcome>& outcomes);
+
+    // Instance i uses Philox stream i of the configured seed
+    static void perturb(BodyStore& bodies, const EnsembleConfig& config, size_t instance);
+    static EnsembleOutcome measure(const SimulationEngine& engine, double initialEnergy, const EnsembleConfig& config);
+
+private:
+    // Systems up to this size go through the lane kernel
+    static constexpr size_t LANE_BODY_LIMIT = 64;
+
+    const BodyStore& initial;
+    EnsembleConfig config;
+
+    std::vector<EnsembleOutcome> runScalar();
+    std::vector<EnsembleOutcome> runLanes();
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+// Ephemeris files: every body's path as Chebyshev polynomial segments, in
+// the style of SPK type 3, so position and velocity at any (fractional)
+// step come from one polynomial evaluation instead of a replay.
+//
+//   EphemerisHeader
+//   record*      EphemerisRecord + double coefficients[6][degree + 1]
+//   bodies       EphemerisBody[bodyCount], at header.bodyOffset
+//   table        EphemerisSegment per body segment, at header.tableOffset
+//
+// Time is cut into global segments of segmentSteps steps. Segment k spans
+// [k * segmentSteps, (k + 1) * segmentSteps]; a body's first and last
+// segments are shorter when it appears or disappears mid-segment. A body
+// lives in the consecutive segments firstSegment .. firstSegment +
+// segmentCount - 1, and table[tableStart + k - firstSegment] lists the
+// records of its segment k, which makes a lookup O(1).
+//
+// Each record holds x, y, z, vx, vy, vz as Chebyshev series over the
+// record's step range mapped to [-1, 1], fitted to the integrated samples
+// by least squares. Velocities have their own series rather than being the
+// derivative of the position fit, as in SPK type 3. Where one series cannot
+// follow the motion within tolerance (close encounters, collisions) the
+// segment is halved, up to MAX_SPLITS times, so a segment has between 1
+// and 2^MAX_SPLITS consecutive records sorted by time.
+//
+// Records are written as their segments complete; the body table, record
+// table and final header are written when the file is closed.
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Ephemeris {
+    constexpr char MAGIC[8] = {'G', 'R', 'A', 'V', 'E', 'P', 'H', 'M'};
+    constexpr uint32_t VERSION = 1;
+    constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+    constexpr uint32_t MAX_DEGREE = 31;
+    constexpr uint32_t SERIES_COUNT = 6;    // x, y, z, vx, vy, vz
+    constexpr uint32_t MAX_SPLITS = 6;
+
+    // Bytes of one record with its coefficients
+    size_t recordSize(uint32_t degree);
+}
+
+struct EphemerisHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t headerSize;
+    uint32_t degree;            // Of every series
+    uint64_t segmentSteps;
+    uint64_t firstStep;         // Range covered by any body
+    uint64_t lastStep;
+    uint64_t recordCount;
+    uint64_t bodyCount;
+    uint64_t bodyOffset;        // 0 until the file is closed
+    uint64_t tableOffset;
+    uint8_t reserved[16];
+};
+
+struct EphemerisRecord {
+    uint64_t startStep;
+    uint64_t endStep;
+    float positionError;        // Largest fit residual over the samples
+    float velocityError;
+    uint32_t degree;            // Lower than the header's when there were few samples
+    uint32_t reserved;
+};
+
+struct EphemerisSegment {
+    uint64_t firstRecord;
+    uint32_t recordCount;
+    uint32_t reserved;
+};
+
+struct EphemerisBody {
+    uint64_t id;
+    float mass;
+    float density;
+    float color[4];
+    uint32_t glow;
+    uint32_t segmentCount;
+    uint64_t firstSegment;
+    uint64_t tableStart;
+};
+
+static_assert(sizeof(EphemerisHeader) == 96, "Ephemeris header layout changed");
+static_assert(sizeof(EphemerisRecord) == 32, "Ephemeris record layout changed");
+static_assert(sizeof(EphemerisSegment) == 16, "Ephemeris segment layout changed");
+static_assert(sizeof(EphemerisBody) == 56, "Ephemeris body layout changed");
+
+inline size_t Ephemeris::recordSize(uint32_t degree) {
+    return sizeof(EphemerisRecord) + SERIES_COUNT * (size_t(degree) + 1) * sizeof(double);
+}
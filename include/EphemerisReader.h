@@ -0,0 +1,48 @@
+#pragma once
+
+// Queries into an ephemeris file (Ephemeris.h). The file is mapped and any
+// body's position and velocity at any step within its lifetime costs one
+// table lookup (plus a search among at most 2^MAX_SPLITS records of a split
+// segment) and a Clenshaw evaluation of six short series.
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Ephemeris.h"
+#include "MappedFile.h"
+
+class EphemerisReader {
+public:
+    static constexpr size_t NOT_FOUND = SIZE_MAX;
+
+    bool open(const std::string& path);
+    void close();
+    bool isOpen() const { return file.isOpen(); }
+
+    uint64_t firstStep() const { return header.firstStep; }
+    uint64_t lastStep() const { return header.lastStep; }
+    uint64_t segmentSteps() const { return header.segmentSteps; }
+
+    size_t bodyCount() const { return size_t(header.bodyCount); }
+    const EphemerisBody& body(size_t index) const { return bodies[index]; }
+    size_t find(uint64_t id) const;
+
+    // False outside the body's lifetime
+    bool state(size_t index, double step, glm::dvec3& position, glm::dvec3& velocity) const;
+    bool covers(size_t index, double step) const { return recordFor(index, step) != nullptr; }
+
+    // Indices of the bodies alive at step, in file order
+    void bodiesAt(double step, std::vector<uint32_t>& out) const;
+
+private:
+    MappedFile file;
+    EphemerisHeader header{};
+    const EphemerisBody* bodies = nullptr;
+    const EphemerisSegment* table = nullptr;
+    size_t recordBytes = 0;
+    std::unordered_map<uint64_t, size_t> index;
+
+    const EphemerisRecord* recordFor(size_t body, double step) const;
+};
@@ -0,0 +1,98 @@
+#pragma once
+
+// Fits the Chebyshev segments of an ephemeris file (Ephemeris.h) while a
+// run steps. Each body's samples since its last segment boundary are kept
+// in memory; at a boundary they are fitted and written as one record, and
+// the boundary sample starts the next segment so consecutive segments meet.
+// A segment whose fit misses the tolerance is split in halves, and those
+// again, sharing their middle samples.
+// Meant for runs with few bodies (planetary systems): memory is about
+// 24 bytes per body per sampled step of the open segment.
+
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Ephemeris.h"
+#include "SimulationEngine.h"
+
+struct EphemerisConfig {
+    uint64_t segmentSteps = 64;
+    uint32_t degree = 11;           // At most Ephemeris::MAX_DEGREE
+    uint64_t every = 1;             // Steps between samples
+    // Largest fit residual before a segment is split; never tighter than a
+    // few float steps of the samples themselves
+    double positionTolerance = 1e-2;
+    double velocityTolerance = 1e-2;
+};
+
+class EphemerisWriter {
+public:
+    struct Stats {
+        uint64_t samples = 0;
+        uint64_t records = 0;
+        uint64_t bytesWritten = 0;
+        double positionError = 0.0;     // Largest fit residual of any record
+        double velocityError = 0.0;
+    };
+
+    explicit EphemerisWriter(const EphemerisConfig& config = EphemerisConfig());
+    ~EphemerisWriter();
+
+    EphemerisWriter(const EphemerisWriter&) = delete;
+    EphemerisWriter& operator=(const EphemerisWriter&) = delete;
+
+    bool open(const std::string& path);
+    // Fits what is left of every segment, then writes the tables
+    void close();
+    bool isOpen() const { return file.is_open(); }
+
+    // Call after each step; steps off the sampling stride are ignored
+    void capture(const SimulationEngine& engine);
+
+    Stats stats() const { return counters; }
+
+private:
+    struct Track {
+        EphemerisBody body{};
+        bool alive = true;
+        std::vector<EphemerisSegment> segments;
+        std::vector<uint64_t> steps;    // Samples of the open segment
+        std::vector<float> samples;     // x, y, z, vx, vy, vz per step
+    };
+
+    // Least-squares fit matrix for one set of sample steps
+    struct Fit {
+        std::vector<uint64_t> steps;
+        uint32_t degree = 0;
+        std::vector<double> solve;      // (degree + 1) x count
+        std::vector<double> basis;      // count x (degree + 1), to measure residuals
+    };
+
+    EphemerisConfig config;
+    std::string path;
+    std::ofstream file;
+
+    std::vector<Track> tracks;
+    std::unordered_map<uint64_t, size_t> trackOf;   // Body id -> live track
+    std::vector<size_t> slots;                      // Body index -> track, for the current topology
+    uint64_t slotsTopology = 0;
+    bool slotsValid = false;
+
+    Fit fit;
+    std::vector<uint64_t> pieceSteps;
+    std::vector<uint8_t> record;
+    uint64_t firstStep = 0, lastStep = 0;
+    bool anySample = false;
+    uint64_t fileOffset = 0;
+    bool failed = false;
+    Stats counters;
+
+    void mapBodies(const BodyStore& bodies, uint64_t step);
+    void flushTrack(Track& track);
+    void writePiece(const Track& track, size_t first, size_t count, unsigned depth);
+    const Fit& fitFor(const std::vector<uint64_t>& steps);
+    void write(const void* data, size_t bytes);
+    EphemerisHeader makeHeader(uint64_t bodyOffset, uint64_t tableOffset) const;
+};
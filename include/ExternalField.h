@@ -0,0 +1,61 @@
+#pragma once
+
+// Analytic background potentials (src/ExternalField.cpp). A smooth halo or
+// disk given as a formula replaces the particles that would otherwise
+// sample it. The engine adds each field's pull to every body and test
+// particle in the force pass, and several fields simply add up.
+//
+// A field can change over time: its centre drifts at a constant velocity,
+// and its strength can ramp up linearly over its first growthSteps steps,
+// so a live system settles into it adiabatically. Both are functions of the
+// step alone, so a field has no state of its own to checkpoint or rewind.
+// That includes the drift, which moves velocity / TIME_SCALE units per step
+// whatever the engine's timeScale: changing the time scale mid-run leaves
+// the centre where it was instead of rescaling the distance it has covered.
+//
+// Lengths are scene units and masses kg. Accelerations come out in m/s^2
+// and potentials in J/kg, like the engine's own force pass.
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <string>
+
+namespace ExternalField {
+    enum class Profile {
+        NFW,            // rho ~ 1 / (r/scale (1 + r/scale)^2), untruncated
+        Hernquist,      // Phi = -G mass / (r + scale)
+        MiyamotoNagai,  // Phi = -G mass / sqrt(R^2 + (scale + sqrt(z^2 + height^2))^2)
+        Logarithmic     // Phi = speed^2 / 2 ln(scale^2 + R^2 + z^2 / flattening^2)
+    };
+
+    struct Potential {
+        Profile profile = Profile::NFW;
+        double mass = 1e28;             // kg: NFW characteristic mass 4 pi rho_s scale^3, otherwise the total
+        float speed = 0.0f;             // Logarithmic: circular speed at large radii, stored velocity units
+        float scale = 5000.0f;          // NFW r_s, Hernquist a, Miyamoto-Nagai a, logarithmic core radius
+        float height = 500.0f;          // Miyamoto-Nagai b
+        float flattening = 1.0f;        // Logarithmic q, along axis
+
+        glm::vec3 centre{0.0f};             // At startStep
+        glm::vec3 axis{0.0f, 1.0f, 0.0f};   // Symmetry axis of the disk and the flattened halo
+        glm::vec3 velocity{0.0f};           // Of the centre, stored velocity units at timeScale 1
+        uint64_t growthSteps = 0;           // 0 = full strength from the start
+        uint64_t startStep = 0;             // Step the field was added at
+
+        // Share of full strength at a step
+        double strength(uint64_t step) const;
+        // Centre at a step, drifting since startStep
+        glm::dvec3 centreAt(uint64_t step) const;
+        // Pull and potential per unit mass at a scene position, for a field
+        // centred on origin and scaled by strength
+        void evaluate(const glm::dvec3& position, const glm::dvec3& origin, double G, double strength,
+                      glm::dvec3& acceleration, double& potential) const;
+    };
+
+    // PROFILE[:key=value,...], e.g. nfw:mass=2e28,scale=20000 or
+    // disk:mass=5e27,scale=3000,height=300. Keys: mass, speed, scale,
+    // height, q, x, y, z (centre), vx, vy, vz, ax, ay, az (axis) and grow.
+    bool parse(const std::string& spec, Potential& out);
+    // nfw, hernquist, disk or log
+    const char* profileName(Profile profile);
+}
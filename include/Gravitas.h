@@ -21,15 +21,7 @@
 #include <fstream>
 #include <sstream>
 #include "Mesh.h"
-
-// Physics Constants
-namespace Physics {
-    constexpr double G = 6.6743e-11;           // Gravitational constant (m^3 kg^-1 s^-2)
-    constexpr float LIGHT_SPEED = 299792458.0f; // Speed of light (m/s)
-    constexpr float TIME_SCALE = 94.0f;         // Time scaling factor
-    constexpr float ACCELERATION_DAMPING = 96.0f;
-    constexpr float SIZE_RATIO = 30000.0f;      // Size scaling for visual representation
-}
+#include "SimulationEngine.h"
 
 // Rendering Constants
 namespace Rendering {
@@ -131,15 +123,6 @@ enum class CollisionType {
     MERGE
 };
 
-// Simulation presets
-enum class SimulationPreset {
-    EMPTY,
-    SOLAR_SYSTEM,
-    BINARY_STARS,
-    GALAXY_COLLISION,
-    CUSTOM
-};
-
 // Trail point structure
 struct TrailPoint {
     glm::vec3 position;
@@ -223,56 +206,6 @@ public:
     void updateRadius();
 };
 
-// Simulation engine class
-class SimulationEngine {
-public:
-    void render(GLuint shaderProgram, GLuint trailShader, const glm::mat4& view, const glm::mat4& projection);
-    CelestialBody* getBodyById(size_t id);
-    void saveState(const std::string& filename);
-    void loadState(const std::string& filename);
-    void loadBodyFromFile(std::ifstream& file);
-    std::vector<CelestialBody*> getBodiesInRadius(const glm::vec3& center, float radius);
-    glm::vec3 getCenterOfMass() const;
-    float getTotalEnergy() const;
-    glm::vec3 randomPointOnSphere(float radius);
-    std::string formatScientific(float value, int precision = 3);
-
-    SimulationEngine();
-    ~SimulationEngine();
-    
-    void update(float deltaTime);
-    void removeBody(size_t id);
-    void clearBodies();
-    void loadPreset(SimulationPreset preset);
-    
-    // Physics calculations
-    void calculateGravitationalForces();
-    void updateGridDeformation();
-    glm::vec3 calculateCenterOfMass() const;
-    
-    // Grid management and rendering
-    void initializeGrid();
-    void renderGrid(GLuint shaderProgram, const glm::mat4& view, const glm::mat4& projection);
-	void generateMesh();
-	void addBody(std::unique_ptr<CelestialBody> body);
-	
-public:
-    bool showGrid;
-    bool isPaused;
-    bool enableCollisions;
-    bool enableRelativisticEffects;
-    float timeScale;
-    float gravitationalConstant = Physics::G;
-    GLuint gridVAO = 0, gridVBO = 0;
-    std::vector<std::unique_ptr<CelestialBody>> bodies;
-    const std::vector<std::unique_ptr<CelestialBody>>& getBodies() const;
-	std::vector<float> gridVertices;
-	std::vector<float> createGridVertices() const;
-    
-private:
-    void applySpacetimeDeformation();
-};
-
 // Camera system
 class Camera {
 public:
@@ -0,0 +1,4 @@
+#pragma once
+
+// Windowless entry point: `Gravitas --headless [options]` (src/Headless.cpp)
+int runHeadless(int argc, char** argv);
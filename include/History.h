@@ -0,0 +1,119 @@
+#pragma once
+
+// Bounded rewind history of a running engine, for scrubbing backwards in
+// the viewer. The steps are cut into segments. Each one opens with a
+// keyframe, a full copy of the bodies, test particles and integrator
+// settings, and then keeps every step's body positions and velocities as
+// frames. Once a segment is
+// complete its frames are compressed with the trajectory codec (Codec.h),
+// which stores each step as its residual against the two before it.
+//
+// A new segment starts every keyframeInterval steps, whenever the bodies
+// are added or removed, and after any edit (markEdited), so nothing inside
+// a segment depends on input that was not recorded. When the whole history
+// outgrows its memory budget the oldest segments are dropped.
+//
+// view() rebuilds any past step from the frames for display without
+// touching the engine. restore() puts the engine itself back at a step,
+// exactly: it copies the segment's keyframe and integrates forward on the
+// engine's threads (at most keyframeInterval - 1 steps). In fast mode the
+// symmetric force pass sums in a thread-dependent order, so the replayed
+// steps can differ from the originals in the last bits; deterministic mode
+// reproduces them bit for bit. Restoring discards everything after the
+// step, so the run continues from there as a new branch.
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include "SimulationEngine.h"
+
+struct HistoryConfig {
+    uint64_t keyframeInterval = 64;
+    size_t memoryBudget = size_t(256) << 20;    // Bytes for keyframes and frames together
+    // Largest error of the frames shown by view(); 0 keeps them exact.
+    // restore() is exact either way.
+    double positionTolerance = 0.0;
+    double velocityTolerance = 0.0;
+};
+
+class History {
+public:
+    struct Stats {
+        uint64_t segments = 0;
+        uint64_t frames = 0;
+        size_t keyframeBytes = 0;
+        size_t frameBytes = 0;          // Compressed, plus the open segment's raw frames
+        size_t rawFrameBytes = 0;       // The same frames uncompressed
+        uint64_t evictedSegments = 0;
+    };
+
+    explicit History(const HistoryConfig& config = HistoryConfig());
+
+    // Call after every step (and once before the first). A step that does
+    // not follow the last recorded one starts a new segment.
+    void record(const SimulationEngine& engine);
+    // The state was edited: the next record() starts a segment
+    void markEdited() { edited = true; }
+    void clear();
+
+    bool empty() const { return segments.empty(); }
+    uint64_t firstStep() const;
+    uint64_t lastStep() const;
+
+    // Bodies as they were at step, positions and velocities from the frames
+    bool view(uint64_t step, BodyStore& out);
+    // Rewinds engine to step and drops the history after it
+    bool restore(SimulationEngine& engine, uint64_t step);
+
+    Stats stats() const;
+
+private:
+    static constexpr size_t COLUMNS = 6;    // px, py, pz, vx, vy, vz
+
+    struct Segment {
+        uint64_t firstStep = 0;
+        uint64_t frames = 0;
+        BodyStore keyframe;
+        TestParticles particles;                // Only restored; view() shows bodies alone
+        bool deterministic = false;
+        bool enableCollisions = true;
+        float timeScale = 1.0f;
+        float gravitationalConstant = 0.0f;
+
+        std::vector<float> raw[COLUMNS];        // frames x bodies, while the segment is open
+        std::vector<uint8_t> encoded;           // Once sealed: per column a byte count and its stream
+        uint64_t encodedFrames = 0;             // Can exceed frames after a rewind into the segment
+        size_t keyframeBytes = 0;
+
+        uint64_t lastStep() const { return firstStep + frames - 1; }
+        bool sealed() const { return !encoded.empty(); }
+    };
+
+    HistoryConfig config;
+    std::deque<Segment> segments;
+    bool edited = false;
+    uint64_t evicted = 0;
+
+    // Decoded frames of one sealed segment, so scrubbing within it decodes once
+    const Segment* decodedSegment = nullptr;
+    std::vector<float> decoded[COLUMNS];
+
+    // Storage handed back by sealed and dropped segments for the next one
+    // to reuse: the raw frame columns, one evicted keyframe and the buffer
+    // frames are encoded into. Once the budget is reached, recording a
+    // segment allocates only its compressed frames and its test particles.
+    std::vector<float> spareFrames[COLUMNS];
+    BodyStore spareKeyframe;
+    std::vector<uint8_t> sealBuffer;
+    std::vector<uint8_t> sealStream;
+
+    void startSegment(const SimulationEngine& engine);
+    void seal(Segment& segment);
+    void retire(Segment& segment);
+    // Frames of segment as raw columns, decoding a sealed one
+    const std::vector<float>* framesOf(const Segment& segment);
+    Segment* segmentFor(uint64_t step);
+    void dropFrom(uint64_t step);
+    size_t segmentBytes(const Segment& segment) const;
+    void enforceBudget();
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+// Equilibrium initial conditions for SimulationEngine::addModel
+// (src/InitialConditions.cpp). The spherical models are drawn from their
+// isotropic distribution function: the King model has its own, the others
+// get theirs from Eddington's formula over a radial table of the density.
+// The disk model is an exponential disk, sech^2 in height, around a
+// Hernquist bulge. It rotates at the circular speed of both, less the
+// asymmetric drift, with a radial dispersion set by Toomre's Q.
+//
+// Lengths are scene units and masses kg. Velocities come out in the
+// engine's stored units, so a model is in equilibrium under its integrator.
+// Every body draws from its own Philox stream, keyed by the seed and its
+// index within the model, so the bodies are the same for any thread count.
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace InitialConditions {
+    enum class Model {
+        Plummer,
+        Hernquist,
+        NFW,        // Tapered exponentially beyond concentration * scaleRadius
+        Disk,       // Exponential disk with a Hernquist bulge
+        King
+    };
+
+    struct Config {
+        Model model = Model::Plummer;
+        size_t count = 10000;
+        uint64_t seed = 1;
+        double totalMass = 1e28;            // kg, bulge included
+        float scaleRadius = 5000.0f;        // Plummer and Hernquist a, NFW r_s, disk scale length, King core radius
+        float density = 1e6f;               // Of the bodies; only sets their radius
+
+        float concentration = 10.0f;        // NFW: virial radius over scaleRadius
+        float kingW0 = 6.0f;                // King: central potential over sigma^2
+        float bulgeFraction = 0.2f;         // Disk: share of the mass in the bulge
+        float bulgeRadius = 0.2f;           // Disk: bulge scale over the scale length
+        float diskHeight = 0.1f;            // Disk: sech^2 scale height over the scale length
+        float toomreQ = 1.2f;               // Disk: stability at 2.43 scale lengths
+
+        glm::vec3 position{0.0f};           // Of the centre of mass
+        glm::vec3 velocity{0.0f};           // Stored velocity units
+        glm::vec3 axis{0.0f, 1.0f, 0.0f};   // Disk: spin axis
+        glm::vec4 color{1.0f};
+        glm::vec4 bulgeColor{1.0f, 0.85f, 0.6f, 1.0f};
+    };
+
+    // plummer, hernquist, nfw, disk or king
+    bool parseModel(const std::string& name, Model& out);
+    const char* modelName(Model model);
+}
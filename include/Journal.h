@@ -0,0 +1,128 @@
+#pragma once
+
+// Session journals: every edit the physics thread applies, every rewind and
+// every raw input event of the viewer, stamped with the step it happened
+// at, so a session can be replayed headless (`--journal FILE`) step for step
+// and used as a benchmark workload.
+//
+//   JournalHeader
+//   JournalEntry*        in the order they happened
+//
+// The state the recording started from is saved next to the journal as a
+// checkpoint (path + ".start"). Edits are logged at the tick boundary where
+// the physics thread applied them, not when the UI queued them, so a replay
+// applies them between the same two steps. Input events only move the
+// camera; they are kept for inspection and ignored by headless replays.
+// A final End entry holds the state hash the session finished with, which
+// a replay compares against. Bit-identical replays need deterministic mode
+// or the same thread count (the fast force pass sums in thread order).
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "SimulationEngine.h"
+
+namespace Journal {
+    constexpr char MAGIC[8] = {'G', 'R', 'A', 'V', 'J', 'R', 'N', 'L'};
+    constexpr uint32_t VERSION = 1;
+    constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+    enum class Kind : uint8_t {
+        Command,        // type, flag, preset, bodyId, values: a SimulationCommand; code is
+                        // its index in the batch the physics thread applied it with
+        Rewind,         // bodyId holds the step the engine went back to
+        Key,            // code, action, mods
+        MouseButton,    // code, action, mods
+        CursorPos,      // values[0], values[1]
+        Scroll,         // values[0], values[1]
+        End             // bodyId holds the final state hash
+    };
+}
+
+struct JournalHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t headerSize;
+    uint32_t entrySize;
+    uint64_t startStep;
+    uint32_t threads;
+    uint8_t deterministic;
+    uint8_t reserved[19];
+};
+
+struct JournalEntry {
+    uint64_t step;
+    float time;             // Seconds since the recording started
+    uint8_t kind;           // Journal::Kind
+    uint8_t type;           // SimulationCommand::Type
+    uint8_t flag;
+    uint8_t preset;         // SimulationPreset
+    int32_t code;
+    int32_t action;
+    int32_t mods;
+    uint32_t count;         // Particles of an AddRing command
+    uint64_t bodyId;
+    float values[12];       // position, velocity, color, mass, density; value in [0]
+};
+
+static_assert(sizeof(JournalHeader) == 56, "Journal header layout changed");
+static_assert(sizeof(JournalEntry) == 88, "Journal entry layout changed");
+
+class JournalWriter {
+public:
+    JournalWriter() = default;
+    ~JournalWriter() { close(); }
+
+    JournalWriter(const JournalWriter&) = delete;
+    JournalWriter& operator=(const JournalWriter&) = delete;
+
+    // Saves engine as the start state; the engine must not be stepping
+    bool open(const std::string& path, const SimulationEngine& engine);
+    // Appends the End entry with the engine's final state, then closes
+    void finish(const SimulationEngine& engine);
+    void close();
+    bool isOpen() const { return recording.load(std::memory_order_relaxed); }
+
+    // Physics thread, as edits are applied and after every step
+    void commands(uint64_t step, const SimulationCommand* commands, size_t count);
+    void rewind(uint64_t step, uint64_t target);
+    void setStep(uint64_t step) { currentStep.store(step, std::memory_order_relaxed); }
+
+    // Any thread: raw input, stamped with the last step the physics thread reported
+    void input(Journal::Kind kind, int code, int action, int mods, float x = 0.0f, float y = 0.0f);
+
+    uint64_t entryCount() const { return entries; }
+
+private:
+    std::mutex mutex;
+    std::ofstream file;
+    std::string path;
+    std::atomic<bool> recording{false};
+    std::atomic<uint64_t> currentStep{0};
+    std::chrono::steady_clock::time_point start;
+    uint64_t entries = 0;
+
+    JournalEntry makeEntry(Journal::Kind kind, uint64_t step) const;
+    void write(const JournalEntry* entries, size_t count, bool flush);
+};
+
+class JournalReader {
+public:
+    bool open(const std::string& path);
+
+    const JournalHeader& header() const { return head; }
+    const std::vector<JournalEntry>& entries() const { return list; }
+    std::string startPath() const { return path + ".start"; }
+
+    static SimulationCommand toCommand(const JournalEntry& entry);
+
+private:
+    std::string path;
+    JournalHeader head{};
+    std::vector<JournalEntry> list;
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+// SIMD-across-systems integrator. Systems with a handful of bodies are too
+// small to vectorize internally, so instead LANES independent systems of
+// the same size are packed into the lanes of one vector register and
+// stepped in lockstep. Every per-lane loop below has a fixed trip count of
+// LANES over contiguous, aligned floats, which the compiler turns into
+// straight vector code (AVX with GRAVITAS_NATIVE / -mavx, SSE otherwise).
+//
+// The arithmetic mirrors SimulationEngine's deterministic force pass
+// operation for operation, so a lane reproduces a scalar run of the same
+// system bit for bit as long as both are compiled with the same flags.
+
+#include <cstdint>
+#include <vector>
+#include "SimulationEngine.h"
+
+#if defined(__AVX512F__)
+    #define GRAVITAS_LANES 16
+#else
+    #define GRAVITAS_LANES 8
+#endif
+
+class LaneSystems {
+public:
+    static constexpr size_t LANES = GRAVITAS_LANES;
+
+    float gravitationalConstant = static_cast<float>(Physics::G);
+    float timeScale = 1.0f;
+    bool enableCollisions = true;
+
+    explicit LaneSystems(size_t bodiesPerSystem);
+
+    size_t bodiesPerSystem() const { return n; }
+
+    // Packs one system into a lane and marks the lane active. Systems must
+    // all have bodiesPerSystem() bodies.
+    void load(size_t lane, const BodyStore& system);
+    // Copies a lane's positions and velocities back into a system
+    void store(size_t lane, BodyStore& system) const;
+
+    // A lane finishes once any body is farther than radius from centre
+    void setEscape(size_t lane, const glm::vec3& centre, float radius);
+
+    // Steps every active lane until it has run maxSteps ticks or escaped.
+    // Finished lanes are masked out and keep their final state.
+    void run(uint64_t maxSteps);
+
+    bool isActive(size_t lane) const { return active.v[lane] != 0; }
+    uint64_t stepsTaken(size_t lane) const { return steps[lane]; }
+
+private:
+    struct alignas(sizeof(float) * LANES) LaneFloat {
+        float v[LANES];
+    };
+    struct alignas(sizeof(uint32_t) * LANES) LaneMask {
+        uint32_t v[LANES];
+    };
+
+    size_t n;
+    std::vector<LaneFloat> px, py, pz, vx, vy, vz, ax, ay, az, mass, radius;
+    std::vector<LaneMask> hits;
+    LaneMask active{};
+    LaneFloat escapeX{}, escapeY{}, escapeZ{}, escapeR2{};
+    uint64_t steps[LANES] = {};
+
+    void computeForces();
+    void integrate();
+    bool updateActive(uint64_t maxSteps);
+};
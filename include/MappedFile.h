@@ -0,0 +1,32 @@
+#pragma once
+
+// Read-only file mapped copy-on-write: pages are loaded lazily by the OS,
+// and writes through data() land in private pages, never in the file.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+
+    bool isOpen() const { return base != nullptr; }
+    uint8_t* data() const { return base; }
+    size_t size() const { return length; }
+
+private:
+    uint8_t* base = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#endif
+};
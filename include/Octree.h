@@ -0,0 +1,73 @@
+#pragma once
+
+// Barnes-Hut octree over a set of point masses. Nodes are built over
+// Morton-sorted particles, so each node owns a contiguous particle range.
+// Used by the distributed backend (Distributed.h), which also exports
+// pruned copies of the tree to other ranks as pseudo-particles.
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+// A body, or a whole subtree collapsed to its centre of mass (radius 0)
+struct TreeParticle {
+    float x, y, z;
+    float mass;
+    float radius;
+};
+
+struct Bounds {
+    glm::vec3 min{0.0f};
+    glm::vec3 max{0.0f};
+
+    // Squared distance from p to the nearest point of the box
+    float distance2(const glm::vec3& p) const;
+};
+
+class Octree {
+public:
+    // Result of walking the tree for one target
+    struct Sample {
+        float ax = 0.0f, ay = 0.0f, az = 0.0f;  // Acceleration, scene units x m/s^2 per unit
+        double potential = 0.0;                 // J/kg
+        uint32_t overlaps = 0;                  // Direct partners closer than the sum of radii
+        uint32_t interactions = 0;              // Particle and node terms evaluated
+    };
+
+    void build(const std::vector<TreeParticle>& particles);
+
+    bool empty() const { return nodes.empty(); }
+    const Bounds& bounds() const { return rootBounds; }
+
+    // Monopole walk with opening angle theta. theta = 0 opens every node,
+    // which reduces to a direct sum.
+    Sample evaluate(const glm::vec3& target, float targetRadius, float theta, float G) const;
+
+    // Appends the part of the tree any target inside `region` needs: nodes
+    // that pass the opening test for the nearest point of the region are
+    // collapsed, leaves that do not are sent particle by particle
+    void exportFor(const Bounds& region, float theta, std::vector<TreeParticle>& out) const;
+
+private:
+    static constexpr uint32_t LEAF_SIZE = 8;
+    static constexpr int MAX_DEPTH = 21;
+
+    struct Node {
+        float cx, cy, cz;       // Centre of mass
+        float mass;
+        float size;             // Cube edge length
+        uint32_t begin, end;    // Particle range
+        uint32_t firstChild;    // Children are contiguous; 0 = leaf
+        uint32_t childCount;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<TreeParticle> sorted;
+    std::vector<uint64_t> keys;
+    Bounds rootBounds;
+
+    void buildNode(uint32_t index, uint32_t begin, uint32_t end, int depth, const glm::vec3& corner, float size);
+};
+
+// 63-bit Morton key of p inside the cube at origin with edge length size
+uint64_t mortonKey(const glm::vec3& p, const glm::vec3& origin, float size);
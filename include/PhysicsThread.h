@@ -0,0 +1,117 @@
+#pragma once
+
+// Runs a SimulationEngine on its own thread and publishes every completed
+// tick to the renderer through a triple buffer. Every tick also goes into a
+// rewind history (History.h) that the UI can scrub through, and optionally
+// into a session journal (Journal.h) for headless replay.
+
+#include <glm/glm.hpp>
+#include <array>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "CommandQueue.h"
+#include "History.h"
+#include "Journal.h"
+#include "SimulationEngine.h"
+#include "TripleBuffer.h"
+
+// Read-only copy of the engine state for the renderer and the UI
+struct SimulationSnapshot {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> velocities;
+    std::vector<float> mass;
+    std::vector<float> density;
+    std::vector<float> radius;
+    std::vector<glm::vec4> color;
+    std::vector<uint8_t> glow;
+    std::vector<uint64_t> ids;
+    std::vector<glm::vec3> particles;   // Test particles, always of the live state
+    uint64_t topologyVersion = 0;
+    uint64_t step = 0;
+    bool paused = false;
+    bool deterministic = false;
+    float timeScale = 1.0f;
+    double lastForceMs = 0.0;
+    double lastParticleMs = 0.0;
+    double totalEnergy = 0.0;
+    double energyDrift = 0.0;       // Relative to the energy after the last edit
+    double ticksPerSecond = 0.0;    // Measured physics rate
+    Diagnostics diagnostics;        // Of the step before step; invalid right after an edit
+
+    // Steps the rewind history covers, and whether step is one of them
+    // shown in place of the live state
+    uint64_t historyFirst = 0;
+    uint64_t historyLast = 0;
+    bool rewound = false;
+};
+
+class PhysicsThread {
+public:
+    explicit PhysicsThread(SimulationEngine& engine);
+    ~PhysicsThread();
+
+    PhysicsThread(const PhysicsThread&) = delete;
+    PhysicsThread& operator=(const PhysicsThread&) = delete;
+
+    void start();
+    void stop();
+
+    // Any thread: queue an edit for the next tick boundary. Returns false
+    // if the queue is full, in which case the edit is dropped.
+    bool submit(const SimulationCommand& command) { return commands.push(command); }
+
+    void setTargetRate(float ticksPerSecond) { targetRate.store(ticksPerSecond); }
+
+    // Logs every applied edit and rewind; set before start(), open or not
+    void setJournal(JournalWriter* writer) { journal = writer; }
+
+    // Any thread: show a past step from the history, pausing the engine.
+    // The newest request wins. Resuming, or any edit, rewinds the engine to
+    // the step shown and continues from there; seeking to the last step
+    // returns to the live state untouched.
+    void seek(uint64_t step) { seekRequest.store(int64_t(step)); }
+
+    // Render thread: latest complete snapshot, never blocks
+    const SimulationSnapshot& latest() {
+        snapshots.update();
+        return snapshots.readBuffer();
+    }
+
+    static constexpr size_t COMMAND_CAPACITY = 1024;
+    static constexpr size_t COMMAND_BATCH = 256;
+
+private:
+    SimulationEngine& engine;
+    TripleBuffer<SimulationSnapshot> snapshots;
+    std::thread worker;
+
+    CommandQueue<SimulationCommand, COMMAND_CAPACITY> commands;
+    std::array<SimulationCommand, COMMAND_BATCH> batch;
+
+    std::atomic<bool> running{false};
+    std::atomic<float> targetRate{60.0f};
+
+    double totalEnergy = 0.0;
+    double referenceEnergy = 0.0;  // First tracked energy after the last edit
+    bool referencePending = false;
+    double measuredRate = 0.0;
+
+    History history;
+    std::atomic<int64_t> seekRequest{-1};
+    int64_t shownStep = -1;         // Past step on display, -1 when live
+    BodyStore pastBodies;
+
+    JournalWriter* journal = nullptr;
+
+    void run();
+    bool drainCommands();
+    void showStep(uint64_t step);
+    void rewindToShown();
+    void resetEnergy();
+    void logCommands(const SimulationCommand* commands, size_t count) {
+        if (journal) journal->commands(engine.stepCount, commands, count);
+    }
+    void publish() { publish(engine.bodies, engine.stepCount); }
+    void publish(const BodyStore& bodies, uint64_t step);
+};
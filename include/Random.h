@@ -0,0 +1,59 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+// Counter-based generator (Philox4x32-10). Each output block is a pure
+// function of (seed, stream, index), so independent streams can be handed
+// to instances or particles without any shared state, and results never
+// depend on which thread draws them or in what order.
+class Philox {
+public:
+    Philox(uint64_t seed, uint64_t stream, uint64_t index = 0)
+        : key{static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32)}, stream(stream), index(index) {}
+
+    // Random access to the 128-bit block at a given counter value
+    std::array<uint32_t, 4> block(uint64_t at) const {
+        std::array<uint32_t, 4> ctr{static_cast<uint32_t>(at), static_cast<uint32_t>(at >> 32),
+                                    static_cast<uint32_t>(stream), static_cast<uint32_t>(stream >> 32)};
+        uint32_t k0 = key[0], k1 = key[1];
+        for (int round = 0; round < 10; ++round) {
+            const uint64_t p0 = uint64_t(0xD2511F53u) * ctr[0];
+            const uint64_t p1 = uint64_t(0xCD9E8D57u) * ctr[2];
+            ctr = {static_cast<uint32_t>(p1 >> 32) ^ ctr[1] ^ k0, static_cast<uint32_t>(p1),
+                   static_cast<uint32_t>(p0 >> 32) ^ ctr[3] ^ k1, static_cast<uint32_t>(p0)};
+            k0 += 0x9E3779B9u;
+            k1 += 0xBB67AE85u;
+        }
+        return ctr;
+    }
+
+    uint32_t nextU32() {
+        if (lane == 4) {
+            buffer = block(index++);
+            lane = 0;
+        }
+        return buffer[lane++];
+    }
+
+    // Uniform in [0, 1)
+    double uniform() {
+        const uint64_t bits = (uint64_t(nextU32()) << 21) ^ (nextU32() >> 11);
+        return bits * (1.0 / 9007199254740992.0);
+    }
+
+    // Standard normal (Box-Muller)
+    double normal() {
+        const double u1 = 1.0 - uniform();
+        const double u2 = uniform();
+        return std::sqrt(-2.0 * std::log(u1)) * std::cos(6.283185307179586 * u2);
+    }
+
+private:
+    std::array<uint32_t, 2> key;
+    uint64_t stream;
+    uint64_t index;
+    std::array<uint32_t, 4> buffer{};
+    int lane = 4;
+};
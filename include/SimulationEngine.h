@@ -0,0 +1,356 @@
+#pragma once
+
+// Headless N-body engine used by the viewer and by `Gravitas --headless`.
+// Nothing in here touches OpenGL, so it can run without a window.
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Arena.h"
+#include "ArrayImport.h"
+#include "Column.h"
+#include "ExternalField.h"
+#include "InitialConditions.h"
+#include "SpatialIndex.h"
+#include "ThreadPool.h"
+
+// Physics Constants
+namespace Physics {
+    constexpr double G = 6.6743e-11;           // Gravitational constant (m^3 kg^-1 s^-2)
+    constexpr float LIGHT_SPEED = 299792458.0f; // Speed of light (m/s)
+    constexpr float TIME_SCALE = 94.0f;         // Time scaling factor
+    constexpr float ACCELERATION_DAMPING = 96.0f;
+    constexpr float SIZE_RATIO = 30000.0f;      // Size scaling for visual representation
+    constexpr float METERS_PER_UNIT = 1000.0f;  // Scene units are kilometres
+    constexpr float COLLISION_RESTITUTION = -0.2f;
+}
+
+// Simulation presets
+enum class SimulationPreset {
+    EMPTY,
+    SOLAR_SYSTEM,
+    BINARY_STARS,
+    GALAXY_COLLISION,
+    CUSTOM
+};
+
+// Structure-of-arrays body storage shared by the force, integration and reduction passes
+struct BodyStore {
+    // Physical properties
+    Column<float> px, py, pz;
+    Column<float> vx, vy, vz;
+    Column<float> ax, ay, az;
+    Column<float> mass, density, radius;
+
+    // Visual properties
+    Column<glm::vec4> color;
+    Column<uint8_t> glow;
+
+    // Identification, unique for the lifetime of the store. Ids the store
+    // issues are generational handles: the low 32 bits name a slot that
+    // holds the body's current index, so indexOf() is O(1) and survives
+    // compaction. Every new id is at least nextId, so none is ever issued
+    // twice and a stale one finds its slot empty or holding another id.
+    Column<uint64_t> id;
+    uint64_t nextId = 1;
+
+    // Optional labels from scene files, by id so compaction never moves
+    // them. Not part of checkpoints.
+    std::unordered_map<uint64_t, std::string> names;
+
+    // Bumped whenever bodies are added, removed or reordered
+    uint64_t topologyVersion = 0;
+
+    static constexpr size_t npos = SIZE_MAX;
+
+    size_t size() const { return mass.size(); }
+    // Current index of the body with this id, or npos
+    size_t indexOf(uint64_t bodyId) const;
+    glm::vec3 position(size_t i) const { return glm::vec3(px[i], py[i], pz[i]); }
+    glm::vec3 velocity(size_t i) const { return glm::vec3(vx[i], vy[i], vz[i]); }
+
+    size_t add(const glm::vec3& pos, const glm::vec3& vel, float m, float d = 3344.0f,
+               const glm::vec4& c = glm::vec4(1.0f), bool isGlowing = false);
+    void reserve(size_t n);
+    // Appends count bodies with fresh ids and zeroed columns (white, not
+    // glowing) for generators to fill in place; returns the first index
+    size_t append(size_t count);
+    void clear();
+    // Drops every body whose flag is set, keeping the order of the rest
+    void removeFlagged(const std::vector<uint8_t>& flagged);
+    // Moves body order[i] to index i for every i; ids keep resolving to
+    // their bodies. scratch holds one column at a time while it moves.
+    void permute(const uint32_t* order, ScratchArena& scratch);
+
+    // FNV-1a over the raw position and velocity bits, to compare runs for bit-identity
+    uint64_t hash() const;
+
+    static float computeRadius(float mass, float density);
+
+private:
+    // Slot map, rebuilt from the id column whenever the columns changed
+    // behind its back (loads, imports, copies that bumped topologyVersion).
+    // Ids from elsewhere that do not look like handles fall back to a scan.
+    mutable std::vector<uint32_t> slotIndex;    // Per slot: body index or FREE_SLOT; slot 0 is never used
+    mutable std::vector<uint32_t> freeSlots;    // Min-heap, so the next id depends only on the live ids
+    mutable uint64_t slotsVersion = UINT64_MAX; // topologyVersion the map describes
+    mutable bool slotted = true;
+
+    void ensureSlots() const;
+    uint64_t issueId(uint32_t index);
+};
+
+// Massless test particles for rings, belts and comet clouds
+// (src/TestParticles.cpp). They move in the gravity of the bodies but pull
+// on nothing, so N of them cost O(bodies x N) per step instead of joining
+// the O(N^2) pair passes. While collisions are enabled, a particle that
+// falls inside a body is absorbed. The rewind history keeps them in its
+// keyframes and stateHash() covers them, but checkpoints, trajectories and
+// diagnostics leave them out.
+struct TestParticles {
+    Column<float> px, py, pz;
+    Column<float> vx, vy, vz;
+
+    // Bumped whenever particles are added or removed
+    uint64_t version = 0;
+
+    size_t size() const { return px.size(); }
+    glm::vec3 position(size_t i) const { return glm::vec3(px[i], py[i], pz[i]); }
+
+    void add(const glm::vec3& pos, const glm::vec3& vel);
+    // Appends count zeroed particles to fill in place; returns the first index
+    size_t append(size_t count);
+    void reserve(size_t n);
+    void clear();
+    void removeFlagged(const std::vector<uint8_t>& flagged);
+    // FNV-1a over positions and velocities, continuing from value
+    uint64_t hash(uint64_t value) const;
+};
+
+// Conservation quantities of the state a step started from. The potential
+// comes from the force pass of that step and everything else from the
+// integrator's pass over the bodies, so tracking them adds no pass of its own.
+struct Diagnostics {
+    uint64_t step = 0;
+    bool valid = false;
+    double mass = 0.0;
+    double kinetic = 0.0;               // J, velocities as stored
+    double potential = 0.0;             // J, same terms as getTotalEnergy()
+    glm::dvec3 momentum{0.0};
+    glm::dvec3 angularMomentum{0.0};    // About the origin, positions in metres
+    glm::dvec3 centerOfMass{0.0};       // Scene units
+
+    double total() const { return kinetic + potential; }
+};
+
+// An edit to the simulation from the UI. Plain data, so it can travel
+// through a lock-free queue without allocating.
+struct SimulationCommand {
+    enum class Type : uint8_t {
+        AddBody,
+        RemoveBody,
+        LoadPreset,
+        SetPaused,
+        SetTimeScale,
+        SetDeterministic,
+        AddRing,            // count particles about bodyId, radii position.x to position.y
+        ClearParticles
+    };
+
+    Type type = Type::SetPaused;
+    glm::vec3 position{0.0f};
+    glm::vec3 velocity{0.0f};
+    glm::vec4 color{1.0f};
+    float mass = 0.0f;
+    float density = 3344.0f;
+    float value = 0.0f;
+    bool flag = false;
+    uint64_t bodyId = 0;
+    uint32_t count = 0;
+    SimulationPreset preset = SimulationPreset::EMPTY;
+
+    static SimulationCommand addBody(const glm::vec3& pos, const glm::vec3& vel, float mass, float density,
+                                     const glm::vec4& color, bool isGlowing);
+    static SimulationCommand removeBody(uint64_t id);
+    static SimulationCommand loadPreset(SimulationPreset preset);
+    static SimulationCommand setPaused(bool paused);
+    static SimulationCommand setTimeScale(float scale);
+    static SimulationCommand setDeterministic(bool enabled);
+    static SimulationCommand addRing(uint64_t centreId, uint32_t count, float innerRadius, float outerRadius);
+    static SimulationCommand clearParticles();
+};
+
+class SimulationEngine {
+public:
+    BodyStore bodies;
+    TestParticles particles;
+
+    // Fixed-order blocked reductions: forces and energy are bit-identical
+    // for any thread count and schedule, at the cost of skipping the
+    // symmetric (Newton's third law) pair pass
+    bool deterministic = false;
+    bool enableCollisions = true;
+    bool isPaused = false;
+    float timeScale = 1.0f;
+    float gravitationalConstant = static_cast<float>(Physics::G);
+
+    // Analytic background potentials (ExternalField.h), summed into the
+    // force pass for bodies and test particles alike, and into the energy.
+    // Like the rest of the engine settings they are not checkpointed.
+    std::vector<ExternalField::Potential> externalField;
+
+    uint64_t stepCount = 0;
+    double lastForceMs = 0.0;   // Wall time of the last force pass
+    double lastParticleMs = 0.0;    // Wall time of the last test-particle pass
+
+    // While set, every step also fills diagnostics. The force pass then
+    // sums each body's potential next to its acceleration, which costs a
+    // few flops per pair; kinetic energy, momenta and the centre of mass
+    // ride along in the integrator. Blocks are summed in index order, so
+    // in deterministic mode the results are bit-identical for any thread count.
+    bool trackDiagnostics = false;
+    Diagnostics diagnostics;
+
+    // Morton (Z-order) body order (src/Reorder.cpp). Bodies that move apart
+    // in space stay next to each other in the columns, so walks over
+    // consecutive bodies (tree evaluation, neighbour queries) stop sharing
+    // nodes. Every reorderInterval steps, step() measures the disorder and
+    // re-sorts the bodies along the curve once it exceeds reorderThreshold.
+    // A reorder changes the summation order of later steps and counts as a
+    // topology change, so it is off unless asked for.
+    uint64_t reorderInterval = 0;       // 0 = never
+    double reorderThreshold = 0.1;
+    uint64_t reorderCount = 0;
+
+    explicit SimulationEngine(unsigned threadCount = 0);
+
+    void setThreadCount(unsigned threadCount);
+    unsigned getThreadCount() const { return pool.size(); }
+
+    // Advances the simulation by one tick
+    void step();
+    void clearBodies();
+    void removeBody(uint64_t id);
+    // Index of the body in bodies, or BodyStore::npos if it no longer exists
+    size_t getBodyById(uint64_t id) const { return bodies.indexOf(id); }
+    void loadPreset(SimulationPreset preset);
+
+    // Binary checkpoints (Checkpoint.h). Loading maps the file and adopts
+    // its columns in place, and restores the integrator state, so a run
+    // continues bit for bit from where it was saved.
+    bool saveState(const std::string& filename) const;
+    bool loadState(const std::string& filename);
+
+    // Replaces the bodies with arrays from .npy or raw files (ArrayImport.h),
+    // adopting them as columns where their layout allows, and restarts the
+    // step count
+    bool importArrays(const std::vector<ArrayImport::Source>& sources);
+
+    // Replaces the bodies with those of a text scene, one body per line
+    // (format in src/SceneFile.cpp), parsed in parallel blocks of lines
+    bool loadScene(const std::string& filename);
+
+    // Appends an equilibrium model (InitialConditions.h), sampled in parallel
+    // straight into the columns
+    void addModel(const InitialConditions::Config& config);
+
+    // Test particles on circular orbits about body centre, spread evenly
+    // over the annulus between inner and outer radius normal to axis, with
+    // a 1-sigma height of thickness times the radius. Orbits are about the
+    // centre alone, so the other bodies perturb them from the first step.
+    void addRing(size_t centre, size_t count, float inner, float outer, uint64_t seed,
+                 const glm::vec3& axis = glm::vec3(0.0f, 1.0f, 0.0f), float thickness = 0.01f);
+    // Same, on circular orbits of random orientation with radii uniform in
+    // volume between inner and outer: a comet cloud
+    void addCloud(size_t centre, size_t count, float inner, float outer, uint64_t seed);
+
+    // Applies a batch of queued edits at a step boundary. Removals are
+    // collected and compacted in a single pass over the columns.
+    void applyCommands(const SimulationCommand* commands, size_t count);
+
+    // Physics calculations
+    void calculateGravitationalForces();
+    double getTotalEnergy() const;
+    // Sum of the external fields at a scene position, J/kg
+    double externalPotential(const glm::vec3& position) const;
+    glm::vec3 calculateCenterOfMass() const;
+    // Hash of the bodies and then the test particles; the bodies' own hash
+    // while there are no particles
+    uint64_t stateHash() const { return particles.hash(bodies.hash()); }
+    // G in scene units (km^3 kg^-1 tick^-2): a tick drifts v / TIME_SCALE
+    // units and kicks a / ACCELERATION_DAMPING with a in m/s^2, so stored
+    // velocities are TIME_SCALE times units per tick. Independent of timeScale,
+    // which speeds up drift and kick alike.
+    double sceneGravitationalConstant() const;
+
+    // Share of bodies that come before their predecessor on the Morton
+    // curve, at a resolution of about one body per cell: 0 when sorted,
+    // about 0.5 for a random order
+    double bodyDisorder() const;
+    // Sorts the bodies along the Morton curve of their bounding cube. order
+    // receives the old index of every new position, for callers that keep
+    // per-body arrays of their own.
+    void reorderBodies();
+    void reorderBodies(std::vector<uint32_t>& order);
+
+    // Kd-tree over the bodies as they are now, rebuilt on first use after
+    // a step, a load or a change to the body set. Query results are body indices.
+    const SpatialIndex& spatialIndex();
+    void getBodiesInRadius(const glm::vec3& centre, float radius, std::vector<uint32_t>& out);
+
+    // Kick and drift using the accelerations already in bodies.ax/ay/az, so
+    // force passes that live outside the engine (Distributed.h) share the
+    // integrator. With trackDiagnostics set it fills diagnostics on the way,
+    // taking the potential energy from potentials (J/kg per body) if given.
+    void integrate(const std::vector<uint32_t>& overlapCounts, const std::vector<double>* potentials = nullptr);
+
+private:
+    // Below this many bodies the passes run on the calling thread
+    static constexpr size_t PARALLEL_THRESHOLD = 256;
+    // Rows per reduction block. Fixed so that the blocking never depends on the thread count
+    static constexpr size_t REDUCTION_BLOCK = 64;
+
+    mutable ThreadPool pool;
+    std::vector<uint32_t> overlaps;             // Overlapping partners per body
+    std::vector<double> potential;              // Per body, J/kg, while tracking diagnostics
+    std::vector<uint8_t> removalFlags;
+    std::vector<uint8_t> absorbed;              // Per test particle, set inside a body
+    // Temporaries of a single pass: per-worker accumulators, reduction blocks
+    mutable ScratchArena scratch;
+
+    SpatialIndex index;
+    uint64_t indexStep = UINT64_MAX;
+    uint64_t indexTopology = UINT64_MAX;
+
+    bool runsParallel() const { return pool.size() > 1 && bodies.size() >= PARALLEL_THRESHOLD; }
+    void runTasks(size_t taskCount, const ThreadPool::Task& fn) const;
+
+    template <bool Potential> void forcesSymmetricSerial();
+    template <bool Potential> void forcesSymmetricParallel();
+    template <bool Potential> void forcesDeterministic();
+    // Adds the external fields' pull on count points to ax/ay/az, and twice
+    // their potential to phi if given (src/ExternalField.cpp)
+    void addExternalField(const float* x, const float* y, const float* z, size_t count, float* ax, float* ay,
+                          float* az, double* phi) const;
+    void applyExternalField();
+    // Kicks and drifts the test particles in the field of the bodies as
+    // they are before this step's drift
+    void stepParticles();
+
+    // Morton keys of the bodies, coarsened to bits per key
+    void mortonKeys(uint32_t* keys, int bits) const;
+    // Sorted positions for the old indices, in scratch
+    const uint32_t* mortonOrder();
+};
+
+// Built-in initial conditions that do not need a window
+namespace Presets {
+    void loadSolarSystem(SimulationEngine& engine);
+    void loadBinaryStars(SimulationEngine& engine);
+    void loadRandomCluster(SimulationEngine& engine, size_t count, uint32_t seed);
+    // Two disk galaxies on a collision course (src/InitialConditions.cpp)
+    constexpr size_t GALAXY_BODIES = 4000;
+    void loadGalaxyCollision(SimulationEngine& engine, size_t count = GALAXY_BODIES, uint64_t seed = 1);
+}
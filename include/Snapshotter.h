@@ -0,0 +1,77 @@
+#pragma once
+
+// Checkpoints that do not pause the run for the write. On POSIX systems
+// save() fork()s: the child inherits a copy-on-write image of the engine,
+// writes it with SimulationEngine::saveState and exits, while the parent
+// goes straight back to stepping. The parent only pays for the fork itself
+// (copying page tables, a few ms per GB), plus a page copy for every page
+// it writes while a child still holds the old one, so memory can reach
+// twice the state while a snapshot is in flight.
+// Children are reaped by poll(), which the owner calls now and then (once
+// per step is fine), and by wait() and the destructor.
+// Call save() between steps, from the thread that steps the engine: the
+// child gets only that thread, and the state must not be mid-update.
+// Windows has no fork, so there save() writes synchronously.
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "SimulationEngine.h"
+
+struct SnapshotConfig {
+    size_t maxInFlight = 2;         // Snapshots being written at once
+    // What save() does when maxInFlight are running, or one is already
+    // writing the same path
+    enum class WhenBusy { Skip, Wait } whenBusy = WhenBusy::Skip;
+    bool background = true;         // false writes in the calling thread
+};
+
+class Snapshotter {
+public:
+    struct Stats {
+        uint64_t started = 0;
+        uint64_t completed = 0;
+        uint64_t failed = 0;
+        uint64_t skipped = 0;
+        double pauseSeconds = 0.0;      // Time save() held the caller, in total
+        double longestPause = 0.0;
+        double longestWrite = 0.0;      // From fork to the child's exit
+    };
+
+    explicit Snapshotter(const SnapshotConfig& config = SnapshotConfig());
+    ~Snapshotter();
+
+    Snapshotter(const Snapshotter&) = delete;
+    Snapshotter& operator=(const Snapshotter&) = delete;
+
+    // Starts a checkpoint of the engine's current state to path; false when
+    // it was skipped or could not be started. Completion is reported later.
+    bool save(const SimulationEngine& engine, const std::string& path);
+    // Reaps finished snapshots without blocking
+    void poll();
+    // Blocks until every snapshot has finished
+    void wait();
+
+    size_t inFlight() const { return pending.size(); }
+    Stats stats() const { return counters; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Pending {
+        int pid;
+        std::string path;
+        Clock::time_point start;
+    };
+
+    SnapshotConfig config;
+    std::vector<Pending> pending;
+    Stats counters;
+
+    bool saveInProcess(const SimulationEngine& engine, const std::string& path);
+    // Reaps pending[index], blocking when asked; false if it is still running
+    bool reap(size_t index, bool block);
+    void finish(size_t index, bool ok, const std::string& reason);
+    void recordPause(Clock::time_point start);
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+// Kd-tree over body positions for the queries that would otherwise scan
+// every body: bodies within a radius, the k nearest, bodies in a box, and
+// the first body sphere a ray hits (picking). Built from plain position and
+// radius arrays, so it indexes an engine's BodyStore as well as a renderer
+// snapshot; results are indices into those arrays.
+//
+// Building is O(N log N) (median splits on the widest axis) and meant to
+// happen once per step; queries never allocate beyond their output.
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Octree.h"
+
+class SpatialIndex {
+public:
+    struct Hit {
+        uint32_t index = 0;
+        float distance = 0.0f;  // Along the ray to the sphere's surface
+    };
+
+    // radius may be null for point-only data; rays then never hit
+    void build(const float* x, const float* y, const float* z, const float* radius, size_t count);
+    void build(const std::vector<glm::vec3>& positions, const std::vector<float>& radii);
+    void clear();
+
+    bool empty() const { return nodes.empty(); }
+    size_t size() const { return points.size(); }
+
+    // Appends the bodies whose centres lie within radius of centre
+    void radius(const glm::vec3& centre, float radius, std::vector<uint32_t>& out) const;
+    // The k bodies nearest to p, nearest first, replacing out
+    void nearest(const glm::vec3& p, size_t k, std::vector<uint32_t>& out) const;
+    // Appends the bodies whose centres lie inside region
+    void box(const Bounds& region, std::vector<uint32_t>& out) const;
+    // First body sphere along the ray within maxDistance; direction need not be normalised
+    bool raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, Hit& hit) const;
+
+private:
+    static constexpr uint32_t LEAF_SIZE = 8;
+
+    struct Point {
+        float x, y, z;
+        float radius;
+        uint32_t index;
+    };
+
+    struct Node {
+        Bounds bounds;          // Of the centres
+        float maxRadius;        // Largest sphere below, to widen bounds for rays
+        uint32_t begin, end;    // Point range
+        uint32_t firstChild;    // Two children, adjacent; 0 = leaf
+    };
+
+    std::vector<Point> points;  // In tree order
+    std::vector<Node> nodes;
+
+    void buildTree();
+    void buildNode(uint32_t index, uint32_t begin, uint32_t end);
+};
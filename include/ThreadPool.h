@@ -0,0 +1,135 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Persistent worker pool for the physics passes. The calling thread takes part
+// in every job, so a pool of size 1 simply runs everything inline.
+// run() is not re-entrant: do not call it from inside a task of the same pool.
+class ThreadPool {
+public:
+    // Non-owning reference to fn(task, worker). A job only runs while run()
+    // is on the stack, so unlike std::function it never copies the callable
+    // and never allocates, whatever the lambda captures.
+    class Task {
+    public:
+        template <typename Fn, typename = std::enable_if_t<!std::is_same<std::decay_t<Fn>, Task>::value>>
+        Task(Fn&& fn) : callable(const_cast<void*>(static_cast<const void*>(std::addressof(fn)))),
+                        invoke(&call<std::remove_reference_t<Fn>>) {}
+
+        void operator()(size_t task, unsigned worker) const { invoke(callable, task, worker); }
+
+    private:
+        void* callable;
+        void (*invoke)(void*, size_t, unsigned);
+
+        template <typename Fn>
+        static void call(void* fn, size_t task, unsigned worker) { (*static_cast<Fn*>(fn))(task, worker); }
+    };
+
+    explicit ThreadPool(unsigned threadCount = 0) { resize(threadCount); }
+    ~ThreadPool() { stop(); }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Number of threads taking part in a job (workers + caller)
+    unsigned size() const { return static_cast<unsigned>(workers.size()) + 1; }
+
+    // 0 means one thread per hardware thread
+    void resize(unsigned threadCount) {
+        if (threadCount == 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+        stop();
+        stopping = false;
+        for (unsigned i = 1; i < threadCount; ++i) {
+            workers.emplace_back([this, i, start = generation] { workerLoop(i, start); });
+        }
+    }
+
+    // Runs fn(task, worker) for every task in [0, taskCount). Tasks are handed
+    // out dynamically, so which worker runs which task is NOT fixed.
+    void run(size_t taskCount, const Task& fn) {
+        if (taskCount == 0) return;
+        if (workers.empty() || taskCount == 1) {
+            for (size_t t = 0; t < taskCount; ++t) fn(t, 0);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &fn;
+            jobTasks = taskCount;
+            nextTask.store(0, std::memory_order_relaxed);
+            busyWorkers = workers.size();
+            ++generation;
+        }
+        wake.notify_all();
+        drain(fn, 0);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return busyWorkers == 0; });
+        job = nullptr;
+    }
+
+    // Splits [0, count) into one contiguous range per thread: fn(begin, end, worker)
+    template <typename Fn>
+    void parallelFor(size_t count, Fn&& fn) {
+        const size_t chunks = std::min<size_t>(size(), count);
+        run(chunks, [&](size_t chunk, unsigned worker) {
+            fn(count * chunk / chunks, count * (chunk + 1) / chunks, worker);
+        });
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+
+    const Task* job = nullptr;
+    size_t jobTasks = 0;
+    std::atomic<size_t> nextTask{0};
+    size_t busyWorkers = 0;
+    uint64_t generation = 0;
+    bool stopping = false;
+
+    void drain(const Task& fn, unsigned worker) {
+        for (size_t t = nextTask.fetch_add(1); t < jobTasks; t = nextTask.fetch_add(1)) {
+            fn(t, worker);
+        }
+    }
+
+    void workerLoop(unsigned worker, uint64_t seen) {
+        for (;;) {
+            const Task* current = nullptr;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping) return;
+                seen = generation;
+                current = job;
+            }
+            drain(*current, worker);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--busyWorkers == 0) done.notify_one();
+            }
+        }
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) worker.join();
+        workers.clear();
+    }
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+// Trajectory files: every k-th step of every body, for offline analysis.
+//
+//   TrajectoryHeader
+//   chunk*       TrajectoryChunk + payload, each on a CHUNK_ALIGNMENT boundary
+//   index        TrajectoryIndexEntry[chunkCount], at header.indexOffset
+//
+// A chunk holds up to framesPerChunk consecutive frames with the same set
+// of bodies, stored column by column so a reader can pull one quantity for
+// a whole time range. Payload of a RAW chunk, all in native byte order:
+//
+//   uint64_t  step[frameCount]
+//   uint64_t  id[bodyCount]
+//   float     mass[bodyCount], density[bodyCount]
+//   glm::vec4 color[bodyCount]
+//   uint8_t   glow[bodyCount], zero padded to a multiple of 8
+//   float     px[frameCount][bodyCount], then py, pz, vx, vy, vz
+//
+// A QUANTIZED chunk has the same layout up to the glow padding, then per
+// column (px .. vz) a uint64_t byte count and that many bytes of
+// Codec::encodeColumn output, zero padded to a multiple of 8.
+//
+// The per-body properties let a viewer draw the run without the scene it
+// came from.
+//
+// The header and index are rewritten when the file is closed; a file whose
+// indexOffset is still 0 was not closed cleanly, and its chunks can be
+// recovered by walking them from the header onwards.
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Trajectory {
+    constexpr char MAGIC[8] = {'G', 'R', 'A', 'V', 'T', 'R', 'A', 'J'};
+    constexpr uint32_t VERSION = 2;
+    constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+    constexpr uint64_t CHUNK_ALIGNMENT = 64;
+    constexpr uint32_t COLUMN_COUNT = 6;    // px, py, pz, vx, vy, vz
+
+    enum Codec : uint32_t {
+        RAW = 0,
+        QUANTIZED = 1   // Codec.h, error bounded or lossless
+    };
+}
+
+struct TrajectoryHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t headerSize;
+    uint32_t framesPerChunk;
+    uint64_t stride;            // Steps between frames
+    uint64_t frameCount;
+    uint64_t chunkCount;
+    uint64_t indexOffset;       // 0 until the file is closed
+    uint8_t reserved[16];
+};
+
+struct TrajectoryChunk {
+    uint64_t firstFrame;
+    uint32_t frameCount;
+    uint32_t bodyCount;
+    uint32_t codec;
+    uint32_t reserved;
+    uint64_t topologyVersion;   // BodyStore::topologyVersion of the body set
+    uint64_t bytes;             // Payload size following this header
+};
+
+struct TrajectoryIndexEntry {
+    uint64_t offset;            // Of the TrajectoryChunk
+    uint64_t firstFrame;
+    uint64_t firstStep;
+    uint32_t frameCount;
+    uint32_t bodyCount;
+    uint64_t topologyVersion;
+};
+
+static_assert(sizeof(TrajectoryHeader) == 72, "Trajectory header layout changed");
+static_assert(sizeof(TrajectoryChunk) == 40, "Trajectory chunk layout changed");
+static_assert(sizeof(TrajectoryIndexEntry) == 40, "Trajectory index layout changed");
@@ -0,0 +1,70 @@
+#pragma once
+
+// Random access into a trajectory file (Trajectory.h). The file is mapped,
+// so opening reads the header and index only, and any frame is found in
+// O(1) through a frame -> chunk table; its columns are handed out as
+// pointers into the mapping. QUANTIZED chunks are decoded whole, one
+// column per thread, into a small cache on first touch, so scrubbing
+// within a chunk costs nothing. frame() is not safe to call from several
+// threads at once.
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "MappedFile.h"
+#include "ThreadPool.h"
+#include "Trajectory.h"
+
+struct TrajectoryFrame {
+    uint64_t step = 0;
+    uint64_t topologyVersion = 0;   // Changes whenever the body set does
+    size_t bodyCount = 0;
+
+    const uint64_t* ids = nullptr;
+    const float* mass = nullptr;
+    const float* density = nullptr;
+    const glm::vec4* color = nullptr;
+    const uint8_t* glow = nullptr;
+
+    const float* px = nullptr; const float* py = nullptr; const float* pz = nullptr;
+    const float* vx = nullptr; const float* vy = nullptr; const float* vz = nullptr;
+
+    glm::vec3 position(size_t i) const { return glm::vec3(px[i], py[i], pz[i]); }
+    glm::vec3 velocity(size_t i) const { return glm::vec3(vx[i], vy[i], vz[i]); }
+};
+
+class TrajectoryReader {
+public:
+    bool open(const std::string& path);
+    void close();
+    bool isOpen() const { return file.isOpen(); }
+
+    size_t frameCount() const { return frameChunk.size(); }
+    uint64_t stride() const { return strideSteps; }
+
+    // Views into the mapping or the decode cache, valid until close() or
+    // until frames from CACHED_CHUNKS other chunks have been read
+    bool frame(size_t index, TrajectoryFrame& out) const;
+
+    static constexpr size_t CACHED_CHUNKS = 2;   // Enough to blend between neighbouring frames
+
+private:
+    struct DecodedChunk {
+        size_t chunk = SIZE_MAX;
+        uint64_t lastUse = 0;
+        std::vector<float> columns;     // COLUMN_COUNT x frames x bodies
+    };
+
+    MappedFile file;
+    std::vector<TrajectoryIndexEntry> chunks;
+    std::vector<uint32_t> frameChunk;   // Chunk holding each frame
+    uint64_t strideSteps = 1;
+    mutable DecodedChunk cache[CACHED_CHUNKS];
+    mutable uint64_t cacheClock = 0;
+    mutable std::unique_ptr<ThreadPool> decoders;  // Started by the first QUANTIZED chunk
+
+    void recoverIndex(uint64_t firstChunk);
+    const float* decodeChunk(size_t chunkIndex, const uint8_t* columns, const uint8_t* end) const;
+};
@@ -0,0 +1,131 @@
+#pragma once
+
+// Background trajectory output. The stepping thread copies the body
+// columns into one of a fixed set of frame buffers and moves on; a writer
+// thread packs the frames into chunks (Trajectory.h) and does all file I/O.
+// When every buffer is waiting for the disk, capture() either blocks until
+// one frees up or drops the frame, as configured.
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "SimulationEngine.h"
+#include "Trajectory.h"
+
+struct TrajectoryConfig {
+    enum class Backpressure {
+        Block,      // Stall the step until the writer catches up
+        Drop        // Skip the frame and count it
+    };
+
+    uint64_t every = 1;             // Steps between frames
+    size_t queueDepth = 8;          // Frame buffers between the step and the disk
+    uint32_t framesPerChunk = 16;
+    Backpressure backpressure = Backpressure::Block;
+
+    // QUANTIZED keeps every value within its tolerance; 0 is lossless
+    Trajectory::Codec codec = Trajectory::RAW;
+    double positionTolerance = 0.0;
+    double velocityTolerance = 0.0;
+};
+
+class TrajectoryWriter {
+public:
+    struct Stats {
+        uint64_t framesCaptured = 0;
+        uint64_t framesWritten = 0;
+        uint64_t framesDropped = 0;
+        uint64_t chunksWritten = 0;
+        uint64_t bytesWritten = 0;
+        uint64_t columnBytesIn = 0;     // Position and velocity data before and after coding
+        uint64_t columnBytesOut = 0;
+        double blockedSeconds = 0.0;    // Stepping thread waiting for a free buffer
+        double writeSeconds = 0.0;      // Writer thread busy packing and writing
+    };
+
+    explicit TrajectoryWriter(const TrajectoryConfig& config = TrajectoryConfig());
+    ~TrajectoryWriter();
+
+    TrajectoryWriter(const TrajectoryWriter&) = delete;
+    TrajectoryWriter& operator=(const TrajectoryWriter&) = delete;
+
+    bool open(const std::string& path);
+    // Writes out everything queued, then the index
+    void close();
+    bool isOpen() const { return worker.joinable(); }
+
+    // Call after each step on the stepping thread. Steps off the stride are
+    // ignored; returns false only when a frame was due but dropped.
+    bool capture(const SimulationEngine& engine);
+
+    Stats stats() const;
+
+private:
+    // Per-body properties, sent only when the body set changes
+    struct BodySet {
+        std::vector<uint64_t> ids;
+        std::vector<float> mass, density;
+        std::vector<glm::vec4> color;
+        std::vector<uint8_t> glow;
+    };
+
+    struct Frame {
+        uint64_t step = 0;
+        uint64_t topologyVersion = 0;
+        bool hasBodies = false;
+        BodySet bodies;
+        std::vector<float> columns[Trajectory::COLUMN_COUNT];
+    };
+
+    TrajectoryConfig config;
+    std::string path;
+    std::ofstream file;
+    std::thread worker;
+
+    // Buffers cycle free -> pending -> free; nothing is allocated once they have grown
+    std::vector<std::unique_ptr<Frame>> frames;
+    std::deque<Frame*> freeFrames;
+    std::deque<Frame*> pendingFrames;
+    std::mutex mutex;
+    std::condition_variable frameFreed;
+    std::condition_variable frameQueued;
+    bool stopping = false;
+
+    // Body set the writer already has, stepping thread only
+    uint64_t sentTopology = 0;
+    bool sentBodies = false;
+
+    // Chunk being assembled, writer thread only
+    std::vector<uint64_t> chunkSteps;
+    BodySet chunkBodies;
+    std::vector<float> chunkColumns[Trajectory::COLUMN_COUNT];
+    std::vector<uint8_t> encoded;
+    uint64_t chunkTopology = 0;
+    std::vector<TrajectoryIndexEntry> index;
+    uint64_t frameCount = 0;
+    uint64_t fileOffset = 0;
+    bool failed = false;
+
+    std::atomic<uint64_t> framesCaptured{0};
+    std::atomic<uint64_t> framesWritten{0};
+    std::atomic<uint64_t> framesDropped{0};
+    std::atomic<uint64_t> chunksWritten{0};
+    std::atomic<uint64_t> bytesWritten{0};
+    std::atomic<uint64_t> columnBytesIn{0};
+    std::atomic<uint64_t> columnBytesOut{0};
+    std::atomic<double> blockedSeconds{0.0};
+    std::atomic<double> writeSeconds{0.0};
+
+    void run();
+    void append(const Frame& frame);
+    void flushChunk();
+    void write(const void* data, size_t bytes);
+    void padToAlignment();
+    TrajectoryHeader makeHeader(uint64_t indexOffset) const;
+};
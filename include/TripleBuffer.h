@@ -0,0 +1,40 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Lock-free single-producer / single-consumer triple buffer. The producer
+// always owns one slot to write into, the consumer always owns one slot to
+// read from, and the third slot is swapped between them atomically, so
+// neither side ever blocks on the other. The consumer only ever sees
+// complete states and skips any it was too slow to pick up.
+template <typename T>
+class TripleBuffer {
+public:
+    // Producer side: the slot to fill next
+    T& writeBuffer() { return buffers[back]; }
+
+    // Producer side: hand the filled slot over and take the spare one back
+    void publish() {
+        back = middle.exchange(static_cast<uint8_t>(back | DIRTY), std::memory_order_acq_rel) & INDEX;
+    }
+
+    // Consumer side: switch to the newest published slot, if there is one
+    bool update() {
+        if (!(middle.load(std::memory_order_relaxed) & DIRTY)) return false;
+        front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+
+    // Consumer side: the newest slot picked up by update()
+    const T& readBuffer() const { return buffers[front]; }
+
+private:
+    static constexpr uint8_t INDEX = 0x3;
+    static constexpr uint8_t DIRTY = 0x4;
+
+    T buffers[3];
+    uint8_t back = 0;
+    uint8_t front = 1;
+    std::atomic<uint8_t> middle{2};
+};
@@ -0,0 +1,359 @@
+#include "ArrayImport.h"
+#include "MappedFile.h"
+#include "SimulationEngine.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <type_traits>
+
+// SimulationEngine::importArrays lives here, next to the formats it reads
+
+namespace {
+    enum class ElementType { Float32, Float64, UInt64, Int64 };
+
+    size_t elementSize(ElementType type) { return type == ElementType::Float32 ? 4 : 8; }
+
+    // A mapped 1-D or 2-D array
+    struct Array {
+        std::shared_ptr<MappedFile> file;
+        uint8_t* data = nullptr;
+        ElementType type = ElementType::Float32;
+        uint64_t rows = 0;
+        uint64_t columns = 1;
+        bool fortranOrder = false;
+
+        uint8_t* element(uint64_t row, uint64_t column) const {
+            const uint64_t index = fortranOrder ? column * rows + row : row * columns + column;
+            return data + index * elementSize(type);
+        }
+        // Component column's values sit next to each other
+        bool contiguous() const { return columns == 1 || fortranOrder; }
+    };
+
+    bool hostIsLittleEndian() {
+        const uint16_t probe = 1;
+        uint8_t first;
+        std::memcpy(&first, &probe, 1);
+        return first == 1;
+    }
+
+    bool parseType(const std::string& name, ElementType& type) {
+        if (name == "f4") type = ElementType::Float32;
+        else if (name == "f8") type = ElementType::Float64;
+        else if (name == "u8") type = ElementType::UInt64;
+        else if (name == "i8") type = ElementType::Int64;
+        else return false;
+        return true;
+    }
+
+    // Value of key in the header's Python dict literal, up to the next ',' or
+    // the closing ')' of a tuple; empty when the key or its end is missing
+    std::string headerValue(const std::string& header, const char* key) {
+        const size_t at = header.find(std::string("'") + key + "'");
+        if (at == std::string::npos) return std::string();
+        size_t begin = header.find(':', at);
+        if (begin == std::string::npos) return std::string();
+        ++begin;
+        while (begin < header.size() && header[begin] == ' ') ++begin;
+        if (begin >= header.size()) return std::string();
+        if (header[begin] == '(') {
+            const size_t close = header.find(')', begin);
+            return close == std::string::npos ? std::string() : header.substr(begin, close + 1 - begin);
+        }
+        const size_t end = header.find_first_of(",}", begin);
+        return end == std::string::npos ? std::string() : header.substr(begin, end - begin);
+    }
+
+    // Reads the .npy header: format version, dtype, order and shape
+    bool readNpyHeader(Array& array, const std::string& path) {
+        const uint8_t* bytes = array.file->data();
+        const size_t size = array.file->size();
+        if (size < 10 || std::memcmp(bytes, "\x93NUMPY", 6) != 0) {
+            std::cerr << path << " is not a .npy file" << std::endl;
+            return false;
+        }
+        const uint8_t major = bytes[6];
+        size_t headerStart = 10, headerLength = size_t(bytes[8]) | size_t(bytes[9]) << 8;
+        if (major >= 2 && size >= 12) {
+            headerStart = 12;
+            headerLength |= size_t(bytes[10]) << 16 | size_t(bytes[11]) << 24;
+        }
+        if (major < 1 || major > 3 || headerStart + headerLength > size) {
+            std::cerr << path << " has an unsupported .npy header" << std::endl;
+            return false;
+        }
+        const std::string header(reinterpret_cast<const char*>(bytes) + headerStart, headerLength);
+
+        // '<f4', or '|' for single bytes and '=' for native order
+        std::string descr = headerValue(header, "descr");
+        if (descr.size() != 5 || (descr[0] != '\'' && descr[0] != '"')) {
+            std::cerr << path << " has dtype " << descr << ", only plain numeric arrays are supported" << std::endl;
+            return false;
+        }
+        const char order = descr[1];
+        if (order == '>' || ((order == '<') != hostIsLittleEndian() && order != '=' && order != '|') ||
+            !parseType(descr.substr(2, 2), array.type)) {
+            std::cerr << path << " has dtype " << descr << ", expected native float32, float64, uint64 or int64"
+                      << std::endl;
+            return false;
+        }
+        array.fortranOrder = headerValue(header, "fortran_order") == "True";
+
+        // (N,) or (N, k)
+        const std::string shape = headerValue(header, "shape");
+        std::vector<uint64_t> dims;
+        for (size_t i = 0; i < shape.size();) {
+            if (shape[i] >= '0' && shape[i] <= '9') {
+                char* end = nullptr;
+                dims.push_back(std::strtoull(shape.c_str() + i, &end, 10));
+                i = size_t(end - shape.c_str());
+            } else {
+                ++i;
+            }
+        }
+        if (dims.empty() || dims.size() > 2) {
+            std::cerr << path << " has shape " << shape << ", expected (N,) or (N, k)" << std::endl;
+            return false;
+        }
+        array.rows = dims[0];
+        array.columns = dims.size() == 2 ? dims[1] : 1;
+        array.data = array.file->data() + headerStart + headerLength;
+        return true;
+    }
+
+    bool openArray(const ArrayImport::Source& source, uint64_t components, Array& array) {
+        array.file = std::make_shared<MappedFile>();
+        if (!array.file->open(source.path)) return false;
+
+        const std::string& path = source.path;
+        const bool npy = path.size() >= 4 && path.compare(path.size() - 4, 4, ".npy") == 0;
+        if (npy) {
+            if (!readNpyHeader(array, path)) return false;
+        } else {
+            if (!hostIsLittleEndian()) {
+                std::cerr << "Raw arrays are little-endian, this machine is not" << std::endl;
+                return false;
+            }
+            const std::string dtype = source.dtype.empty() ? (source.field == "id" ? "u8" : "f4") : source.dtype;
+            if (!parseType(dtype, array.type)) {
+                std::cerr << "Unknown dtype " << dtype << " for " << path << std::endl;
+                return false;
+            }
+            const uint64_t rowBytes = components * elementSize(array.type);
+            if (array.file->size() % rowBytes != 0) {
+                std::cerr << path << " is not a whole number of " << dtype << " x " << components << " rows"
+                          << std::endl;
+                return false;
+            }
+            array.data = array.file->data();
+            array.rows = array.file->size() / rowBytes;
+            array.columns = components;
+        }
+
+        if (array.columns != components) {
+            std::cerr << path << " has " << array.columns << " values per body, " << source.field << " needs "
+                      << components << std::endl;
+            return false;
+        }
+        // Bounded by the payload before multiplying, so a huge shape cannot wrap
+        const uint64_t payload = array.file->size() - uint64_t(array.data - array.file->data());
+        const uint64_t rowBytes = array.columns * elementSize(array.type);
+        if (array.rows > payload / rowBytes) {
+            std::cerr << path << " is truncated" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    template <typename T>
+    T convert(const uint8_t* p, ElementType type) {
+        switch (type) {
+        case ElementType::Float32: { float v; std::memcpy(&v, p, 4); return T(v); }
+        case ElementType::Float64: { double v; std::memcpy(&v, p, 8); return T(v); }
+        case ElementType::UInt64: { uint64_t v; std::memcpy(&v, p, 8); return T(v); }
+        default: { int64_t v; std::memcpy(&v, p, 8); return T(v); }
+        }
+    }
+
+    template <typename T>
+    constexpr ElementType nativeType() {
+        return std::is_same<T, float>::value ? ElementType::Float32 : ElementType::UInt64;
+    }
+
+    // Fills column with one component of array: adopted in place when the
+    // file already has the column's layout, converted otherwise
+    template <typename T>
+    void importComponent(Column<T>& column, const Array& array, uint64_t component, ThreadPool& pool) {
+        const size_t n = size_t(array.rows);
+        T* first = reinterpret_cast<T*>(array.element(0, component));
+        const bool sameType = array.type == nativeType<T>() || (std::is_same<T, uint64_t>::value &&
+                                                                array.type == ElementType::Int64);
+        if (sameType && array.contiguous() && reinterpret_cast<uintptr_t>(first) % alignof(T) == 0) {
+            column.adopt(array.file, first, n);
+            return;
+        }
+        column.resize(n);
+        pool.parallelFor(n, [&](size_t begin, size_t end, unsigned) {
+            for (size_t i = begin; i < end; ++i) column[i] = convert<T>(array.element(i, component), array.type);
+        });
+    }
+}
+
+bool SimulationEngine::importArrays(const std::vector<ArrayImport::Source>& sources) {
+    BodyStore loaded;
+    struct Target {
+        const char* field;
+        Column<float>* columns[3];
+        uint64_t components;
+    };
+    const Target targets[] = {
+        {"pos", {&loaded.px, &loaded.py, &loaded.pz}, 3}, {"vel", {&loaded.vx, &loaded.vy, &loaded.vz}, 3},
+        {"px", {&loaded.px}, 1},           {"py", {&loaded.py}, 1},           {"pz", {&loaded.pz}, 1},
+        {"vx", {&loaded.vx}, 1},           {"vy", {&loaded.vy}, 1},           {"vz", {&loaded.vz}, 1},
+        {"mass", {&loaded.mass}, 1},       {"density", {&loaded.density}, 1}, {"radius", {&loaded.radius}, 1},
+    };
+
+    // Open and check everything before touching any column
+    std::vector<Array> arrays(sources.size());
+    std::vector<const Target*> targetOf(sources.size(), nullptr);
+    std::vector<const void*> claimed;
+    for (size_t s = 0; s < sources.size(); ++s) {
+        const std::string& field = sources[s].field;
+        uint64_t components = field == "color" ? 4 : 1;
+        for (const Target& target : targets) {
+            if (field == target.field) targetOf[s] = &target;
+        }
+        if (targetOf[s]) {
+            components = targetOf[s]->components;
+        } else if (field != "color" && field != "id") {
+            std::cerr << "Unknown import field " << field << std::endl;
+            return false;
+        }
+        if (!openArray(sources[s], components, arrays[s])) return false;
+        if (arrays[s].rows != arrays[0].rows) {
+            std::cerr << sources[s].path << " has " << arrays[s].rows << " bodies, " << sources[0].path << " has "
+                      << arrays[0].rows << std::endl;
+            return false;
+        }
+
+        // Every column comes from one source at most
+        std::vector<const void*> writes;
+        if (targetOf[s]) {
+            writes.assign(targetOf[s]->columns, targetOf[s]->columns + components);
+        } else {
+            writes.push_back(field == "color" ? static_cast<const void*>(&loaded.color) : &loaded.id);
+        }
+        for (const void* column : writes) {
+            if (std::find(claimed.begin(), claimed.end(), column) != claimed.end()) {
+                std::cerr << "Import field " << field << " overlaps an earlier one" << std::endl;
+                return false;
+            }
+            claimed.push_back(column);
+        }
+    }
+    auto provided = [&](const void* column) {
+        return std::find(claimed.begin(), claimed.end(), column) != claimed.end();
+    };
+    if (!provided(&loaded.px) || !provided(&loaded.py) || !provided(&loaded.pz) || !provided(&loaded.mass)) {
+        std::cerr << "Import needs positions (pos, or px, py and pz) and mass" << std::endl;
+        return false;
+    }
+    const size_t n = sources.empty() ? 0 : size_t(arrays[0].rows);
+
+    for (size_t s = 0; s < sources.size(); ++s) {
+        if (targetOf[s]) {
+            for (uint64_t c = 0; c < targetOf[s]->components; ++c) {
+                importComponent(*targetOf[s]->columns[c], arrays[s], c, pool);
+            }
+        } else if (sources[s].field == "id") {
+            importComponent(loaded.id, arrays[s], 0, pool);
+        } else {
+            // RGBA rows already have glm::vec4's layout
+            const Array& array = arrays[s];
+            auto* first = reinterpret_cast<glm::vec4*>(array.data);
+            if (array.type == ElementType::Float32 && !array.fortranOrder &&
+                reinterpret_cast<uintptr_t>(first) % alignof(glm::vec4) == 0) {
+                loaded.color.adopt(array.file, first, n);
+            } else {
+                loaded.color.resize(n);
+                pool.parallelFor(n, [&](size_t begin, size_t end, unsigned) {
+                    for (size_t i = begin; i < end; ++i) {
+                        for (int c = 0; c < 4; ++c) loaded.color[i][c] = convert<float>(array.element(i, c), array.type);
+                    }
+                });
+            }
+        }
+    }
+
+    // Whatever the files left out gets the same defaults as BodyStore::add
+    for (auto* column : {&loaded.vx, &loaded.vy, &loaded.vz}) {
+        if (!provided(column)) column->assign(n, 0.0f);
+    }
+    for (auto* column : {&loaded.ax, &loaded.ay, &loaded.az}) column->assign(n, 0.0f);
+    if (!provided(&loaded.density)) loaded.density.assign(n, 3344.0f);
+    if (!provided(&loaded.color)) loaded.color.assign(n, glm::vec4(1.0f));
+    loaded.glow.assign(n, 0);
+    if (!provided(&loaded.radius)) {
+        loaded.radius.resize(n);
+        pool.parallelFor(n, [&](size_t begin, size_t end, unsigned) {
+            for (size_t i = begin; i < end; ++i) {
+                loaded.radius[i] = BodyStore::computeRadius(loaded.mass[i], loaded.density[i]);
+            }
+        });
+    }
+
+    // Ids handed out later must not collide with imported ones
+    if (provided(&loaded.id)) {
+        std::vector<uint64_t> largest(pool.size(), 0);
+        pool.parallelFor(n, [&](size_t begin, size_t end, unsigned worker) {
+            for (size_t i = begin; i < end; ++i) largest[worker] = std::max(largest[worker], loaded.id[i]);
+        });
+        loaded.nextId = *std::max_element(largest.begin(), largest.end()) + 1;
+    } else {
+        loaded.id.resize(n);
+        pool.parallelFor(n, [&](size_t begin, size_t end, unsigned) {
+            for (size_t i = begin; i < end; ++i) loaded.id[i] = uint64_t(i) + 1;
+        });
+        loaded.nextId = uint64_t(n) + 1;
+    }
+
+    loaded.topologyVersion = bodies.topologyVersion + 1;
+    bodies = std::move(loaded);
+    particles.clear();
+    stepCount = 0;
+    return true;
+}
+
+bool ArrayImport::parseSources(const std::string& spec, std::vector<Source>& out) {
+    out.clear();
+    size_t begin = 0;
+    while (begin <= spec.size()) {
+        size_t end = spec.find(',', begin);
+        if (end == std::string::npos) end = spec.size();
+        const std::string item = spec.substr(begin, end - begin);
+        begin = end + 1;
+        if (item.empty()) continue;
+
+        const size_t equals = item.find('=');
+        if (equals == std::string::npos || equals == 0 || equals + 1 == item.size()) {
+            std::cerr << "Import source " << item << " is not field=path" << std::endl;
+            return false;
+        }
+        Source source;
+        source.field = item.substr(0, equals);
+        source.path = item.substr(equals + 1);
+        const size_t colon = source.field.find(':');
+        if (colon != std::string::npos) {
+            source.dtype = source.field.substr(colon + 1);
+            source.field.resize(colon);
+        }
+        out.push_back(source);
+    }
+    if (out.empty()) {
+        std::cerr << "No import sources given" << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,184 @@
+#include "Checkpoint.h"
+#include "MappedFile.h"
+#include "SimulationEngine.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+// SimulationEngine::saveState/loadState live here, next to the format they implement
+
+namespace {
+    struct ColumnSource {
+        const char* name;
+        const void* data;
+        uint32_t elementSize;
+    };
+
+    uint64_t alignUp(uint64_t offset) {
+        return (offset + Checkpoint::COLUMN_ALIGNMENT - 1) / Checkpoint::COLUMN_ALIGNMENT * Checkpoint::COLUMN_ALIGNMENT;
+    }
+
+    // Points column at its data inside the mapping, after checking it fits
+    template <typename T>
+    bool adoptColumn(Column<T>& column, const char* name, const std::shared_ptr<MappedFile>& file,
+                     const CheckpointColumn* table, uint32_t columnCount, uint64_t bodyCount) {
+        for (uint32_t c = 0; c < columnCount; ++c) {
+            const CheckpointColumn& entry = table[c];
+            if (std::strncmp(entry.name, name, Checkpoint::NAME_LENGTH) != 0) continue;
+
+            if (entry.elementSize != sizeof(T) || entry.bytes != bodyCount * sizeof(T) ||
+                entry.offset % alignof(T) != 0 || entry.offset > file->size() ||
+                entry.bytes > file->size() - entry.offset) {
+                std::cerr << "Checkpoint column " << name << " is malformed" << std::endl;
+                return false;
+            }
+            column.adopt(file, reinterpret_cast<T*>(file->data() + entry.offset), size_t(bodyCount));
+            return true;
+        }
+        std::cerr << "Checkpoint has no column " << name << std::endl;
+        return false;
+    }
+}
+
+bool SimulationEngine::saveState(const std::string& filename) const {
+    const ColumnSource columns[] = {
+        {"px", bodies.px.data(), sizeof(float)},      {"py", bodies.py.data(), sizeof(float)},
+        {"pz", bodies.pz.data(), sizeof(float)},      {"vx", bodies.vx.data(), sizeof(float)},
+        {"vy", bodies.vy.data(), sizeof(float)},      {"vz", bodies.vz.data(), sizeof(float)},
+        {"ax", bodies.ax.data(), sizeof(float)},      {"ay", bodies.ay.data(), sizeof(float)},
+        {"az", bodies.az.data(), sizeof(float)},      {"mass", bodies.mass.data(), sizeof(float)},
+        {"density", bodies.density.data(), sizeof(float)}, {"radius", bodies.radius.data(), sizeof(float)},
+        {"color", bodies.color.data(), sizeof(glm::vec4)}, {"glow", bodies.glow.data(), sizeof(uint8_t)},
+        {"id", bodies.id.data(), sizeof(uint64_t)},
+    };
+    const uint32_t columnCount = uint32_t(sizeof(columns) / sizeof(columns[0]));
+    const uint64_t n = bodies.size();
+
+    CheckpointHeader header{};
+    std::memcpy(header.magic, Checkpoint::MAGIC, sizeof(header.magic));
+    header.version = Checkpoint::VERSION;
+    header.byteOrder = Checkpoint::BYTE_ORDER_MARK;
+    header.headerSize = sizeof(CheckpointHeader);
+    header.columnCount = columnCount;
+    header.bodyCount = n;
+    header.nextId = bodies.nextId;
+    header.stepCount = stepCount;
+    header.timeScale = timeScale;
+    header.gravitationalConstant = gravitationalConstant;
+    header.deterministic = deterministic;
+    header.enableCollisions = enableCollisions;
+    header.isPaused = isPaused;
+
+    CheckpointColumn table[sizeof(columns) / sizeof(columns[0])] = {};
+    uint64_t offset = sizeof(CheckpointHeader) + sizeof(table);
+    for (uint32_t c = 0; c < columnCount; ++c) {
+        std::strncpy(table[c].name, columns[c].name, Checkpoint::NAME_LENGTH);
+        table[c].elementSize = columns[c].elementSize;
+        table[c].offset = alignUp(offset);
+        table[c].bytes = n * columns[c].elementSize;
+        offset = table[c].offset + table[c].bytes;
+    }
+
+    // Written next to the target and renamed over it, so a crash mid-write
+    // never leaves a truncated checkpoint under the real name
+    const std::string temporary = filename + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            std::cerr << "Failed to create " << temporary << std::endl;
+            return false;
+        }
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(table), sizeof(table));
+
+        static const char padding[Checkpoint::COLUMN_ALIGNMENT] = {};
+        uint64_t written = sizeof(header) + sizeof(table);
+        for (uint32_t c = 0; c < columnCount; ++c) {
+            file.write(padding, std::streamsize(table[c].offset - written));
+            file.write(static_cast<const char*>(columns[c].data), std::streamsize(table[c].bytes));
+            written = table[c].offset + table[c].bytes;
+        }
+        if (!file.flush()) {
+            std::cerr << "Failed to write " << temporary << std::endl;
+            return false;
+        }
+    }
+
+    // rename replaces the target atomically on POSIX; Windows refuses an
+    // existing one, so only there is the old checkpoint removed first
+    bool moved = std::rename(temporary.c_str(), filename.c_str()) == 0;
+    if (!moved) {
+        std::remove(filename.c_str());
+        moved = std::rename(temporary.c_str(), filename.c_str()) == 0;
+    }
+    if (!moved) {
+        std::cerr << "Failed to move checkpoint into place at " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool SimulationEngine::loadState(const std::string& filename) {
+    auto file = std::make_shared<MappedFile>();
+    if (!file->open(filename)) return false;
+
+    CheckpointHeader header;
+    if (file->size() < sizeof(header)) {
+        std::cerr << filename << " is not a checkpoint" << std::endl;
+        return false;
+    }
+    std::memcpy(&header, file->data(), sizeof(header));
+
+    if (std::memcmp(header.magic, Checkpoint::MAGIC, sizeof(header.magic)) != 0) {
+        std::cerr << filename << " is not a checkpoint" << std::endl;
+        return false;
+    }
+    if (header.byteOrder != Checkpoint::BYTE_ORDER_MARK) {
+        std::cerr << filename << " was written on a machine with a different byte order" << std::endl;
+        return false;
+    }
+    if (header.version > Checkpoint::VERSION) {
+        std::cerr << filename << " is checkpoint version " << header.version << ", this build reads up to "
+                  << Checkpoint::VERSION << std::endl;
+        return false;
+    }
+    if (header.headerSize < sizeof(header) ||
+        header.headerSize + uint64_t(header.columnCount) * sizeof(CheckpointColumn) > file->size()) {
+        std::cerr << filename << " is truncated" << std::endl;
+        return false;
+    }
+
+    const auto* table = reinterpret_cast<const CheckpointColumn*>(file->data() + header.headerSize);
+    const uint32_t count = header.columnCount;
+    const uint64_t n = header.bodyCount;
+
+    BodyStore loaded;
+    if (!adoptColumn(loaded.px, "px", file, table, count, n) || !adoptColumn(loaded.py, "py", file, table, count, n) ||
+        !adoptColumn(loaded.pz, "pz", file, table, count, n) || !adoptColumn(loaded.vx, "vx", file, table, count, n) ||
+        !adoptColumn(loaded.vy, "vy", file, table, count, n) || !adoptColumn(loaded.vz, "vz", file, table, count, n) ||
+        !adoptColumn(loaded.ax, "ax", file, table, count, n) || !adoptColumn(loaded.ay, "ay", file, table, count, n) ||
+        !adoptColumn(loaded.az, "az", file, table, count, n) ||
+        !adoptColumn(loaded.mass, "mass", file, table, count, n) ||
+        !adoptColumn(loaded.density, "density", file, table, count, n) ||
+        !adoptColumn(loaded.radius, "radius", file, table, count, n) ||
+        !adoptColumn(loaded.color, "color", file, table, count, n) ||
+        !adoptColumn(loaded.glow, "glow", file, table, count, n) ||
+        !adoptColumn(loaded.id, "id", file, table, count, n)) {
+        return false;
+    }
+
+    loaded.nextId = header.nextId;
+    loaded.topologyVersion = bodies.topologyVersion + 1;
+    bodies = std::move(loaded);
+    particles.clear();
+
+    stepCount = header.stepCount;
+    timeScale = header.timeScale;
+    gravitationalConstant = header.gravitationalConstant;
+    deterministic = header.deterministic != 0;
+    enableCollisions = header.enableCollisions != 0;
+    isPaused = header.isPaused != 0;
+    return true;
+}
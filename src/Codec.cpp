@@ -0,0 +1,234 @@
+#include "Codec.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+namespace {
+    // Column stream header
+    struct ColumnHeader {
+        double origin;
+        double quantum;     // 0 = lossless float bits
+    };
+
+    uint64_t zigzag(int64_t v) { return (uint64_t(v) << 1) ^ uint64_t(v >> 63); }
+    int64_t unzigzag(uint64_t v) { return int64_t(v >> 1) ^ -int64_t(v & 1); }
+
+    // Float bits as integers with the same ordering, so nearby floats give small differences
+    int64_t orderedBits(float f) {
+        uint32_t u;
+        std::memcpy(&u, &f, sizeof(u));
+        return int64_t((u & 0x80000000u) ? ~u : (u | 0x80000000u));
+    }
+    float fromOrderedBits(int64_t v) {
+        const uint32_t o = uint32_t(v);
+        const uint32_t u = (o & 0x80000000u) ? (o & 0x7FFFFFFFu) : ~o;
+        float f;
+        std::memcpy(&f, &u, sizeof(f));
+        return f;
+    }
+
+    int bitWidth(uint64_t v) {
+        int width = 0;
+        while (v) {
+            ++width;
+            v >>= 1;
+        }
+        return width;
+    }
+
+    void packBlock(const uint64_t* values, size_t count, std::vector<uint8_t>& out) {
+        uint64_t widest = 0;
+        for (size_t i = 0; i < count; ++i) widest |= values[i];
+        const int width = bitWidth(widest);
+        out.push_back(uint8_t(width));
+        if (width == 0) return;
+
+        // Whole words while they fill, then only the bytes still needed
+        const size_t start = out.size();
+        const size_t packed = (count * size_t(width) + 7) / 8;
+        out.resize(start + packed + 8);
+        uint8_t* dst = out.data() + start;
+        uint64_t buffer = 0;
+        int filled = 0;
+        for (size_t i = 0; i < count; ++i) {
+            const uint64_t v = values[i];
+            buffer |= v << filled;
+            if (filled + width >= 64) {
+                std::memcpy(dst, &buffer, 8);
+                dst += 8;
+                const int used = 64 - filled;
+                buffer = used < 64 ? v >> used : 0;
+                filled += width - 64;
+            } else {
+                filled += width;
+            }
+        }
+        std::memcpy(dst, &buffer, 8);
+        out.resize(start + packed);
+    }
+
+    // Eight values of a fixed width always span exactly WIDTH bytes, so with
+    // the width known at compile time every shift below is a constant. Reads
+    // up to 8 bytes past the group.
+    template <int WIDTH>
+    void unpackGroups(const uint8_t* in, size_t groups, int64_t* values) {
+        constexpr uint64_t mask = WIDTH == 64 ? ~uint64_t(0) : (uint64_t(1) << WIDTH) - 1;
+        for (size_t g = 0; g < groups; ++g, in += WIDTH, values += 8) {
+            for (int j = 0; j < 8; ++j) {
+                const int bit = j * WIDTH;
+                const int shift = bit & 7;
+                uint64_t word;
+                std::memcpy(&word, in + (bit >> 3), 8);
+                uint64_t v = word >> shift;
+                if (shift + WIDTH > 64) v |= uint64_t(in[(bit >> 3) + 8]) << ((64 - shift) & 63);
+                values[j] = unzigzag(v & mask);
+            }
+        }
+    }
+
+    using UnpackFn = void (*)(const uint8_t*, size_t, int64_t*);
+
+    template <int... W>
+    constexpr std::array<UnpackFn, sizeof...(W)> unpackTable(std::integer_sequence<int, W...>) {
+        return {&unpackGroups<W>...};
+    }
+
+    const std::array<UnpackFn, 65> UNPACK = unpackTable(std::make_integer_sequence<int, 65>());
+
+    // Returns bytes consumed, 0 if the block runs past the end
+    size_t unpackBlock(const uint8_t* data, size_t bytes, size_t count, int64_t* values) {
+        if (bytes < 1) return 0;
+        const int width = data[0];
+        if (width > 64) return 0;
+        if (width == 0) {
+            std::fill(values, values + count, 0);
+            return 1;
+        }
+        const size_t packed = (count * size_t(width) + 7) / 8;
+        if (packed + 1 > bytes) return 0;
+
+        // Whole groups when the stream has room for the overread, the rest bit by bit
+        const uint8_t* in = data + 1;
+        size_t done = 0;
+        if (packed + 1 + 8 <= bytes) {
+            done = count / 8 * 8;
+            UNPACK[width](in, count / 8, values);
+        }
+        const uint64_t mask = width == 64 ? ~uint64_t(0) : (uint64_t(1) << width) - 1;
+        for (size_t i = done; i < count; ++i) {
+            const size_t bit = i * size_t(width);
+            const size_t byte = bit >> 3;
+            const int shift = int(bit & 7);
+            uint64_t word = 0;
+            std::memcpy(&word, in + byte, std::min<size_t>(8, packed - byte));
+            uint64_t v = word >> shift;
+            // Values wider than 56 bits can spill into a ninth byte
+            if (shift + width > 64) v |= uint64_t(in[byte + 8]) << (64 - shift);
+            values[i] = unzigzag(v & mask);
+        }
+        return packed + 1;
+    }
+}
+
+void Codec::encodeColumn(const float* values, size_t frames, size_t bodies, double tolerance,
+                         std::vector<uint8_t>& out) {
+    const size_t n = frames * bodies;
+
+    double lo = 0.0, hi = 0.0, largest = 0.0;
+    bool finite = true;
+    for (size_t i = 0; i < n; ++i) {
+        const double v = values[i];
+        if (!std::isfinite(v)) finite = false;
+        lo = i ? std::min(lo, v) : v;
+        hi = i ? std::max(hi, v) : v;
+        largest = std::max(largest, std::fabs(v));
+    }
+
+    // Rounding to the quantum is off by at most half of it and the cast back
+    // to float by at most half the float spacing, which together stay within
+    // the tolerance. Below the spacing nothing can be gained, so such columns
+    // (and ones with infinities or NaNs) are kept exact.
+    const float reach = float(largest + tolerance);
+    const double spacing = double(std::nextafter(reach, INFINITY)) - double(reach);
+    ColumnHeader header{lo, 2.0 * tolerance - spacing};
+    if (!finite || tolerance <= spacing || (hi - lo) / header.quantum > 9.0e15) {
+        header = ColumnHeader{0.0, 0.0};
+    }
+
+    // Reused across calls like the decoder's, so sealing a chunk does not allocate
+    static thread_local std::vector<int64_t> q;
+    static thread_local std::vector<uint64_t> residual;
+    q.resize(n);
+    residual.resize(n);
+    if (header.quantum > 0.0) {
+        // Offsets from the minimum are never negative, so truncating x + 0.5 rounds
+        const double scale = 1.0 / header.quantum;
+        for (size_t i = 0; i < n; ++i) q[i] = int64_t((double(values[i]) - header.origin) * scale + 0.5);
+    } else {
+        for (size_t i = 0; i < n; ++i) q[i] = orderedBits(values[i]);
+    }
+
+    // Residuals against the linear extrapolation of each body's previous two frames
+    for (size_t f = 0; f < frames; ++f) {
+        const int64_t* cur = q.data() + f * bodies;
+        uint64_t* r = residual.data() + f * bodies;
+        if (f == 0) {
+            for (size_t i = 0; i < bodies; ++i) r[i] = zigzag(cur[i]);
+        } else if (f == 1) {
+            const int64_t* p1 = cur - bodies;
+            for (size_t i = 0; i < bodies; ++i) r[i] = zigzag(cur[i] - p1[i]);
+        } else {
+            const int64_t* p1 = cur - bodies;
+            const int64_t* p2 = p1 - bodies;
+            for (size_t i = 0; i < bodies; ++i) r[i] = zigzag(cur[i] - (2 * p1[i] - p2[i]));
+        }
+    }
+
+    const size_t at = out.size();
+    out.resize(at + sizeof(header));
+    std::memcpy(out.data() + at, &header, sizeof(header));
+    for (size_t b = 0; b < n; b += BLOCK) {
+        packBlock(residual.data() + b, std::min(BLOCK, n - b), out);
+    }
+}
+
+bool Codec::decodeColumn(const uint8_t* data, size_t bytes, size_t frames, size_t bodies, float* values) {
+    ColumnHeader header;
+    if (bytes < sizeof(header)) return false;
+    std::memcpy(&header, data, sizeof(header));
+    data += sizeof(header);
+    bytes -= sizeof(header);
+
+    const size_t n = frames * bodies;
+    static thread_local std::vector<int64_t> q;
+    q.resize(n);
+    for (size_t b = 0; b < n; b += BLOCK) {
+        const size_t used = unpackBlock(data, bytes, std::min(BLOCK, n - b), q.data() + b);
+        if (used == 0) return false;
+        data += used;
+        bytes -= used;
+    }
+
+    // Undo the prediction and convert frame by frame, while the rows are in cache
+    const double origin = header.origin, quantum = header.quantum;
+    for (size_t f = 0; f < frames; ++f) {
+        int64_t* cur = q.data() + f * bodies;
+        float* out = values + f * bodies;
+        if (f == 1) {
+            const int64_t* p1 = cur - bodies;
+            for (size_t i = 0; i < bodies; ++i) cur[i] += p1[i];
+        } else if (f > 1) {
+            const int64_t* p1 = cur - bodies;
+            const int64_t* p2 = p1 - bodies;
+            for (size_t i = 0; i < bodies; ++i) cur[i] += 2 * p1[i] - p2[i];
+        }
+        if (quantum > 0.0) {
+            for (size_t i = 0; i < bodies; ++i) out[i] = float(origin + double(cur[i]) * quantum);
+        } else {
+            for (size_t i = 0; i < bodies; ++i) out[i] = fromOrderedBits(cur[i]);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,317 @@
+#ifdef GRAVITAS_WITH_MPI
+
+#include "Distributed.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+namespace {
+    // Exclusive prefix sums of counts, as MPI displacements
+    std::vector<int> displacements(const std::vector<int>& counts) {
+        std::vector<int> displs(counts.size(), 0);
+        for (size_t r = 1; r < counts.size(); ++r) displs[r] = displs[r - 1] + counts[r - 1];
+        return displs;
+    }
+
+    void appendRecord(BodyStore& bodies, const float* p, const float* v, float mass, float density, float radius,
+                      const glm::vec4& color, uint64_t id, uint8_t glow) {
+        bodies.px.push_back(p[0]); bodies.py.push_back(p[1]); bodies.pz.push_back(p[2]);
+        bodies.vx.push_back(v[0]); bodies.vy.push_back(v[1]); bodies.vz.push_back(v[2]);
+        bodies.ax.push_back(0.0f); bodies.ay.push_back(0.0f); bodies.az.push_back(0.0f);
+        bodies.mass.push_back(mass);
+        bodies.density.push_back(density);
+        bodies.radius.push_back(radius);
+        bodies.color.push_back(color);
+        bodies.glow.push_back(glow);
+        bodies.id.push_back(id);
+    }
+}
+
+DistributedSimulation::DistributedSimulation(MPI_Comm comm, const DistributedConfig& config)
+    : comm(comm), config(config), pool(config.threads) {
+    MPI_Comm_rank(comm, &rankIndex);
+    MPI_Comm_size(comm, &rankCount);
+
+    // Both are trivially copyable and only ever travel between identical binaries
+    MPI_Type_contiguous(int(sizeof(BodyRecord)), MPI_BYTE, &recordType);
+    MPI_Type_commit(&recordType);
+    MPI_Type_contiguous(int(sizeof(TreeParticle)), MPI_BYTE, &particleType);
+    MPI_Type_commit(&particleType);
+}
+
+DistributedSimulation::~DistributedSimulation() {
+    MPI_Type_free(&recordType);
+    MPI_Type_free(&particleType);
+}
+
+void DistributedSimulation::scatter(const BodyStore& global, int root) {
+    engine.clearBodies();
+    if (rankIndex == root) engine.bodies = global;
+    cost.assign(engine.bodies.size(), 1.0f);
+    stepCount = 0;
+    rebalance();
+}
+
+void DistributedSimulation::gather(BodyStore& global, int root) {
+    const BodyStore& local = engine.bodies;
+    std::vector<BodyRecord> records(local.size());
+    for (size_t i = 0; i < local.size(); ++i) {
+        records[i] = BodyRecord{{local.px[i], local.py[i], local.pz[i]}, {local.vx[i], local.vy[i], local.vz[i]},
+                                local.mass[i], local.density[i], local.radius[i], 0.0f,
+                                local.color[i], local.id[i], local.glow[i]};
+    }
+
+    int count = int(records.size());
+    std::vector<int> counts(rankCount);
+    MPI_Gather(&count, 1, MPI_INT, counts.data(), 1, MPI_INT, root, comm);
+
+    std::vector<int> displs = displacements(counts);
+    std::vector<BodyRecord> all(rankIndex == root ? size_t(displs.back() + counts.back()) : 0);
+    MPI_Gatherv(records.data(), count, recordType, all.data(), counts.data(), displs.data(), recordType, root, comm);
+    if (rankIndex != root) return;
+
+    std::sort(all.begin(), all.end(), [](const BodyRecord& a, const BodyRecord& b) { return a.id < b.id; });
+    global.clear();
+    global.reserve(all.size());
+    for (const BodyRecord& r : all) {
+        appendRecord(global, r.p, r.v, r.mass, r.density, r.radius, r.color, r.id, r.glow);
+        global.nextId = std::max(global.nextId, r.id + 1);
+    }
+}
+
+void DistributedSimulation::step() {
+    if (engine.reorderInterval > 0 && engine.stepCount % engine.reorderInterval == 0 &&
+        engine.bodyDisorder() > engine.reorderThreshold) {
+        reorder();
+    }
+    computeForces();
+    engine.integrate(overlaps, &potential);
+    ++engine.stepCount;
+    ++stepCount;
+    checkBalance();
+}
+
+double DistributedSimulation::getTotalEnergy() {
+    computeForces();
+
+    const BodyStore& b = engine.bodies;
+    double local = 0.0;
+    for (size_t i = 0; i < b.size(); ++i) {
+        const double v2 = double(b.vx[i]) * b.vx[i] + double(b.vy[i]) * b.vy[i] + double(b.vz[i]) * b.vz[i];
+        local += 0.5 * b.mass[i] * v2 + 0.5 * b.mass[i] * potential[i];
+    }
+    double total = 0.0;
+    MPI_Allreduce(&local, &total, 1, MPI_DOUBLE, MPI_SUM, comm);
+    return total;
+}
+
+Diagnostics DistributedSimulation::getDiagnostics() {
+    const Diagnostics& d = engine.diagnostics;
+    const glm::dvec3 moment = d.centerOfMass * d.mass;
+    double local[13] = {d.mass, d.kinetic, d.potential,
+                        d.momentum.x, d.momentum.y, d.momentum.z,
+                        d.angularMomentum.x, d.angularMomentum.y, d.angularMomentum.z,
+                        moment.x, moment.y, moment.z, d.valid ? 1.0 : 0.0};
+    double sum[13] = {};
+    MPI_Allreduce(local, sum, 13, MPI_DOUBLE, MPI_SUM, comm);
+
+    Diagnostics total;
+    total.step = d.step;
+    total.valid = sum[12] == rankCount;
+    total.mass = sum[0];
+    total.kinetic = sum[1];
+    total.potential = sum[2];
+    total.momentum = glm::dvec3(sum[3], sum[4], sum[5]);
+    total.angularMomentum = glm::dvec3(sum[6], sum[7], sum[8]);
+    if (total.mass > 0.0) total.centerOfMass = glm::dvec3(sum[9], sum[10], sum[11]) / total.mass;
+    return total;
+}
+
+void DistributedSimulation::computeForces() {
+    BodyStore& b = engine.bodies;
+    const size_t n = b.size();
+
+    auto start = std::chrono::steady_clock::now();
+    particles.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        particles[i] = TreeParticle{b.px[i], b.py[i], b.pz[i], b.mass[i], b.radius[i]};
+    }
+    localTree.build(particles);
+    double busy = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // Domain boxes of every rank; an empty rank needs nothing
+    float box[7] = {};
+    if (n > 0) {
+        const Bounds& bounds = localTree.bounds();
+        box[0] = bounds.min.x; box[1] = bounds.min.y; box[2] = bounds.min.z;
+        box[3] = bounds.max.x; box[4] = bounds.max.y; box[5] = bounds.max.z;
+        box[6] = 1.0f;
+    }
+    std::vector<float> boxes(size_t(rankCount) * 7);
+    MPI_Allgather(box, 7, MPI_FLOAT, boxes.data(), 7, MPI_FLOAT, comm);
+
+    // Locally essential trees: what each other rank needs from ours
+    start = std::chrono::steady_clock::now();
+    exports.clear();
+    std::vector<int> sendCounts(rankCount, 0);
+    for (int r = 0; r < rankCount; ++r) {
+        const float* other = &boxes[size_t(r) * 7];
+        if (r == rankIndex || other[6] == 0.0f) continue;
+        const size_t before = exports.size();
+        localTree.exportFor(Bounds{glm::vec3(other[0], other[1], other[2]), glm::vec3(other[3], other[4], other[5])},
+                            config.theta, exports);
+        sendCounts[r] = int(exports.size() - before);
+    }
+    busy += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<int> recvCounts(rankCount);
+    MPI_Alltoall(sendCounts.data(), 1, MPI_INT, recvCounts.data(), 1, MPI_INT, comm);
+    const std::vector<int> sendDispls = displacements(sendCounts);
+    const std::vector<int> recvDispls = displacements(recvCounts);
+    imported = size_t(recvDispls.back() + recvCounts.back());
+
+    particles.resize(n + imported);
+    MPI_Alltoallv(exports.data(), sendCounts.data(), sendDispls.data(), particleType,
+                  particles.data() + n, recvCounts.data(), recvDispls.data(), particleType, comm);
+
+    // One tree over our bodies and everything imported, walked for our bodies only
+    start = std::chrono::steady_clock::now();
+    essentialTree.build(particles);
+
+    overlaps.assign(n, 0);
+    potential.assign(n, 0.0);
+    cost.assign(n, 0.0f);
+    const float G = engine.gravitationalConstant;
+    pool.parallelFor(n, [&](size_t begin, size_t end, unsigned) {
+        for (size_t i = begin; i < end; ++i) {
+            const Octree::Sample s = essentialTree.evaluate(b.position(i), b.radius[i], config.theta, G);
+            b.ax[i] = s.ax; b.ay[i] = s.ay; b.az[i] = s.az;
+            overlaps[i] = s.overlaps;
+            potential[i] = s.potential;
+            cost[i] = float(s.interactions);
+        }
+    });
+    busy += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    lastForceSeconds = busy;
+    engine.lastForceMs = busy * 1000.0;
+
+    // Spread the measured time over bodies by their share of the interactions
+    const double interactions = std::accumulate(cost.begin(), cost.end(), 0.0);
+    if (interactions > 0.0) {
+        const float secondsPerInteraction = float(busy / interactions);
+        for (float& c : cost) c *= secondsPerInteraction;
+    }
+}
+
+// Compares measured force time across ranks and redraws the domains when one lags
+void DistributedSimulation::checkBalance() {
+    double slowest = 0.0, total = 0.0;
+    MPI_Allreduce(&lastForceSeconds, &slowest, 1, MPI_DOUBLE, MPI_MAX, comm);
+    MPI_Allreduce(&lastForceSeconds, &total, 1, MPI_DOUBLE, MPI_SUM, comm);
+    lastImbalance = total > 0.0 ? slowest / (total / rankCount) : 1.0;
+
+    if (config.rebalanceInterval > 0 && stepCount % config.rebalanceInterval == 0 &&
+        lastImbalance > config.imbalanceThreshold) {
+        rebalance();
+    }
+}
+
+// Cuts the global Morton curve into rankCount pieces of equal summed cost.
+// The cut points come from a cost histogram over the top Morton bits, so no
+// rank ever sees another rank's bodies.
+void DistributedSimulation::rebalance() {
+    const BodyStore& b = engine.bodies;
+    const size_t n = b.size();
+    const float inf = std::numeric_limits<float>::infinity();
+
+    float lo[3] = {inf, inf, inf}, hi[3] = {-inf, -inf, -inf};
+    for (size_t i = 0; i < n; ++i) {
+        lo[0] = std::min(lo[0], b.px[i]); lo[1] = std::min(lo[1], b.py[i]); lo[2] = std::min(lo[2], b.pz[i]);
+        hi[0] = std::max(hi[0], b.px[i]); hi[1] = std::max(hi[1], b.py[i]); hi[2] = std::max(hi[2], b.pz[i]);
+    }
+    MPI_Allreduce(MPI_IN_PLACE, lo, 3, MPI_FLOAT, MPI_MIN, comm);
+    MPI_Allreduce(MPI_IN_PLACE, hi, 3, MPI_FLOAT, MPI_MAX, comm);
+    if (lo[0] > hi[0]) return;  // No bodies anywhere
+
+    const glm::vec3 origin(lo[0], lo[1], lo[2]);
+    float size = std::max(hi[0] - lo[0], std::max(hi[1] - lo[1], hi[2] - lo[2])) * 1.0001f;
+    if (size <= 0.0f) size = 1.0f;
+
+    const int shift = 63 - HISTOGRAM_BITS;
+    std::vector<uint32_t> bins(n);
+    std::vector<double> histogram(size_t(1) << HISTOGRAM_BITS, 0.0);
+    for (size_t i = 0; i < n; ++i) {
+        bins[i] = uint32_t(mortonKey(b.position(i), origin, size) >> shift);
+        histogram[bins[i]] += cost[i];
+    }
+    MPI_Allreduce(MPI_IN_PLACE, histogram.data(), int(histogram.size()), MPI_DOUBLE, MPI_SUM, comm);
+
+    // A bin goes to the rank its cost midpoint falls into
+    const double total = std::accumulate(histogram.begin(), histogram.end(), 0.0);
+    std::vector<int> binOwner(histogram.size());
+    double before = 0.0;
+    for (size_t bin = 0; bin < histogram.size(); ++bin) {
+        const double mid = before + histogram[bin] * 0.5;
+        binOwner[bin] = total > 0.0 ? std::min(rankCount - 1, int(mid / total * rankCount)) : 0;
+        before += histogram[bin];
+    }
+
+    std::vector<int> owner(n);
+    for (size_t i = 0; i < n; ++i) owner[i] = binOwner[bins[i]];
+    migrate(owner);
+    ++rebalances;
+}
+
+// Sends every body to its new owner and rebuilds the local store from what arrives
+void DistributedSimulation::migrate(const std::vector<int>& owner) {
+    BodyStore& b = engine.bodies;
+    const size_t n = b.size();
+
+    std::vector<int> sendCounts(rankCount, 0);
+    for (size_t i = 0; i < n; ++i) ++sendCounts[owner[i]];
+    const std::vector<int> sendDispls = displacements(sendCounts);
+
+    std::vector<BodyRecord> outgoing(n);
+    std::vector<int> cursor = sendDispls;
+    for (size_t i = 0; i < n; ++i) {
+        outgoing[size_t(cursor[owner[i]]++)] =
+            BodyRecord{{b.px[i], b.py[i], b.pz[i]}, {b.vx[i], b.vy[i], b.vz[i]}, b.mass[i], b.density[i],
+                       b.radius[i], cost[i], b.color[i], b.id[i], b.glow[i]};
+    }
+    migrated += n - size_t(sendCounts[rankIndex]);
+
+    std::vector<int> recvCounts(rankCount);
+    MPI_Alltoall(sendCounts.data(), 1, MPI_INT, recvCounts.data(), 1, MPI_INT, comm);
+    const std::vector<int> recvDispls = displacements(recvCounts);
+    std::vector<BodyRecord> incoming(size_t(recvDispls.back() + recvCounts.back()));
+    MPI_Alltoallv(outgoing.data(), sendCounts.data(), sendDispls.data(), recordType,
+                  incoming.data(), recvCounts.data(), recvDispls.data(), recordType, comm);
+
+    const uint64_t nextId = b.nextId;
+    b.clear();
+    b.reserve(incoming.size());
+    cost.resize(incoming.size());
+    for (size_t i = 0; i < incoming.size(); ++i) {
+        const BodyRecord& r = incoming[i];
+        appendRecord(b, r.p, r.v, r.mass, r.density, r.radius, r.color, r.id, r.glow);
+        cost[i] = r.cost;
+    }
+    b.nextId = nextId;
+
+    // Arrivals come grouped by sender; the tree walk wants them along the curve
+    reorder();
+}
+
+// Sorts this rank's bodies in Morton order, so that consecutive bodies walk
+// the same tree nodes; their costs move with them
+void DistributedSimulation::reorder() {
+    engine.reorderBodies(order);
+    if (cost.size() != order.size()) return;
+    std::vector<float> moved(cost.size());
+    for (size_t i = 0; i < order.size(); ++i) moved[i] = cost[order[i]];
+    cost.swap(moved);
+}
+
+#endif
@@ -0,0 +1,197 @@
+#include "Ensemble.h"
+#include "LaneKernel.h"
+#include "Random.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <limits>
+
+EnsembleRunner::EnsembleRunner(const BodyStore& initial, const EnsembleConfig& config)
+    : initial(initial), config(config) {}
+
+std::vector<EnsembleOutcome> EnsembleRunner::run() {
+    // The lane kernel mirrors the deterministic force pass only
+    if (config.useLanes && config.deterministic && initial.size() <= LANE_BODY_LIMIT) {
+        return runLanes();
+    }
+    return runScalar();
+}
+
+namespace {
+    bool anyEscaped(const BodyStore& bodies, const glm::vec3& centre, float escapeRadius) {
+        const float r2 = escapeRadius * escapeRadius;
+        for (size_t i = 0; i < bodies.size(); ++i) {
+            const float dx = bodies.px[i] - centre.x, dy = bodies.py[i] - centre.y, dz = bodies.pz[i] - centre.z;
+            if (dx * dx + dy * dy + dz * dz > r2) return true;
+        }
+        return false;
+    }
+}
+
+std::vector<EnsembleOutcome> EnsembleRunner::runScalar() {
+    std::vector<EnsembleOutcome> outcomes(config.instances);
+
+    // One instance per task; each engine is single-threaded so the pool
+    // spreads whole instances across cores
+    ThreadPool pool(config.threads);
+    pool.run(config.instances, [&](size_t instance, unsigned) {
+        SimulationEngine engine(1);
+        engine.deterministic = config.deterministic;
+        engine.bodies = initial;
+        perturb(engine.bodies, config, instance);
+
+        const double initialEnergy = engine.getTotalEnergy();
+        const glm::vec3 centre = engine.calculateCenterOfMass();
+        while (engine.stepCount < config.steps) {
+            if (config.stopOnEscape && anyEscaped(engine.bodies, centre, config.escapeRadius)) break;
+            engine.step();
+        }
+        outcomes[instance] = measure(engine, initialEnergy, config);
+    });
+    return outcomes;
+}
+
+// LANES instances per task, integrated in lockstep by LaneSystems
+std::vector<EnsembleOutcome> EnsembleRunner::runLanes() {
+    constexpr size_t LANES = LaneSystems::LANES;
+    std::vector<EnsembleOutcome> outcomes(config.instances);
+    const size_t batches = (config.instances + LANES - 1) / LANES;
+
+    ThreadPool pool(config.threads);
+    pool.run(batches, [&](size_t batch, unsigned) {
+        LaneSystems lanes(initial.size());
+        std::vector<BodyStore> systems(LANES);
+        double initialEnergy[LANES] = {};
+
+        const size_t first = batch * LANES;
+        const size_t count = std::min(LANES, config.instances - first);
+        for (size_t l = 0; l < count; ++l) {
+            SimulationEngine engine(1);
+            engine.deterministic = true;
+            engine.bodies = initial;
+            perturb(engine.bodies, config, first + l);
+
+            initialEnergy[l] = engine.getTotalEnergy();
+            lanes.load(l, engine.bodies);
+            if (config.stopOnEscape) {
+                lanes.setEscape(l, engine.calculateCenterOfMass(), config.escapeRadius);
+            }
+            systems[l] = std::move(engine.bodies);
+        }
+
+        lanes.run(config.steps);
+
+        for (size_t l = 0; l < count; ++l) {
+            SimulationEngine engine(1);
+            engine.deterministic = true;
+            engine.bodies = std::move(systems[l]);
+            lanes.store(l, engine.bodies);
+            engine.stepCount = lanes.stepsTaken(l);
+            outcomes[first + l] = measure(engine, initialEnergy[l], config);
+        }
+    });
+    return outcomes;
+}
+
+void EnsembleRunner::perturb(BodyStore& bodies, const EnsembleConfig& config, size_t instance) {
+    Philox rng(config.seed, instance);
+    for (size_t i = 0; i < bodies.size(); ++i) {
+        const float massFactor = std::max(0.01f, 1.0f + config.massJitter * static_cast<float>(rng.normal()));
+        bodies.mass[i] *= massFactor;
+        bodies.radius[i] = BodyStore::computeRadius(bodies.mass[i], bodies.density[i]);
+
+        const float speed = glm::length(bodies.velocity(i));
+        bodies.vx[i] += config.velocityJitter * speed * static_cast<float>(rng.normal());
+        bodies.vy[i] += config.velocityJitter * speed * static_cast<float>(rng.normal());
+        bodies.vz[i] += config.velocityJitter * speed * static_cast<float>(rng.normal());
+    }
+}
+
+EnsembleOutcome EnsembleRunner::measure(const SimulationEngine& engine, double initialEnergy,
+                                        const EnsembleConfig& config) {
+    const BodyStore& bodies = engine.bodies;
+    const glm::vec3 com = engine.calculateCenterOfMass();
+
+    EnsembleOutcome outcome;
+    const double finalEnergy = engine.getTotalEnergy();
+    outcome.energyDrift = initialEnergy != 0.0 ? std::abs((finalEnergy - initialEnergy) / initialEnergy) : 0.0;
+
+    double radiusSum = 0.0;
+    double minSeparation = std::numeric_limits<double>::infinity();
+    for (size_t i = 0; i < bodies.size(); ++i) {
+        const float r = glm::length(bodies.position(i) - com);
+        radiusSum += r;
+        if (r > config.escapeRadius) outcome.ejected += 1.0;
+        for (size_t j = i + 1; j < bodies.size(); ++j) {
+            minSeparation = std::min(minSeparation, double(glm::length(bodies.position(j) - bodies.position(i))));
+        }
+    }
+    outcome.meanRadius = bodies.size() ? radiusSum / bodies.size() : 0.0;
+    outcome.minSeparation = std::isfinite(minSeparation) ? minSeparation : 0.0;
+    outcome.steps = static_cast<double>(engine.stepCount);
+    return outcome;
+}
+
+namespace {
+
+struct MetricSummary {
+    const char* name;
+    double mean, stddev, min, p05, p50, p95, max;
+};
+
+std::vector<MetricSummary> summarize(const std::vector<EnsembleOutcome>& outcomes) {
+    struct Metric { const char* name; double EnsembleOutcome::* field; };
+    const Metric metrics[] = {
+        {"energy_drift", &EnsembleOutcome::energyDrift},
+        {"ejected", &EnsembleOutcome::ejected},
+        {"min_separation", &EnsembleOutcome::minSeparation},
+        {"mean_radius", &EnsembleOutcome::meanRadius},
+        {"steps", &EnsembleOutcome::steps},
+    };
+
+    std::vector<MetricSummary> summaries;
+    std::vector<double> values(outcomes.size());
+    for (const Metric& metric : metrics) {
+        if (outcomes.empty()) break;
+        for (size_t i = 0; i < outcomes.size(); ++i) values[i] = outcomes[i].*metric.field;
+        std::sort(values.begin(), values.end());
+
+        double sum = 0.0, sumSq = 0.0;
+        for (double v : values) { sum += v; sumSq += v * v; }
+        const double n = static_cast<double>(values.size());
+        const double mean = sum / n;
+        const double variance = n > 1 ? std::max(0.0, (sumSq - n * mean * mean) / (n - 1)) : 0.0;
+        auto percentile = [&](double p) { return values[static_cast<size_t>(std::round(p * (n - 1)))]; };
+
+        summaries.push_back({metric.name, mean, std::sqrt(variance), values.front(), percentile(0.05),
+                             percentile(0.5), percentile(0.95), values.back()});
+    }
+    return summaries;
+}
+
+} // namespace
+
+bool EnsembleRunner::writeStatistics(const std::string& filename, const std::vector<EnsembleOutcome>& outcomes) {
+    std::ofstream file(filename);
+    if (!file) {
+        std::cerr << "Failed to open " << filename << " for writing" << std::endl;
+        return false;
+    }
+    file.precision(17);
+    file << "metric,instances,mean,stddev,min,p05,p50,p95,max\n";
+    for (const MetricSummary& s : summarize(outcomes)) {
+        file << s.name << ',' << outcomes.size() << ',' << s.mean << ',' << s.stddev << ',' << s.min << ','
+             << s.p05 << ',' << s.p50 << ',' << s.p95 << ',' << s.max << '\n';
+    }
+    return static_cast<bool>(file);
+}
+
+void EnsembleRunner::printStatistics(const std::vector<EnsembleOutcome>& outcomes) {
+    std::printf("%-16s %12s %12s %12s %12s %12s\n", "metric", "mean", "stddev", "min", "median", "max");
+    for (const MetricSummary& s : summarize(outcomes)) {
+        std::printf("%-16s %12.5g %12.5g %12.5g %12.5g %12.5g\n", s.name, s.mean, s.stddev, s.min, s.p50, s.max);
+    }
+}
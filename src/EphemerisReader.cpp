@@ -0,0 +1,151 @@
+#include "EphemerisReader.h"
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+namespace {
+    // Sums c_s[j] * T_j(tau) for j = 0 .. degree of all six series at once,
+    // so their recurrences overlap instead of waiting on each other
+    void clenshaw(const double* c, size_t stride, uint32_t degree, double tau, double* out) {
+        double b1[Ephemeris::SERIES_COUNT] = {}, b2[Ephemeris::SERIES_COUNT] = {};
+        const double twoTau = 2.0 * tau;
+        for (uint32_t j = degree; j > 0; --j) {
+            for (uint32_t s = 0; s < Ephemeris::SERIES_COUNT; ++s) {
+                const double b0 = twoTau * b1[s] - b2[s] + c[s * stride + j];
+                b2[s] = b1[s];
+                b1[s] = b0;
+            }
+        }
+        for (uint32_t s = 0; s < Ephemeris::SERIES_COUNT; ++s) out[s] = tau * b1[s] - b2[s] + c[s * stride];
+    }
+}
+
+bool EphemerisReader::open(const std::string& path) {
+    close();
+    if (!file.open(path)) return false;
+
+    if (file.size() < sizeof(header)) {
+        std::cerr << path << " is not an ephemeris" << std::endl;
+        close();
+        return false;
+    }
+    std::memcpy(&header, file.data(), sizeof(header));
+
+    if (std::memcmp(header.magic, Ephemeris::MAGIC, sizeof(header.magic)) != 0) {
+        std::cerr << path << " is not an ephemeris" << std::endl;
+        close();
+        return false;
+    }
+    if (header.byteOrder != Ephemeris::BYTE_ORDER_MARK || header.version != Ephemeris::VERSION) {
+        std::cerr << path << " is ephemeris version " << header.version << ", this build reads version "
+                  << Ephemeris::VERSION << " in native byte order" << std::endl;
+        close();
+        return false;
+    }
+    if (header.bodyOffset == 0) {
+        std::cerr << path << " was not closed cleanly" << std::endl;
+        close();
+        return false;
+    }
+
+    // Records, bodies and table must all lie inside the file; compared by
+    // division so huge counts cannot wrap
+    recordBytes = Ephemeris::recordSize(header.degree);
+    const uint64_t size = file.size();
+    const bool fits = header.degree <= Ephemeris::MAX_DEGREE && header.segmentSteps > 0 &&
+                      header.headerSize <= header.bodyOffset && header.bodyOffset <= header.tableOffset &&
+                      header.tableOffset <= size &&
+                      header.recordCount <= (header.bodyOffset - header.headerSize) / recordBytes &&
+                      header.bodyCount <= (header.tableOffset - header.bodyOffset) / sizeof(EphemerisBody);
+    if (!fits) {
+        std::cerr << path << " has a broken layout" << std::endl;
+        close();
+        return false;
+    }
+    bodies = reinterpret_cast<const EphemerisBody*>(file.data() + header.bodyOffset);
+    table = reinterpret_cast<const EphemerisSegment*>(file.data() + header.tableOffset);
+    const uint64_t tableEntries = (size - header.tableOffset) / sizeof(EphemerisSegment);
+
+    for (size_t i = 0; i < bodyCount(); ++i) {
+        const EphemerisBody& b = bodies[i];
+        bool valid = b.segmentCount <= tableEntries && b.tableStart <= tableEntries - b.segmentCount;
+        for (uint64_t k = 0; valid && k < b.segmentCount; ++k) {
+            const EphemerisSegment& segment = table[b.tableStart + k];
+            valid = segment.recordCount > 0 && segment.recordCount <= (1u << Ephemeris::MAX_SPLITS) &&
+                    segment.recordCount <= header.recordCount &&
+                    segment.firstRecord <= header.recordCount - segment.recordCount;
+        }
+        if (!valid) {
+            std::cerr << path << " has a broken record table" << std::endl;
+            close();
+            return false;
+        }
+        index[b.id] = i;    // A later body reusing an id wins
+    }
+    return true;
+}
+
+void EphemerisReader::close() {
+    file.close();
+    header = EphemerisHeader{};
+    bodies = nullptr;
+    table = nullptr;
+    recordBytes = 0;
+    index.clear();
+}
+
+size_t EphemerisReader::find(uint64_t id) const {
+    auto it = index.find(id);
+    return it == index.end() ? NOT_FOUND : it->second;
+}
+
+const EphemerisRecord* EphemerisReader::recordFor(size_t i, double step) const {
+    if (i >= bodyCount() || !(step >= 0.0)) return nullptr;
+    const EphemerisBody& b = bodies[i];
+    if (b.segmentCount == 0) return nullptr;
+
+    const double global = std::floor(step / double(header.segmentSteps));
+    if (global < double(b.firstSegment)) return nullptr;
+    // The last step of a body closes its final segment rather than opening another
+    const uint64_t k = std::min<uint64_t>(uint64_t(global) - b.firstSegment, b.segmentCount - 1);
+
+    // Split segments have a few records sorted by time; take the first that reaches step
+    const EphemerisSegment& segment = table[b.tableStart + k];
+    const uint8_t* records = file.data() + header.headerSize + segment.firstRecord * recordBytes;
+    size_t lo = 0, hi = segment.recordCount - 1;
+    while (lo < hi) {
+        const size_t mid = (lo + hi) / 2;
+        if (double(reinterpret_cast<const EphemerisRecord*>(records + mid * recordBytes)->endStep) < step) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    const auto* record = reinterpret_cast<const EphemerisRecord*>(records + lo * recordBytes);
+    if (step < double(record->startStep) || step > double(record->endStep)) return nullptr;
+    return record;
+}
+
+bool EphemerisReader::state(size_t i, double step, glm::dvec3& position, glm::dvec3& velocity) const {
+    const EphemerisRecord* record = recordFor(i, step);
+    if (!record) return false;
+
+    const double span = double(record->endStep - record->startStep);
+    const double tau = span > 0.0 ? 2.0 * (step - double(record->startStep)) / span - 1.0 : 0.0;
+    const auto* c = reinterpret_cast<const double*>(record + 1);
+    const size_t stride = size_t(header.degree) + 1;
+    const uint32_t degree = std::min(record->degree, header.degree);
+
+    double values[Ephemeris::SERIES_COUNT];
+    clenshaw(c, stride, degree, tau, values);
+    position = glm::dvec3(values[0], values[1], values[2]);
+    velocity = glm::dvec3(values[3], values[4], values[5]);
+    return true;
+}
+
+void EphemerisReader::bodiesAt(double step, std::vector<uint32_t>& out) const {
+    out.clear();
+    for (size_t i = 0; i < bodyCount(); ++i) {
+        if (covers(i, step)) out.push_back(uint32_t(i));
+    }
+}
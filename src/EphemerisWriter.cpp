@@ -0,0 +1,280 @@
+#include "EphemerisWriter.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+EphemerisWriter::EphemerisWriter(const EphemerisConfig& config) : config(config) {
+    if (this->config.every == 0) this->config.every = 1;
+    this->config.degree = std::min(this->config.degree, Ephemeris::MAX_DEGREE);
+    // Boundaries must land on sampled steps so that segments meet
+    const uint64_t every = this->config.every;
+    this->config.segmentSteps = std::max<uint64_t>(this->config.segmentSteps, every);
+    this->config.segmentSteps = (this->config.segmentSteps + every - 1) / every * every;
+}
+
+EphemerisWriter::~EphemerisWriter() {
+    close();
+}
+
+bool EphemerisWriter::open(const std::string& filename) {
+    close();
+    file.open(filename, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        std::cerr << "Failed to create " << filename << std::endl;
+        return false;
+    }
+    path = filename;
+
+    tracks.clear();
+    trackOf.clear();
+    slots.clear();
+    slotsValid = false;
+    fit = Fit();
+    anySample = false;
+    firstStep = lastStep = 0;
+    fileOffset = 0;
+    failed = false;
+    counters = Stats();
+
+    // Placeholder until close() knows where the tables went
+    const EphemerisHeader header = makeHeader(0, 0);
+    write(&header, sizeof(header));
+    return true;
+}
+
+void EphemerisWriter::close() {
+    if (!file.is_open()) return;
+    for (auto& track : tracks) {
+        if (track.alive) flushTrack(track);
+    }
+
+    const uint64_t bodyOffset = fileOffset;
+    uint64_t tableStart = 0;
+    for (auto& track : tracks) {
+        track.body.segmentCount = uint32_t(track.segments.size());
+        track.body.tableStart = tableStart;
+        tableStart += track.segments.size();
+        write(&track.body, sizeof(track.body));
+    }
+    const uint64_t tableOffset = fileOffset;
+    for (const auto& track : tracks) write(track.segments.data(), track.segments.size() * sizeof(EphemerisSegment));
+
+    file.seekp(0);
+    const EphemerisHeader header = makeHeader(bodyOffset, tableOffset);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.close();
+    if (failed || !file) std::cerr << "Ephemeris " << path << " is incomplete" << std::endl;
+}
+
+void EphemerisWriter::capture(const SimulationEngine& engine) {
+    const uint64_t step = engine.stepCount;
+    if (!file.is_open() || step % config.every != 0) return;
+    if (anySample && step <= lastStep) return;   // Already sampled
+
+    const BodyStore& bodies = engine.bodies;
+    if (!slotsValid || slotsTopology != bodies.topologyVersion) mapBodies(bodies, step);
+
+    if (!anySample) firstStep = step;
+    lastStep = step;
+    anySample = true;
+
+    const bool boundary = step % config.segmentSteps == 0;
+    for (size_t i = 0; i < bodies.size(); ++i) {
+        Track& track = tracks[slots[i]];
+        track.steps.push_back(step);
+        const float sample[Ephemeris::SERIES_COUNT] = {bodies.px[i], bodies.py[i], bodies.pz[i],
+                                                       bodies.vx[i], bodies.vy[i], bodies.vz[i]};
+        track.samples.insert(track.samples.end(), sample, sample + Ephemeris::SERIES_COUNT);
+        ++counters.samples;
+        if (boundary && track.steps.size() > 1) flushTrack(track);
+    }
+}
+
+// Matches the body columns to tracks, closing the tracks of bodies that are gone
+void EphemerisWriter::mapBodies(const BodyStore& bodies, uint64_t step) {
+    std::vector<uint8_t> present(tracks.size(), 0);
+    slots.resize(bodies.size());
+    for (size_t i = 0; i < bodies.size(); ++i) {
+        auto it = trackOf.find(bodies.id[i]);
+        if (it == trackOf.end()) {
+            Track track;
+            track.body.id = bodies.id[i];
+            track.body.mass = bodies.mass[i];
+            track.body.density = bodies.density[i];
+            std::memcpy(track.body.color, &bodies.color[i], sizeof(track.body.color));
+            track.body.glow = bodies.glow[i];
+            track.body.firstSegment = step / config.segmentSteps;
+            it = trackOf.emplace(bodies.id[i], tracks.size()).first;
+            tracks.push_back(std::move(track));
+            present.push_back(0);
+        }
+        slots[i] = it->second;
+        present[it->second] = 1;
+    }
+
+    for (size_t t = 0; t < tracks.size(); ++t) {
+        if (!tracks[t].alive || present[t]) continue;
+        flushTrack(tracks[t]);
+        tracks[t].alive = false;
+        trackOf.erase(tracks[t].body.id);
+    }
+    slotsTopology = bodies.topologyVersion;
+    slotsValid = true;
+}
+
+// Fits the open segment of a track and writes its records
+void EphemerisWriter::flushTrack(Track& track) {
+    const size_t count = track.steps.size();
+    if (count == 0) return;
+    // A lone boundary sample is already the end of the previous segment
+    if (count == 1 && !track.segments.empty()) {
+        track.steps.clear();
+        track.samples.clear();
+        return;
+    }
+
+    EphemerisSegment segment{counters.records, 0, 0};
+    writePiece(track, 0, count, 0);
+    segment.recordCount = uint32_t(counters.records - segment.firstRecord);
+    track.segments.push_back(segment);
+
+    // The boundary sample also opens the next segment
+    track.steps.erase(track.steps.begin(), track.steps.end() - 1);
+    track.samples.erase(track.samples.begin(), track.samples.end() - Ephemeris::SERIES_COUNT);
+}
+
+// Writes samples [first, first + count) as one record, or as two halves
+// sharing the middle sample when one series misses the tolerance
+void EphemerisWriter::writePiece(const Track& track, size_t first, size_t count, unsigned depth) {
+    pieceSteps.assign(track.steps.begin() + first, track.steps.begin() + first + count);
+    const Fit& f = fitFor(pieceSteps);
+    const size_t terms = size_t(f.degree) + 1;
+    const size_t stride = size_t(config.degree) + 1;
+
+    record.assign(Ephemeris::recordSize(config.degree), 0);
+    auto* coefficients = reinterpret_cast<double*>(record.data() + sizeof(EphemerisRecord));
+    double errors[2] = {0.0, 0.0};
+    float largest[2] = {0.0f, 0.0f};
+    for (size_t s = 0; s < Ephemeris::SERIES_COUNT; ++s) {
+        double* c = coefficients + s * stride;
+        const float* samples = track.samples.data() + first * Ephemeris::SERIES_COUNT + s;
+        for (size_t j = 0; j < terms; ++j) {
+            double sum = 0.0;
+            for (size_t m = 0; m < count; ++m) sum += f.solve[j * count + m] * samples[m * Ephemeris::SERIES_COUNT];
+            c[j] = sum;
+        }
+        for (size_t m = 0; m < count; ++m) {
+            double value = 0.0;
+            for (size_t j = 0; j < terms; ++j) value += f.basis[m * terms + j] * c[j];
+            const float sample = samples[m * Ephemeris::SERIES_COUNT];
+            errors[s / 3] = std::max(errors[s / 3], std::fabs(value - sample));
+            largest[s / 3] = std::max(largest[s / 3], std::fabs(sample));
+        }
+    }
+
+    // The samples are floats, so residuals of a few of their steps are noise
+    auto tolerance = [](double requested, float magnitude) {
+        return std::max(requested, 4.0 * double(std::nextafter(magnitude, INFINITY) - magnitude));
+    };
+    const bool missed = errors[0] > tolerance(config.positionTolerance, largest[0]) ||
+                        errors[1] > tolerance(config.velocityTolerance, largest[1]);
+    if (missed && depth < Ephemeris::MAX_SPLITS && count > 2) {
+        const size_t half = count / 2;
+        writePiece(track, first, half + 1, depth + 1);
+        writePiece(track, first + half, count - half, depth + 1);
+        return;
+    }
+
+    EphemerisRecord header{};
+    header.startStep = track.steps[first];
+    header.endStep = track.steps[first + count - 1];
+    header.degree = f.degree;
+    header.positionError = float(errors[0]);
+    header.velocityError = float(errors[1]);
+    std::memcpy(record.data(), &header, sizeof(header));
+    write(record.data(), record.size());
+
+    ++counters.records;
+    counters.positionError = std::max(counters.positionError, errors[0]);
+    counters.velocityError = std::max(counters.velocityError, errors[1]);
+}
+
+// Least squares through the normal equations, solved once per distinct set
+// of sample steps; every body on the same boundary shares it
+const EphemerisWriter::Fit& EphemerisWriter::fitFor(const std::vector<uint64_t>& steps) {
+    if (fit.steps == steps) return fit;
+
+    const size_t count = steps.size();
+    fit.steps = steps;
+    fit.degree = uint32_t(std::min<size_t>(config.degree, count - 1));
+    const size_t terms = size_t(fit.degree) + 1;
+
+    // Chebyshev polynomials at the sample times mapped to [-1, 1]
+    fit.basis.assign(count * terms, 0.0);
+    const double span = double(steps.back() - steps.front());
+    for (size_t m = 0; m < count; ++m) {
+        const double tau = span > 0.0 ? 2.0 * double(steps[m] - steps.front()) / span - 1.0 : 0.0;
+        double* row = fit.basis.data() + m * terms;
+        row[0] = 1.0;
+        if (terms > 1) row[1] = tau;
+        for (size_t j = 2; j < terms; ++j) row[j] = 2.0 * tau * row[j - 1] - row[j - 2];
+    }
+
+    // Cholesky factor of the normal matrix B^T B
+    std::vector<double> l(terms * terms, 0.0);
+    for (size_t i = 0; i < terms; ++i) {
+        for (size_t j = 0; j <= i; ++j) {
+            double sum = 0.0;
+            for (size_t m = 0; m < count; ++m) sum += fit.basis[m * terms + i] * fit.basis[m * terms + j];
+            for (size_t k = 0; k < j; ++k) sum -= l[i * terms + k] * l[j * terms + k];
+            l[i * terms + j] = i == j ? std::sqrt(std::max(sum, 1e-300)) : sum / l[j * terms + j];
+        }
+    }
+
+    // solve = (B^T B)^-1 B^T, one sample column at a time
+    fit.solve.assign(terms * count, 0.0);
+    std::vector<double> y(terms);
+    for (size_t m = 0; m < count; ++m) {
+        for (size_t i = 0; i < terms; ++i) {
+            double sum = fit.basis[m * terms + i];
+            for (size_t k = 0; k < i; ++k) sum -= l[i * terms + k] * y[k];
+            y[i] = sum / l[i * terms + i];
+        }
+        for (size_t i = terms; i-- > 0;) {
+            double sum = y[i];
+            for (size_t k = i + 1; k < terms; ++k) sum -= l[k * terms + i] * fit.solve[k * count + m];
+            fit.solve[i * count + m] = sum / l[i * terms + i];
+        }
+    }
+    return fit;
+}
+
+void EphemerisWriter::write(const void* data, size_t bytes) {
+    if (bytes == 0 || failed) return;
+    file.write(static_cast<const char*>(data), std::streamsize(bytes));
+    if (!file) {
+        std::cerr << "Failed to write ephemeris " << path << std::endl;
+        failed = true;
+        return;
+    }
+    fileOffset += bytes;
+    counters.bytesWritten += bytes;
+}
+
+EphemerisHeader EphemerisWriter::makeHeader(uint64_t bodyOffset, uint64_t tableOffset) const {
+    EphemerisHeader header{};
+    std::memcpy(header.magic, Ephemeris::MAGIC, sizeof(header.magic));
+    header.version = Ephemeris::VERSION;
+    header.byteOrder = Ephemeris::BYTE_ORDER_MARK;
+    header.headerSize = sizeof(EphemerisHeader);
+    header.degree = config.degree;
+    header.segmentSteps = config.segmentSteps;
+    header.firstStep = firstStep;
+    header.lastStep = lastStep;
+    header.recordCount = counters.records;
+    header.bodyCount = tracks.size();
+    header.bodyOffset = bodyOffset;
+    header.tableOffset = tableOffset;
+    return header;
+}
@@ -0,0 +1,214 @@
+#include "ExternalField.h"
+#include "SimulationEngine.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+// Each profile is evaluated in its own frame: offset from the centre in
+// metres, split into the part along the axis (z) and the part normal to
+// it (R) for the flattened ones. Everything runs in double; a field is a
+// handful of operations per body against the force pass's N per body.
+
+namespace {
+    // Circular speed in stored units squared to m^2/s^2: the integrator
+    // kicks by a / ACCELERATION_DAMPING and drifts by v / TIME_SCALE
+    constexpr double SPEED_SQUARED_TO_SI =
+        double(Physics::ACCELERATION_DAMPING) * Physics::METERS_PER_UNIT / Physics::TIME_SCALE;
+
+    glm::dvec3 unitAxis(const glm::vec3& axis) {
+        return glm::length(axis) > 0.0f ? glm::normalize(glm::dvec3(axis)) : glm::dvec3(0, 1, 0);
+    }
+}
+
+double ExternalField::Potential::strength(uint64_t step) const {
+    const uint64_t age = step > startStep ? step - startStep : 0;
+    if (growthSteps == 0 || age >= growthSteps) return 1.0;
+    return double(age) / double(growthSteps);
+}
+
+glm::dvec3 ExternalField::Potential::centreAt(uint64_t step) const {
+    const double steps = double(step) - double(startStep);
+    return glm::dvec3(centre) + glm::dvec3(velocity) * (steps / Physics::TIME_SCALE);
+}
+
+void ExternalField::Potential::evaluate(const glm::dvec3& position, const glm::dvec3& origin, double G,
+                                        double strength, glm::dvec3& acceleration, double& potential) const {
+    const glm::dvec3 d = (position - origin) * double(Physics::METERS_PER_UNIT);
+    const double a = double(scale) * Physics::METERS_PER_UNIT;
+    const double GM = G * mass * strength;
+
+    switch (profile) {
+        case Profile::NFW: {
+            const double r = std::max(glm::length(d), 1e-6 * a);
+            const double x = r / a;
+            const double log1p = std::log1p(x);
+            // Enclosed mass over the characteristic mass
+            const double enclosed = log1p - x / (1.0 + x);
+            acceleration = -GM * enclosed / (r * r * r) * d;
+            potential = -GM * log1p / r;
+            break;
+        }
+        case Profile::Hernquist: {
+            const double r = glm::length(d);
+            const double ra = r + a;
+            acceleration = r > 0.0 ? -GM / (r * ra * ra) * d : glm::dvec3(0.0);
+            potential = -GM / ra;
+            break;
+        }
+        case Profile::MiyamotoNagai: {
+            const glm::dvec3 e = unitAxis(axis);
+            const double z = glm::dot(d, e);
+            const glm::dvec3 planar = d - z * e;
+            const double b = double(height) * Physics::METERS_PER_UNIT;
+            const double zeta = std::sqrt(z * z + b * b);
+            const double az = a + zeta;
+            const double D2 = glm::dot(planar, planar) + az * az;
+            const double D = std::sqrt(D2);
+            const double pull = GM / (D2 * D);
+            acceleration = -pull * (planar + e * (zeta > 0.0 ? z * az / zeta : 0.0));
+            potential = -GM / D;
+            break;
+        }
+        case Profile::Logarithmic: {
+            const glm::dvec3 e = unitAxis(axis);
+            const double z = glm::dot(d, e);
+            const glm::dvec3 planar = d - z * e;
+            const double q2 = std::max(double(flattening) * flattening, 1e-6);
+            const double v2 = double(speed) * speed * SPEED_SQUARED_TO_SI * strength;
+            const double s = a * a + glm::dot(planar, planar) + z * z / q2;
+            acceleration = -v2 / s * (planar + e * (z / q2));
+            potential = 0.5 * v2 * std::log(s);
+            break;
+        }
+    }
+}
+
+bool ExternalField::parse(const std::string& spec, Potential& out) {
+    const size_t colon = spec.find(':');
+    const std::string name = spec.substr(0, colon);
+    Potential field;
+    bool known = false;
+    for (Profile profile : {Profile::NFW, Profile::Hernquist, Profile::MiyamotoNagai, Profile::Logarithmic}) {
+        if (name == profileName(profile)) {
+            field.profile = profile;
+            known = true;
+        }
+    }
+    if (!known) {
+        std::cerr << "Unknown potential: " << name << " (nfw, hernquist, disk or log)" << std::endl;
+        return false;
+    }
+
+    size_t at = colon == std::string::npos ? spec.size() : colon + 1;
+    while (at < spec.size()) {
+        size_t end = spec.find(',', at);
+        if (end == std::string::npos) end = spec.size();
+        const std::string item = spec.substr(at, end - at);
+        at = end + 1;
+
+        const size_t eq = item.find('=');
+        if (eq == std::string::npos) {
+            std::cerr << "Expected key=value in potential, got: " << item << std::endl;
+            return false;
+        }
+        const std::string key = item.substr(0, eq);
+        const std::string text = item.substr(eq + 1);
+        char* parsed = nullptr;
+        const double value = std::strtod(text.c_str(), &parsed);
+        if (text.empty() || *parsed != '\0') {
+            std::cerr << "Bad value for " << key << " in potential: " << text << std::endl;
+            return false;
+        }
+
+        if (key == "mass") field.mass = value;
+        else if (key == "speed") field.speed = float(value);
+        else if (key == "scale") field.scale = float(value);
+        else if (key == "height") field.height = float(value);
+        else if (key == "q") field.flattening = float(value);
+        else if (key == "x") field.centre.x = float(value);
+        else if (key == "y") field.centre.y = float(value);
+        else if (key == "z") field.centre.z = float(value);
+        else if (key == "vx") field.velocity.x = float(value);
+        else if (key == "vy") field.velocity.y = float(value);
+        else if (key == "vz") field.velocity.z = float(value);
+        else if (key == "ax") field.axis.x = float(value);
+        else if (key == "ay") field.axis.y = float(value);
+        else if (key == "az") field.axis.z = float(value);
+        else if (key == "grow") field.growthSteps = uint64_t(std::max(value, 0.0));
+        else {
+            std::cerr << "Unknown potential key: " << key << std::endl;
+            return false;
+        }
+    }
+    // Negated so NaN fails too
+    const char* invalid = nullptr;
+    if (!(field.scale > 0.0f)) invalid = "scale must be positive";
+    else if (field.profile != Profile::Logarithmic && !(field.mass > 0.0)) invalid = "mass must be positive";
+    else if (field.profile == Profile::Logarithmic && !(field.speed >= 0.0f)) invalid = "speed must not be negative";
+    else if (!(field.height > 0.0f)) invalid = "height must be positive";
+    else if (!(field.flattening > 0.0f)) invalid = "q must be positive";
+    if (invalid) {
+        std::cerr << "Potential " << invalid << std::endl;
+        return false;
+    }
+    out = field;
+    return true;
+}
+
+const char* ExternalField::profileName(Profile profile) {
+    switch (profile) {
+        case Profile::NFW:           return "nfw";
+        case Profile::Hernquist:     return "hernquist";
+        case Profile::MiyamotoNagai: return "disk";
+        case Profile::Logarithmic:   return "log";
+    }
+    return "unknown";
+}
+
+// ---------------------------------------------------------------------------
+// SimulationEngine
+// ---------------------------------------------------------------------------
+
+void SimulationEngine::addExternalField(const float* x, const float* y, const float* z, size_t count, float* ax,
+                                        float* ay, float* az, double* phi) const {
+    const double G = gravitationalConstant;
+    for (const ExternalField::Potential& field : externalField) {
+        const double strength = field.strength(stepCount);
+        const glm::dvec3 origin = field.centreAt(stepCount);
+        for (size_t i = 0; i < count; ++i) {
+            glm::dvec3 a;
+            double p;
+            field.evaluate(glm::dvec3(x[i], y[i], z[i]), origin, G, strength, a, p);
+            ax[i] += float(a.x); ay[i] += float(a.y); az[i] += float(a.z);
+            // Twice: the diagnostics halve each body's sum, which sees every pair from both ends
+            if (phi) phi[i] += 2.0 * p;
+        }
+    }
+}
+
+void SimulationEngine::applyExternalField() {
+    const size_t n = bodies.size();
+    if (externalField.empty() || n == 0) return;
+    double* phi = trackDiagnostics && potential.size() == n ? potential.data() : nullptr;
+    const size_t blocks = (n + REDUCTION_BLOCK - 1) / REDUCTION_BLOCK;
+    runTasks(blocks, [&](size_t block, unsigned) {
+        const size_t begin = block * REDUCTION_BLOCK;
+        const size_t count = std::min(n, begin + REDUCTION_BLOCK) - begin;
+        addExternalField(bodies.px.data() + begin, bodies.py.data() + begin, bodies.pz.data() + begin, count,
+                         bodies.ax.data() + begin, bodies.ay.data() + begin, bodies.az.data() + begin,
+                         phi ? phi + begin : nullptr);
+    });
+}
+
+double SimulationEngine::externalPotential(const glm::vec3& position) const {
+    double total = 0.0;
+    for (const ExternalField::Potential& field : externalField) {
+        glm::dvec3 a;
+        double p;
+        field.evaluate(glm::dvec3(position), field.centreAt(stepCount), gravitationalConstant,
+                       field.strength(stepCount), a, p);
+        total += p;
+    }
+    return total;
+}
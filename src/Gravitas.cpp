@@ -3,6 +3,11 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <vector>
 #include <iostream>
 #include <string>
@@ -10,6 +15,13 @@
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
+#include "SimulationEngine.h"
+#include "PhysicsThread.h"
+#include "Headless.h"
+#include "TrajectoryReader.h"
+#include "EphemerisReader.h"
+#include "Journal.h"
+#include "SpatialIndex.h"
 
 const char* vertexShaderSource = R"glsl(
 #version 330 core
@@ -81,6 +93,8 @@ float deltaTime = 0.0;
 float lastFrame = 0.0;
 bool firstMouse = true;
 bool leftMouseButtonPressed = false; // New global variable to track left mouse button state
+bool pickRequested = false;             // Middle click: select the body under the cursor
+double pickX = 0.0, pickY = 0.0;
 
 const double G = 6.6743e-11; // m^3 kg^-1 s^-2
 const float c = 299792458.0;
@@ -89,7 +103,7 @@ float sizeRatio = 30000.0f;
 
 GLFWwindow* StartGLU();
 GLuint CreateShaderProgram(const char* vertexSource, const char* fragmentSource);
-void CreateVBOVAO(GLuint& VAO, GLuint& VBO, const float* vertices, size_t vertexCount);
+void CreateVBOVAO(GLuint& VAO, GLuint& VBO, const float* vertices, size_t vertexCount, GLenum usage = GL_STATIC_DRAW);
 void UpdateCam(GLuint shaderProgram, glm::vec3 cameraPos);
 void processInput(GLFWwindow* window);
 void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
@@ -99,6 +113,16 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 glm::vec3 sphericalToCartesian(float r, float theta, float phi);
 void DrawGrid(GLuint shaderProgram, GLuint gridVAO, size_t vertexCount);
+void DrawParticles(GLuint shaderProgram, GLuint particleVAO, size_t count);
+
+// Scratch for sphere meshes: every Object builds its vertices here before
+// uploading them, so rebuilding the meshes reuses one buffer
+std::vector<float> sphereVertices;
+
+// Bytes sent to vertex buffers this frame, shown in the controls. Meshes and
+// the grid are only uploaded where they changed, so a paused or static scene
+// sends nothing.
+size_t uploadedBytes = 0;
 
 class Object {
     public:
@@ -115,6 +139,7 @@ class Object {
         float mass;
         float density;  // kg / m^3  HYDROGEN
         float radius;
+        float meshRadius;   // Radius the vertices in VBO were built for
 
         glm::vec3 LastPos = position;
         bool glow;
@@ -130,14 +155,28 @@ class Object {
             
 
             // generate vertices (centered at origin)
-            std::vector<float> vertices = Draw();
-            vertexCount = vertices.size();
+            Draw(sphereVertices);
+            vertexCount = sphereVertices.size();
+            meshRadius = radius;
 
-            CreateVBOVAO(VAO, VBO, vertices.data(), vertexCount);
+            CreateVBOVAO(VAO, VBO, sphereVertices.data(), vertexCount);
+            uploadedBytes += vertexCount * sizeof(float);
         }
 
-        std::vector<float> Draw() {
-            std::vector<float> vertices;
+        // Takes over another body's properties, keeping this object's buffers
+        void Assign(glm::vec3 newPosition, glm::vec3 newVelocity, float newMass, float newDensity, glm::vec4 newColor, bool Glow) {
+            position = LastPos = newPosition;
+            velocity = newVelocity;
+            mass = newMass;
+            density = newDensity;
+            radius = pow(((3 * mass/density)/(4 * 3.14159265359)), (1.0f/3.0f)) / sizeRatio;
+            color = newColor;
+            glow = Glow;
+            UpdateVertices();
+        }
+
+        void Draw(std::vector<float>& vertices) const {
+            vertices.clear();
             int stacks = 10;
             int sectors = 10;
 
@@ -164,51 +203,101 @@ class Object {
                     vertices.insert(vertices.end(), {v3.x, v3.y, v3.z});
                 }   
             }
-            return vertices;
-        }
-        
-        void UpdatePos(){
-            this->position[0] += this->velocity[0] / 94;
-            this->position[1] += this->velocity[1] / 94;
-            this->position[2] += this->velocity[2] / 94;
-            this->radius = pow(((3 * this->mass/this->density)/(4 * 3.14159265359)), (1.0f/3.0f)) / sizeRatio;
         }
+
+        // Rebuilds the mesh if the radius changed since the last upload.
+        // Every sphere has the same vertex count, so the buffer is only overwritten.
         void UpdateVertices() {
+            if (radius == meshRadius) return;
             // generate new vertices with current radius
-            std::vector<float> vertices = Draw();
-            
+            Draw(sphereVertices);
+            meshRadius = radius;
+
             // update VBO with new vertex data
             glBindBuffer(GL_ARRAY_BUFFER, VBO);
-            glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+            if (sphereVertices.size() == vertexCount) {
+                glBufferSubData(GL_ARRAY_BUFFER, 0, vertexCount * sizeof(float), sphereVertices.data());
+            } else {
+                vertexCount = sphereVertices.size();
+                glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(float), sphereVertices.data(), GL_STATIC_DRAW);
+            }
+            uploadedBytes += vertexCount * sizeof(float);
         }
         glm::vec3 GetPos() const {
             return this->position;
         }
-        void accelerate(float x, float y, float z){
-            this->velocity[0] += x / 96;
-            this->velocity[1] += y / 96;
-            this->velocity[2] += z / 96;
-        }
-        float CheckCollision(const Object& other) {
-            float dx = other.position[0] - this->position[0];
-            float dy = other.position[1] - this->position[1];
-            float dz = other.position[2] - this->position[2];
-            float distance = std::pow(dx*dx + dy*dy + dz*dz, (1.0f/2.0f));
-            if (other.radius + this->radius > distance){
-                return -0.2f;
-            }
-            return 1.0f;
-        }
 };
 std::vector<Object> objs = {};
 
+// Inputs of the body creator panel
+struct BodyCreationParams {
+    float mass = 1e24f;
+    float density = 3344.0f;
+    glm::vec3 position{0.0f};
+    glm::vec3 velocity{0.0f};
+    glm::vec4 color{1.0f, 1.0f, 1.0f, 1.0f};
+    bool isGlowing = false;
+};
+
+// Plays a trajectory or ephemeris file in place of the live simulation
+struct ReplayState {
+    TrajectoryReader reader;
+    EphemerisReader ephemeris;              // Open instead of reader for ephemeris files
+    std::vector<uint32_t> ephemerisBodies;  // Ephemeris bodies currently in objs
+    double playhead = 0.0;      // Fractional frame index, or step for an ephemeris
+    float speed = 30.0f;        // Frames (or steps) per second, negative plays backwards
+    bool playing = true;
+    bool loop = true;
+    char path[256] = "trajectory.traj";
+
+    bool isOpen() const { return reader.isOpen() || ephemeris.isOpen(); }
+};
+
+void SetObject(size_t i, glm::vec3 position, glm::vec3 velocity, float mass, float density, glm::vec4 color, bool glow);
+void TrimObjects(size_t count);
+void RebuildObjects(const SimulationSnapshot& snapshot);
+void RebuildObjects(const TrajectoryFrame& frame);
+void RebuildObjects(const EphemerisReader& ephemeris, const std::vector<uint32_t>& bodies);
+bool OpenReplay(ReplayState& replay);
+void AdvanceReplay(ReplayState& replay, float dt);
+
+// What the grid was last bent by. A bend with the same inputs gives the
+// same vertices, so it is skipped along with the upload.
+struct GridBend {
+    std::vector<glm::vec4> bodies;  // Position and mass of every body, w < 0 while initialising
+    float shiftFrom = 0.0f;         // Grid height the vertical shift was taken from
+    float height = 0.0f;            // Highest vertex after the bend
+    bool valid = false;
+};
+
 std::vector<float> CreateGridVertices(float size, int divisions, const std::vector<Object>& objs);
-std::vector<float> UpdateGridVertices(std::vector<float> vertices, const std::vector<Object>& objs);
+// Bends the grid if its inputs changed and returns the range of floats that
+// came out different ([first, end), empty if none)
+void UpdateGridVertices(std::vector<float>& vertices, const std::vector<Object>& objs, GridBend& bend,
+                        size_t& first, size_t& end);
 
 GLuint gridVAO, gridVBO;
 
+// Session journal (--record FILE): the physics thread logs edits, the callbacks raw input
+JournalWriter journal;
+
+
+int main(int argc, char** argv) {
+    ReplayState replay;
+    std::string recordPath;
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "--headless") {
+            return runHeadless(argc - 1, argv + 1);
+        }
+        if (std::string(argv[i]) == "--replay" && i + 1 < argc) {
+            std::snprintf(replay.path, sizeof(replay.path), "%s", argv[++i]);
+            if (OpenReplay(replay)) pause = true;
+        }
+        if (std::string(argv[i]) == "--record" && i + 1 < argc) {
+            recordPath = argv[++i];
+        }
+    }
 
-int main() {
     GLFWwindow* window = StartGLU();
     GLuint shaderProgram = CreateShaderProgram(vertexShaderSource, fragmentShaderSource);
 
@@ -250,35 +339,48 @@ int main() {
     cameraPos = glm::vec3(0.0f, 1000.0f, 5000.0f);
 
     
-    objs = {
-        // Sun
-		Object(glm::vec3(0, 0, 0), glm::vec3(0, 0, 0), 1.989 * pow(10, 25), 1414, glm::vec4(1.0f, 0.929f, 0.176f, 1.0f), true),
-		
-	    // Mars
-		Object(glm::vec3(-3000, 650, 0), glm::vec3(0, 0, 500), 5.97219 * pow(10, 23), 5515, glm::vec4(1.0f, 0.25f, 0.56f, 1.0f)),
-		
-		// Earth
-		Object(glm::vec3(5000, 650, 0), glm::vec3(0, 0, -500), 5.97219 * pow(10, 23), 5515, glm::vec4(0.0f, 1.0f, 1.0f, 1.0f)),
-		
-		// Moon
-		Object(glm::vec3(5250, 650, 0), glm::vec3(0, 0, -50), 5.97219 * pow(10, 21), 5515, glm::vec4(1.0f, 1.0f, 1.0f, 1.0f)),
-		
-		// Jupiter
-		Object(glm::vec3(0, 500, 9000), glm::vec3(-500, 50, 0), 5.97219 * pow(10, 23.5), 5515, glm::vec4(1.0f, 0.5f, 0.15f, 1.0f)),
-		Object(glm::vec3(0, 550, 9500), glm::vec3(0, 0, -50), 5.97219 * pow(10, 21), 5515, glm::vec4(1.0f, 1.0f, 1.0f, 1.0f)),
-		Object(glm::vec3(0, 450, 8500), glm::vec3(0, 0, -50), 5.97219 * pow(10, 21), 5515, glm::vec4(1.0f, 1.0f, 1.0f, 1.0f)),
-		Object(glm::vec3(100, 500, 9000), glm::vec3(50, 0, 0), 5.97219 * pow(10, 21), 5515, glm::vec4(1.0f, 1.0f, 1.0f, 1.0f)),
-		
-		// Neptune
-		Object(glm::vec3(0, -500, -10500), glm::vec3(-350, 50, 0), 5.97219 * pow(10, 23.5), 5515, glm::vec4(0.35f, 0.85f, 0.99f, 1.0f)),
-		Object(glm::vec3(350, -450, -10500), glm::vec3(0, 0, -550), 5.97219 * pow(10, 21), 5515, glm::vec4(1.0f, 1.0f, 1.0f, 1.0f)),
-		Object(glm::vec3(-350, -450, -10500), glm::vec3(0, 0, -550), 5.97219 * pow(10, 21), 5515, glm::vec4(1.0f, 1.0f, 1.0f, 1.0f)),
-		Object(glm::vec3(0, -450, -11050), glm::vec3(-550, 0, 0), 5.97219 * pow(10, 21), 5515, glm::vec4(1.0f, 1.0f, 1.0f, 1.0f)),
-
-    };
-	
+    // Physics state lives in the engine, objs only carry the meshes
+    SimulationEngine engine;
+    Presets::loadSolarSystem(engine);
+    engine.isPaused = pause;
+
+    // From here on only the physics thread touches the engine. UI edits go
+    // through its command queue and are applied at the next tick boundary.
+    PhysicsThread physics(engine);
+    bool pauseSent = pause;
+    bool deterministic = engine.deterministic;
+    float timeScale = engine.timeScale;
+    float physicsRate = 60.0f;
+    uint64_t meshTopology = 0;
+    std::vector<uint32_t> aliveBodies;
+    bool replayMeshes = false;      // objs currently mirror the trajectory, not the engine
+    BodyCreationParams creation;
+
+    // Index of the snapshot's bodies for picking and neighbour queries, rebuilt once per new snapshot
+    SpatialIndex bodyIndex;
+    uint64_t indexedStep = UINT64_MAX, indexedTopology = UINT64_MAX;
+    uint64_t selectedId = 0;        // 0 = nothing selected
+    size_t selectedIndex = 0;       // Where selectedId was last seen in the snapshot
+    bool followSelected = false;    // Camera moves along with the selected body
+    glm::vec3 followedPosition{0.0f};
+    int neighbourCount = 5;
+
+    // Test particles: drawn as points from a buffer that is only refilled
+    // when a new snapshot arrives. Ring radii are in radii of the centre body.
+    GLuint particleVAO = 0, particleVBO = 0;
+    size_t particleCapacity = 0, particleCount = 0;
+    uint64_t particleStep = UINT64_MAX;
+    int ringCount = 100000;
+    float ringInner = 1.5f, ringOuter = 3.0f;
+    std::vector<uint32_t> neighbours;
+    if (!recordPath.empty() && journal.open(recordPath, engine)) {
+        physics.setJournal(&journal);
+    }
+    physics.start();
+
     std::vector<float> gridVertices = CreateGridVertices(20000.0f, 25, objs);
-    CreateVBOVAO(gridVAO, gridVBO, gridVertices.data(), gridVertices.size());
+    CreateVBOVAO(gridVAO, gridVBO, gridVertices.data(), gridVertices.size(), GL_DYNAMIC_DRAW);
+    GridBend gridBend;
 
     // Define light properties
     glm::vec3 lightPos(0.0f, 0.0f, 0.0f); // Sun's position
@@ -291,9 +393,67 @@ int main() {
         float currentFrame = glfwGetTime();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
+        const size_t frameUploadBytes = uploadedBytes;    // Last frame's, for the controls
+        uploadedBytes = 0;
 
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+        // Pause may also have been toggled from the key callback
+        if (pause != pauseSent && physics.submit(SimulationCommand::setPaused(pause))) {
+            pauseSent = pause;
+        }
+
+        // Pull the newest completed physics tick, or the current replay frame, into the meshes
+        const SimulationSnapshot& snapshot = physics.latest();
+        const bool replaying = replay.isOpen();
+        TrajectoryFrame frame, nextFrame;
+        if (replay.ephemeris.isOpen()) {
+            // Any step is one evaluation away, so there is nothing to blend
+            AdvanceReplay(replay, deltaTime);
+            replay.ephemeris.bodiesAt(replay.playhead, aliveBodies);
+            if (!replayMeshes || aliveBodies != replay.ephemerisBodies) {
+                RebuildObjects(replay.ephemeris, aliveBodies);
+                replay.ephemerisBodies = aliveBodies;
+                meshTopology = UINT64_MAX;  // Matches no trajectory chunk
+                replayMeshes = true;
+            }
+            for (size_t i = 0; i < objs.size(); ++i) {
+                glm::dvec3 position, velocity;
+                if (replay.ephemeris.state(aliveBodies[i], replay.playhead, position, velocity)) {
+                    objs[i].position = glm::vec3(position);
+                    objs[i].velocity = glm::vec3(velocity);
+                }
+            }
+        } else if (replaying) {
+            AdvanceReplay(replay, deltaTime);
+            const size_t index = size_t(replay.playhead);
+            if (replay.reader.frame(index, frame)) {
+                if (!replayMeshes || frame.topologyVersion != meshTopology) {
+                    RebuildObjects(frame);
+                    meshTopology = frame.topologyVersion;
+                    replayMeshes = true;
+                }
+                // Blend towards the next frame so slow playback stays smooth
+                const bool blend = replay.reader.frame(index + 1, nextFrame) &&
+                                   nextFrame.topologyVersion == frame.topologyVersion;
+                const float t = float(replay.playhead - double(index));
+                for (size_t i = 0; i < objs.size(); ++i) {
+                    objs[i].position = blend ? glm::mix(frame.position(i), nextFrame.position(i), t) : frame.position(i);
+                    objs[i].velocity = blend ? glm::mix(frame.velocity(i), nextFrame.velocity(i), t) : frame.velocity(i);
+                }
+            }
+        } else {
+            if (replayMeshes || snapshot.topologyVersion != meshTopology) {
+                RebuildObjects(snapshot);
+                meshTopology = snapshot.topologyVersion;
+                replayMeshes = false;
+            }
+            for (size_t i = 0; i < objs.size(); ++i) {
+                objs[i].position = snapshot.positions[i];
+                objs[i].velocity = snapshot.velocities[i];
+            }
+        }
+
         // Start the Dear ImGui frame
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplGlfw_NewFrame();
@@ -316,10 +476,220 @@ int main() {
         }
         ImGui::Separator();
 
+        if (ImGui::SliderFloat("Time scale", &timeScale, 0.1f, 10.0f, "%.2f")) {
+            physics.submit(SimulationCommand::setTimeScale(timeScale));
+        }
+        if (ImGui::Checkbox("Deterministic reductions", &deterministic)) {
+            physics.submit(SimulationCommand::setDeterministic(deterministic));
+        }
+        if (ImGui::SliderFloat("Physics rate (ticks/s)", &physicsRate, 10.0f, 480.0f, "%.0f")) {
+            physics.setTargetRate(physicsRate);
+        }
+        ImGui::Text("Threads: %u", engine.getThreadCount());
+        ImGui::Text("Step: %llu (%.0f ticks/s)", static_cast<unsigned long long>(snapshot.step), snapshot.ticksPerSecond);
+        ImGui::Text("Force pass: %.3f ms", snapshot.lastForceMs);
+        ImGui::Text("GPU upload: %.1f KB/frame", frameUploadBytes / 1024.0);
+        ImGui::Text("Total energy: %.6e J (drift %+.3e)", snapshot.totalEnergy, snapshot.energyDrift);
+        if (snapshot.diagnostics.valid) {
+            const Diagnostics& d = snapshot.diagnostics;
+            ImGui::Text("Momentum: %.6e  Angular momentum: %.6e", glm::length(d.momentum), glm::length(d.angularMomentum));
+            ImGui::Text("Centre of mass: %.1f, %.1f, %.1f", d.centerOfMass.x, d.centerOfMass.y, d.centerOfMass.z);
+        }
+        if (journal.isOpen()) {
+            ImGui::Text("Recording %s (%llu events)", recordPath.c_str(),
+                        static_cast<unsigned long long>(journal.entryCount()));
+        }
+        ImGui::Separator();
+
+        if (ImGui::CollapsingHeader("Presets")) {
+            if (ImGui::Button("Solar System")) {
+                physics.submit(SimulationCommand::loadPreset(SimulationPreset::SOLAR_SYSTEM));
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Binary Stars")) {
+                physics.submit(SimulationCommand::loadPreset(SimulationPreset::BINARY_STARS));
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Galaxy Collision")) {
+                physics.submit(SimulationCommand::loadPreset(SimulationPreset::GALAXY_COLLISION));
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Empty")) {
+                physics.submit(SimulationCommand::loadPreset(SimulationPreset::EMPTY));
+            }
+        }
+
+        if (ImGui::CollapsingHeader("History") && snapshot.historyLast > snapshot.historyFirst) {
+            int rewindStep = int(snapshot.step);
+            if (ImGui::SliderInt("Step##history", &rewindStep, int(snapshot.historyFirst), int(snapshot.historyLast))) {
+                pause = pauseSent = true;   // The physics thread pauses itself on a seek
+                physics.seek(uint64_t(rewindStep));
+            }
+            if (snapshot.rewound) {
+                ImGui::TextWrapped("Showing the past: resuming or editing continues from this step and "
+                                   "discards the steps after it");
+                if (ImGui::Button("Back to live")) physics.seek(snapshot.historyLast);
+            }
+        }
+
+        if (!replaying && (snapshot.step != indexedStep || snapshot.topologyVersion != indexedTopology)) {
+            bodyIndex.build(snapshot.positions, snapshot.radius);
+            indexedStep = snapshot.step;
+            indexedTopology = snapshot.topologyVersion;
+        }
+        if (pickRequested) {
+            pickRequested = false;
+            int width = 0, height = 0;
+            glfwGetWindowSize(window, &width, &height);
+            if (!replaying && width > 0 && height > 0) {
+                // Cursor to a world-space ray through the same camera the scene is drawn with
+                const glm::mat4 view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
+                const glm::mat4 inverse = glm::inverse(projection * view);
+                const float ndcX = float(2.0 * pickX / width - 1.0), ndcY = float(1.0 - 2.0 * pickY / height);
+                const glm::vec4 nearPoint = inverse * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+                const glm::vec4 farPoint = inverse * glm::vec4(ndcX, ndcY, 1.0f, 1.0f);
+                const glm::vec3 from = glm::vec3(nearPoint) / nearPoint.w;
+                const glm::vec3 to = glm::vec3(farPoint) / farPoint.w;
+                SpatialIndex::Hit hit;
+                selectedId = bodyIndex.raycast(from, to - from, glm::length(to - from), hit) ? snapshot.ids[hit.index] : 0;
+                if (selectedId != 0) {
+                    selectedIndex = hit.index;
+                    followedPosition = snapshot.positions[hit.index];
+                }
+            }
+        }
+
+        // The selection is held by id, which survives compaction; the cached
+        // index is only looked up again once the bodies were added or removed
+        bool selectionAlive = false;
+        if (selectedId != 0 && !replaying) {
+            if (selectedIndex >= snapshot.ids.size() || snapshot.ids[selectedIndex] != selectedId) {
+                selectedIndex = size_t(std::find(snapshot.ids.begin(), snapshot.ids.end(), selectedId) -
+                                       snapshot.ids.begin());
+            }
+            selectionAlive = selectedIndex < snapshot.ids.size();
+        }
+        if (!selectionAlive) followSelected = false;
+        if (followSelected) {
+            cameraPos += snapshot.positions[selectedIndex] - followedPosition;
+            followedPosition = snapshot.positions[selectedIndex];
+        }
+
+        if (ImGui::CollapsingHeader("Selection") && !replaying) {
+            if (!selectionAlive) {
+                ImGui::TextWrapped("Middle-click a body to select it");
+            } else {
+                const size_t i = selectedIndex;
+                ImGui::Text("Body %llu", static_cast<unsigned long long>(selectedId));
+                ImGui::Text("  Position: (%.2f, %.2f, %.2f)", snapshot.positions[i].x, snapshot.positions[i].y,
+                            snapshot.positions[i].z);
+                ImGui::Text("  Mass: %.2e kg", snapshot.mass[i]);
+                ImGui::SliderInt("Neighbours", &neighbourCount, 1, 32);
+                // The body itself comes back first
+                bodyIndex.nearest(snapshot.positions[i], size_t(neighbourCount) + 1, neighbours);
+                for (uint32_t n : neighbours) {
+                    if (n == i) continue;
+                    ImGui::Text("  %llu at %.2f units", static_cast<unsigned long long>(snapshot.ids[n]),
+                                glm::length(snapshot.positions[n] - snapshot.positions[i]));
+                }
+                if (ImGui::Checkbox("Follow with camera", &followSelected)) followedPosition = snapshot.positions[i];
+                if (ImGui::SmallButton("Deselect")) selectedId = 0;
+            }
+        }
+
+        if (ImGui::CollapsingHeader("Test Particles") && !replaying) {
+            ImGui::SliderInt("Count##ring", &ringCount, 1000, 1000000, "%d", ImGuiSliderFlags_Logarithmic);
+            ImGui::SliderFloat("Inner radius (body radii)", &ringInner, 1.0f, 50.0f, "%.2f");
+            ImGui::SliderFloat("Outer radius (body radii)", &ringOuter, 1.0f, 50.0f, "%.2f");
+            if (!snapshot.ids.empty()) {
+                // Around the selected body, or else the heaviest
+                const size_t centre = selectionAlive ? selectedIndex
+                                                     : size_t(std::max_element(snapshot.mass.begin(), snapshot.mass.end()) -
+                                                              snapshot.mass.begin());
+                if (ImGui::Button(selectionAlive ? "Add ring around selected body" : "Add ring around heaviest body")) {
+                    const float r = snapshot.radius[centre];
+                    physics.submit(SimulationCommand::addRing(snapshot.ids[centre], uint32_t(ringCount), ringInner * r,
+                                                              std::max(ringInner, ringOuter) * r));
+                }
+                ImGui::SameLine();
+            }
+            if (ImGui::Button("Clear##particles")) {
+                physics.submit(SimulationCommand::clearParticles());
+            }
+            ImGui::Text("%zu particles, %.3f ms per step", snapshot.particles.size(), snapshot.lastParticleMs);
+        }
+
+        if (ImGui::CollapsingHeader("Replay", replaying ? ImGuiTreeNodeFlags_DefaultOpen : 0)) {
+            ImGui::InputText("File", replay.path, sizeof(replay.path));
+            if (ImGui::Button(replaying ? "Close" : "Open")) {
+                if (replaying) {
+                    replay.reader.close();
+                    replay.ephemeris.close();
+                } else if (OpenReplay(replay)) {
+                    replay.playing = true;
+                    pause = true;   // The live simulation waits underneath
+                }
+            }
+            if (replay.ephemeris.isOpen()) {
+                ImGui::SameLine();
+                if (ImGui::Button(replay.playing ? "Stop" : "Play")) {
+                    replay.playing = !replay.playing;
+                }
+                ImGui::SameLine();
+                ImGui::Checkbox("Loop", &replay.loop);
+
+                float scrub = float(replay.playhead);
+                if (ImGui::SliderFloat("Step", &scrub, float(replay.ephemeris.firstStep()),
+                                       float(replay.ephemeris.lastStep()), "%.1f")) {
+                    replay.playhead = scrub;
+                }
+                ImGui::SliderFloat("Speed (steps/s)", &replay.speed, -2400.0f, 2400.0f, "%.0f");
+                ImGui::Text("Ephemeris of %zu bodies, steps %llu to %llu in segments of %llu", replay.ephemeris.bodyCount(),
+                            static_cast<unsigned long long>(replay.ephemeris.firstStep()),
+                            static_cast<unsigned long long>(replay.ephemeris.lastStep()),
+                            static_cast<unsigned long long>(replay.ephemeris.segmentSteps()));
+            } else if (replaying && replay.reader.frameCount() > 0) {
+                ImGui::SameLine();
+                if (ImGui::Button(replay.playing ? "Stop" : "Play")) {
+                    replay.playing = !replay.playing;
+                }
+                ImGui::SameLine();
+                ImGui::Checkbox("Loop", &replay.loop);
+
+                int scrub = int(replay.playhead);
+                if (ImGui::SliderInt("Frame", &scrub, 0, int(replay.reader.frameCount() - 1))) {
+                    replay.playhead = scrub;
+                }
+                ImGui::SliderFloat("Speed (frames/s)", &replay.speed, -240.0f, 240.0f, "%.0f");
+                ImGui::Text("Step %llu, %zu frames every %llu steps", static_cast<unsigned long long>(frame.step),
+                            replay.reader.frameCount(), static_cast<unsigned long long>(replay.reader.stride()));
+            }
+        }
+
+        if (ImGui::CollapsingHeader("Body Creator")) {
+            ImGui::InputFloat("Mass (kg)", &creation.mass, 0.0f, 0.0f, "%.3e");
+            ImGui::InputFloat("Density (kg/m^3)", &creation.density);
+            ImGui::InputFloat3("Position", glm::value_ptr(creation.position));
+            ImGui::InputFloat3("Velocity", glm::value_ptr(creation.velocity));
+            ImGui::ColorEdit4("Color", glm::value_ptr(creation.color));
+            ImGui::Checkbox("Glowing", &creation.isGlowing);
+            if (ImGui::Button("Add Body") && creation.mass > 0.0f && creation.density > 0.0f) {
+                physics.submit(SimulationCommand::addBody(creation.position, creation.velocity, creation.mass,
+                                                          creation.density, creation.color, creation.isGlowing));
+            }
+        }
+        ImGui::Separator();
+
         ImGui::Text("Planetary Data:");
         for (size_t i = 0; i < objs.size(); ++i) {
             ImGui::PushID(i);
             ImGui::Text("Object %zu:", i);
+            if (!replaying) {
+                ImGui::SameLine();
+                if (ImGui::SmallButton("Remove")) {
+                    physics.submit(SimulationCommand::removeBody(snapshot.ids[i]));
+                }
+            }
             ImGui::Text("  Position: (%.2f, %.2f, %.2f)", objs[i].position.x, objs[i].position.y, objs[i].position.z);
             ImGui::Text("  Velocity: (%.2f, %.2f, %.2f)", objs[i].velocity.x, objs[i].velocity.y, objs[i].velocity.z);
             ImGui::Text("  Mass: %.2e kg", objs[i].mass);
@@ -345,50 +715,48 @@ int main() {
         glUniform4f(objectColorLoc, 1.0f, 1.0f, 1.0f, 0.25f);
         glUniform1i(glGetUniformLocation(shaderProgram, "isGrid"), 1);
         glUniform1i(glGetUniformLocation(shaderProgram, "GLOW"), 0);
-        gridVertices = UpdateGridVertices(gridVertices, objs);
-        glBindBuffer(GL_ARRAY_BUFFER, gridVBO);
-        glBufferData(GL_ARRAY_BUFFER, gridVertices.size() * sizeof(float), gridVertices.data(), GL_DYNAMIC_DRAW);
+        size_t gridFirst = 0, gridEnd = 0;
+        UpdateGridVertices(gridVertices, objs, gridBend, gridFirst, gridEnd);
+        if (gridEnd > gridFirst) {
+            glBindBuffer(GL_ARRAY_BUFFER, gridVBO);
+            glBufferSubData(GL_ARRAY_BUFFER, gridFirst * sizeof(float), (gridEnd - gridFirst) * sizeof(float),
+                            gridVertices.data() + gridFirst);
+            uploadedBytes += (gridEnd - gridFirst) * sizeof(float);
+        }
         DrawGrid(shaderProgram, gridVAO, gridVertices.size());
 
+        // Test particles belong to the live state: not shown over a replay or the past
+        if (!replaying && !snapshot.rewound && !snapshot.particles.empty()) {
+            const size_t count = snapshot.particles.size();
+            const size_t bytes = count * sizeof(glm::vec3);
+            if (particleVAO == 0) {
+                CreateVBOVAO(particleVAO, particleVBO, nullptr, 0, GL_STREAM_DRAW);
+            }
+            if (snapshot.step != particleStep || count != particleCount) {
+                glBindBuffer(GL_ARRAY_BUFFER, particleVBO);
+                if (count > particleCapacity) {
+                    glBufferData(GL_ARRAY_BUFFER, bytes, snapshot.particles.data(), GL_STREAM_DRAW);
+                    particleCapacity = count;
+                } else {
+                    glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, snapshot.particles.data());
+                }
+                uploadedBytes += bytes;
+                particleStep = snapshot.step;
+                particleCount = count;
+            }
+            glUniform4f(objectColorLoc, 0.85f, 0.8f, 0.7f, 0.6f);
+            DrawParticles(shaderProgram, particleVAO, count);
+        }
+
         // Draw the triangles / sphere
         for(auto& obj : objs) {
             glUniform4f(objectColorLoc, obj.color.r, obj.color.g, obj.color.b, obj.color.a);
 
-            for(auto& obj2 : objs){
-                if(&obj2 != &obj && !obj.Initalizing && !obj2.Initalizing){
-                    float dx = obj2.GetPos()[0] - obj.GetPos()[0];
-                    float dy = obj2.GetPos()[1] - obj.GetPos()[1];
-                    float dz = obj2.GetPos()[2] - obj.GetPos()[2];
-                    float distance = sqrt(dx * dx + dy * dy + dz * dz);
-
-                    if (distance > 0) {
-                        std::vector<float> direction = {dx / distance, dy / distance, dz / distance};
-                        distance *= 1000;
-                        double Gforce = (G * obj.mass * obj2.mass) / (distance * distance);
-                        
-
-                        float acc1 = Gforce / obj.mass;
-                        std::vector<float> acc = {direction[0] * acc1, direction[1]*acc1, direction[2]*acc1};
-                        if(!pause){
-                            obj.accelerate(acc[0], acc[1], acc[2]);
-                        }
-
-                        //collision
-                        obj.velocity *= obj.CheckCollision(obj2);
-                        // std::cout<<"radius: "<<obj.radius<<std::endl;
-                    }
-                }
-            }
             if(obj.Initalizing){
                 obj.radius = pow(((3 * obj.mass/obj.density)/(4 * 3.14159265359)), (1.0f/3.0f)) / sizeRatio;
                 obj.UpdateVertices();
             }
 
-            //update positions
-            if(!pause){
-                obj.UpdatePos();
-            }
-            
             glm::mat4 model = glm::mat4(1.0f);
             model = glm::translate(model, obj.position); // apply position
             glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
@@ -411,6 +779,9 @@ int main() {
         glfwPollEvents();
     }
 
+    physics.stop();
+    journal.finish(engine);
+
     // Cleanup ImGui
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
@@ -423,6 +794,10 @@ int main() {
 
     glDeleteVertexArrays(1, &gridVAO);
     glDeleteBuffers(1, &gridVBO);
+    if (particleVAO != 0) {
+        glDeleteVertexArrays(1, &particleVAO);
+        glDeleteBuffers(1, &particleVBO);
+    }
 
     glDeleteProgram(shaderProgram);
     glfwTerminate();
@@ -509,13 +884,13 @@ GLuint CreateShaderProgram(const char* vertexSource, const char* fragmentSource)
     return shaderProgram;
 }
 
-void CreateVBOVAO(GLuint& VAO, GLuint& VBO, const float* vertices, size_t vertexCount) {
+void CreateVBOVAO(GLuint& VAO, GLuint& VBO, const float* vertices, size_t vertexCount, GLenum usage) {
     glGenVertexArrays(1, &VAO);
     glGenBuffers(1, &VBO);
 
     glBindVertexArray(VAO);
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(float), vertices, GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(float), vertices, usage);
 
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
@@ -553,6 +928,7 @@ void processInput(GLFWwindow* window) {
 void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
     // Pass key events to ImGui
     ImGui_ImplGlfw_KeyCallback(window, key, scancode, action, mods);
+    journal.input(Journal::Kind::Key, key, action, mods);
 
     // Only process if ImGui is not capturing keyboard and key is pressed (not held down)
     if (!ImGui::GetIO().WantCaptureKeyboard && action == GLFW_PRESS) {
@@ -568,6 +944,7 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
 void mouse_callback(GLFWwindow* window, double xpos, double ypos) {
     // Pass mouse events to ImGui
     ImGui_ImplGlfw_CursorPosCallback(window, xpos, ypos);
+    journal.input(Journal::Kind::CursorPos, 0, 0, 0, float(xpos), float(ypos));
     if (ImGui::GetIO().WantCaptureMouse) {
         return; // ImGui is handling the mouse input
     }
@@ -605,6 +982,7 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos) {
 void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods){
     // Pass mouse events to ImGui
     ImGui_ImplGlfw_MouseButtonCallback(window, button, action, mods);
+    journal.input(Journal::Kind::MouseButton, button, action, mods);
     if (ImGui::GetIO().WantCaptureMouse) {
         return; // ImGui is handling the mouse input
     }
@@ -619,6 +997,10 @@ void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods){
             glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL); // Enable cursor when button is released
         }
     }
+    if (button == GLFW_MOUSE_BUTTON_MIDDLE && action == GLFW_PRESS) {
+        glfwGetCursorPos(window, &pickX, &pickY);
+        pickRequested = true;
+    }
     // Right mouse button functionality is removed as requested
     // Original left click functionality (spawn object) is also removed to prioritize camera dragging
 }
@@ -626,6 +1008,7 @@ void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods){
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset){
     // Pass scroll events to ImGui
     ImGui_ImplGlfw_ScrollCallback(window, xoffset, yoffset);
+    journal.input(Journal::Kind::Scroll, 0, 0, 0, float(xoffset), float(yoffset));
     if (ImGui::GetIO().WantCaptureMouse) {
         return; // ImGui is handling the scroll input
     }
@@ -655,6 +1038,15 @@ void DrawGrid(GLuint shaderProgram, GLuint gridVAO, size_t vertexCount) {
     glDrawArrays(GL_LINES, 0, vertexCount / 3);
     glBindVertexArray(0);
 }
+void DrawParticles(GLuint shaderProgram, GLuint particleVAO, size_t count) {
+    glm::mat4 model = glm::mat4(1.0f);
+    glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
+
+    glBindVertexArray(particleVAO);
+    glPointSize(1.0f);
+    glDrawArrays(GL_POINTS, 0, GLsizei(count));
+    glBindVertexArray(0);
+}
 std::vector<float> CreateGridVertices(float size, int divisions, const std::vector<Object>& objs) {
     std::vector<float> vertices;
     float step = size / divisions;
@@ -690,8 +1082,31 @@ std::vector<float> CreateGridVertices(float size, int divisions, const std::vect
     return vertices;
 }
 
-std::vector<float> UpdateGridVertices(std::vector<float> vertices, const std::vector<Object>& objs){
-    
+// Bends the grid in place; it is rebuilt from its own previous shape, so
+// the inputs include the height the last bend left behind
+void UpdateGridVertices(std::vector<float>& vertices, const std::vector<Object>& objs, GridBend& bend,
+                        size_t& first, size_t& end){
+    first = end = 0;
+
+    float originalMaxY = bend.height;
+    if (!bend.valid) {
+        originalMaxY = -std::numeric_limits<float>::infinity();
+        for (size_t i = 0; i < vertices.size(); i += 3) {
+            originalMaxY = std::max(originalMaxY, vertices[i+1]);
+        }
+    }
+
+    bool changed = !bend.valid || bend.bodies.size() != objs.size() || bend.shiftFrom != originalMaxY;
+    bend.bodies.resize(objs.size());
+    for (size_t i = 0; i < objs.size(); ++i) {
+        const glm::vec4 body(objs[i].position, objs[i].Initalizing ? -objs[i].mass : objs[i].mass);
+        changed = changed || body != bend.bodies[i];
+        bend.bodies[i] = body;
+    }
+    if (!changed) return;
+    bend.shiftFrom = originalMaxY;
+    bend.valid = true;
+
     // centre of mass calc
     float totalMass = 0.0f;
     float comY = 0.0f;
@@ -701,16 +1116,13 @@ std::vector<float> UpdateGridVertices(std::vector<float> vertices, const std::ve
         totalMass += obj.mass;
     }
     if (totalMass > 0) comY /= totalMass;
-    
-    float originalMaxY = -std::numeric_limits<float>::infinity();
-    for (int i = 0; i < vertices.size(); i += 3) {
-        originalMaxY = std::max(originalMaxY, vertices[i+1]);
-    }
 
     float verticalShift = comY - originalMaxY;
     std::cout<<"vertical shift: "<<verticalShift<<" |         comY: "<<comY<<"|            originalmaxy: "<<originalMaxY<<std::endl;
 
 
+    first = vertices.size();
+    bend.height = -std::numeric_limits<float>::infinity();
     for (int i = 0; i < vertices.size(); i += 3) {
 
         // mass bending space
@@ -727,8 +1139,103 @@ std::vector<float> UpdateGridVertices(std::vector<float> vertices, const std::ve
             float dz = 2 * sqrt(rs * (distance_m - rs));
             totalDisplacement.y += dz * 2.0f;
         }
-        vertices[i+1] = totalDisplacement.y + -abs(verticalShift);
+        const float y = totalDisplacement.y + -abs(verticalShift);
+        bend.height = std::max(bend.height, y);
+        if (y == vertices[i+1]) continue;
+        vertices[i+1] = y;
+        first = std::min(first, size_t(i + 1));
+        end = size_t(i + 2);
     }
+    if (end == 0) first = 0;
+}
 
-    return vertices;
-}
\ No newline at end of file
+// Puts a body into objs[i], reusing the object's buffers if it exists; its
+// mesh is uploaded again only if the radius differs
+void SetObject(size_t i, glm::vec3 position, glm::vec3 velocity, float mass, float density, glm::vec4 color, bool glow) {
+    if (i < objs.size()) {
+        objs[i].Assign(position, velocity, mass, density, color, glow);
+    } else {
+        objs.emplace_back(position, velocity, mass, density, color, glow);
+    }
+}
+
+// Deletes the objects from count on
+void TrimObjects(size_t count) {
+    for (size_t i = count; i < objs.size(); ++i) {
+        glDeleteVertexArrays(1, &objs[i].VAO);
+        glDeleteBuffers(1, &objs[i].VBO);
+    }
+    if (count < objs.size()) objs.erase(objs.begin() + count, objs.end());
+}
+
+// Mirrors the bodies after some were added or removed
+void RebuildObjects(const SimulationSnapshot& snapshot) {
+    TrimObjects(snapshot.positions.size());
+    objs.reserve(snapshot.positions.size());
+    for (size_t i = 0; i < snapshot.positions.size(); ++i) {
+        SetObject(i, snapshot.positions[i], snapshot.velocities[i], snapshot.mass[i], snapshot.density[i],
+                  snapshot.color[i], snapshot.glow[i] != 0);
+    }
+}
+
+// Same, for the body set of a trajectory chunk
+void RebuildObjects(const TrajectoryFrame& frame) {
+    TrimObjects(frame.bodyCount);
+    objs.reserve(frame.bodyCount);
+    for (size_t i = 0; i < frame.bodyCount; ++i) {
+        SetObject(i, frame.position(i), frame.velocity(i), frame.mass[i], frame.density[i], frame.color[i],
+                  frame.glow[i] != 0);
+    }
+}
+
+// Same, for the bodies of an ephemeris alive at the playhead
+void RebuildObjects(const EphemerisReader& ephemeris, const std::vector<uint32_t>& bodies) {
+    TrimObjects(bodies.size());
+    objs.reserve(bodies.size());
+    for (size_t i = 0; i < bodies.size(); ++i) {
+        const EphemerisBody& body = ephemeris.body(bodies[i]);
+        const glm::vec4 color(body.color[0], body.color[1], body.color[2], body.color[3]);
+        SetObject(i, glm::vec3(0.0f), glm::vec3(0.0f), body.mass, body.density, color, body.glow != 0);
+    }
+}
+
+// Opens replay.path as an ephemeris or a trajectory, going by its magic
+bool OpenReplay(ReplayState& replay) {
+    replay.reader.close();
+    replay.ephemeris.close();
+    replay.ephemerisBodies.clear();
+
+    char magic[sizeof(Ephemeris::MAGIC)] = {};
+    std::ifstream probe(replay.path, std::ios::binary);
+    probe.read(magic, sizeof(magic));
+    if (probe && std::memcmp(magic, Ephemeris::MAGIC, sizeof(magic)) == 0) {
+        if (!replay.ephemeris.open(replay.path)) return false;
+        replay.playhead = double(replay.ephemeris.firstStep());
+        return true;
+    }
+    if (!replay.reader.open(replay.path)) return false;
+    replay.playhead = 0.0;
+    return true;
+}
+
+// Moves the playhead by speed * dt frames (steps for an ephemeris), wrapping
+// or stopping at either end
+void AdvanceReplay(ReplayState& replay, float dt) {
+    double first = 0.0;
+    double last = double(replay.reader.frameCount()) - 1.0;
+    if (replay.ephemeris.isOpen()) {
+        first = double(replay.ephemeris.firstStep());
+        last = double(replay.ephemeris.lastStep());
+    }
+    if (!replay.playing || last <= first) return;
+
+    replay.playhead += replay.speed * dt;
+    if (replay.playhead >= first && replay.playhead <= last) return;
+    if (replay.loop) {
+        replay.playhead = first + std::fmod(replay.playhead - first, last - first);
+        if (replay.playhead < first) replay.playhead += last - first;
+    } else {
+        replay.playhead = std::min(std::max(replay.playhead, first), last);
+        replay.playing = false;
+    }
+}
@@ -0,0 +1,932 @@
+#include "Headless.h"
+#include "AllocationCounter.h"
+#include "ArrayImport.h"
+#include "Distributed.h"
+#include "EphemerisReader.h"
+#include "EphemerisWriter.h"
+#include "Ensemble.h"
+#include "History.h"
+#include "Journal.h"
+#include "Octree.h"
+#include "SimulationEngine.h"
+#include "Snapshotter.h"
+#include "SpatialIndex.h"
+#include "TrajectoryWriter.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+namespace {
+
+struct HeadlessOptions {
+    size_t bodies = 0;          // 0 = solar system preset
+    uint64_t steps = 1000;
+    bool stepsGiven = false;    // Modes with their own default keep it unless --steps is given
+    unsigned threads = 0;       // 0 = hardware concurrency
+    uint32_t seed = 1;
+    bool deterministic = false;
+    bool bench = false;
+    bool diagnostics = false;
+    bool checkAllocs = false;
+    uint64_t reorderInterval = 0;   // 0 = keep the bodies in load order
+    bool locality = false;
+
+    // Test particles
+    size_t ring = 0;
+    size_t cloud = 0;
+    int64_t ringBody = -1;          // -1 = the heaviest body
+
+    // Analytic background fields, in the order given
+    std::vector<ExternalField::Potential> potentials;
+
+    // Ensemble mode
+    size_t ensemble = 0;
+    float massJitter = 0.01f;
+    float velocityJitter = 0.01f;
+    float escapeRadius = 50000.0f;
+    bool stopOnEscape = false;
+    bool useLanes = true;
+    std::string output;
+
+    // Checkpoints
+    std::string loadFile;
+    std::string importSpec;
+    std::string sceneFile;
+    std::string model;              // InitialConditions model name, or galaxies
+    std::string saveFile;
+    std::string checkpointFile;     // '#' is replaced by the step
+    uint64_t checkpointEvery = 1000;
+    size_t maxSnapshots = 2;
+    bool syncCheckpoints = false;
+
+    // Rewind history
+    size_t historyMegabytes = 0;    // 0 = off
+    uint64_t keyframeInterval = 64;
+    int64_t rewindStep = -1;
+
+    // Session journal replay
+    std::string journalFile;
+
+    // Trajectory output
+    std::string trajectoryFile;
+    uint64_t trajectoryEvery = 1;
+    bool dropFrames = false;
+    bool compress = false;
+    double positionTolerance = 0.0;
+    double velocityTolerance = 0.0;
+
+    // Ephemeris output and lookups
+    std::string ephemerisFile;
+    uint64_t segmentSteps = 64;
+    uint32_t degree = 11;
+    double ephemerisTolerance = 1e-2;
+    std::string lookupFile;
+    double lookupStep = 0.0;
+
+    // Distributed mode (GRAVITAS_WITH_MPI builds)
+    bool mpi = false;
+    float theta = 0.5f;
+    uint64_t rebalanceInterval = 10;
+};
+
+void printUsage() {
+    std::cout << "Usage: Gravitas --headless [options]\n"
+              << "  --bodies N        random cluster of N bodies (default: solar system)\n"
+              << "  --steps N         number of ticks to run (default: 1000)\n"
+              << "  --threads N       worker threads, 0 = all cores (default: 0)\n"
+              << "  --seed N          seed for random initial conditions\n"
+              << "  --deterministic   bit-reproducible reductions for any thread count\n"
+              << "  --bench           compare fast and deterministic force passes\n"
+              << "  --diagnostics     track energy, momentum and angular momentum every step and report their drift\n"
+              << "  --check-allocs    count heap allocations per steady-state step of every force pass\n"
+              << "  --reorder N       check every N steps whether the bodies need re-sorting along the Morton curve\n"
+              << "  --locality        time tree and neighbour passes before and after a Morton reorder (default: 100000 bodies)\n"
+              << "  --potential SPEC  add an analytic background field, may repeat: PROFILE[:key=value,...] with\n"
+              << "                    PROFILE nfw, hernquist, disk (Miyamoto-Nagai) or log and keys mass, speed, scale,\n"
+              << "                    height, q, x, y, z, vx, vy, vz, ax, ay, az, grow (steps to reach full strength)\n"
+              << "  --ring N          add N test particles in a ring of 1.5 to 3 radii about --ring-body\n"
+              << "  --cloud N         add N test particles in a cloud of 10 to 30 radii about --ring-body\n"
+              << "  --ring-body I     index of the body rings and clouds orbit (default: the heaviest)\n"
+              << "  --ensemble K      run K perturbed copies of the scene concurrently\n"
+              << "  --jitter-mass F   relative 1-sigma mass perturbation (default: 0.01)\n"
+              << "  --jitter-vel F    relative 1-sigma velocity perturbation (default: 0.01)\n"
+              << "  --escape R        distance from the centre of mass counted as ejected\n"
+              << "  --stop-on-escape  end an ensemble instance once a body passes --escape\n"
+              << "  --no-lanes        do not pack small systems into SIMD lanes\n"
+              << "  --out FILE        write ensemble statistics as CSV\n"
+              << "  --load FILE       start from a binary checkpoint instead\n"
+              << "  --import SPEC     start from .npy or raw arrays, e.g. pos=pos.npy,vel=vel.npy,mass=m.npy\n"
+              << "  --scene FILE      start from a text scene, one 'mass density x y z vx vy vz [r g b [a]] [name]' per line\n"
+              << "  --model NAME      start from an equilibrium model of --bodies bodies (default: 10000):\n"
+              << "                    plummer, hernquist, nfw, disk, king, or galaxies for two colliding disks\n"
+              << "  --save FILE       write a binary checkpoint after the run\n"
+              << "  --checkpoint FILE checkpoint periodically in a forked child, '#' in FILE becomes the step\n"
+              << "  --checkpoint-every N  steps between periodic checkpoints (default: 1000)\n"
+              << "  --max-snapshots N skip a checkpoint while N are still being written (default: 2)\n"
+              << "  --sync-checkpoints    write periodic checkpoints in place, pausing the run\n"
+              << "  --history MB      keep a rewind history within MB megabytes\n"
+              << "  --keyframe N      steps between history keyframes (default: 64)\n"
+              << "  --rewind STEP     after the run, rewind to STEP through the history and print its state\n"
+              << "  --journal FILE    replay a session recorded with 'Gravitas --record FILE' and time its steps\n"
+              << "  --trajectory FILE stream positions and velocities to FILE on a writer thread\n"
+              << "  --every N         steps between trajectory frames (default: 1)\n"
+              << "  --drop            drop frames instead of stalling when the writer falls behind\n"
+              << "  --compress        compress trajectory positions and velocities (lossless by default)\n"
+              << "  --pos-tol F       compress with positions kept within F (default: 0, exact)\n"
+              << "  --vel-tol F       compress with velocities kept within F (default: 0, exact)\n"
+              << "  --ephemeris FILE  fit Chebyshev segments of every body's path into FILE\n"
+              << "  --segment N       steps per ephemeris segment (default: 64)\n"
+              << "  --degree N        Chebyshev degree of ephemeris segments (default: 11)\n"
+              << "  --eph-tol F       largest ephemeris fit error before a segment is split (default: 0.01)\n"
+              << "  --lookup FILE     print every body's state from an ephemeris instead of running\n"
+              << "  --at F            step to evaluate for --lookup (default: 0)\n"
+              << "  --mpi             distributed Barnes-Hut run, launch with mpirun -np N\n"
+              << "  --theta F         Barnes-Hut opening angle for --mpi (default: 0.5)\n"
+              << "  --rebalance N     steps between load-balance checks for --mpi (default: 10)\n";
+}
+
+bool parseOptions(int argc, char** argv, HeadlessOptions& options) {
+    for (int i = 0; i < argc; ++i) {
+        const std::string arg = argv[i];
+        auto value = [&]() -> const char* { return i + 1 < argc ? argv[++i] : nullptr; };
+
+        if (arg == "--headless") {
+            continue;
+        } else if (arg == "--help") {
+            return false;
+        } else if (arg == "--deterministic") {
+            options.deterministic = true;
+        } else if (arg == "--bench") {
+            options.bench = true;
+        } else if (arg == "--diagnostics") {
+            options.diagnostics = true;
+        } else if (arg == "--check-allocs") {
+            options.checkAllocs = true;
+        } else if (arg == "--locality") {
+            options.locality = true;
+        } else if (arg == "--stop-on-escape") {
+            options.stopOnEscape = true;
+        } else if (arg == "--no-lanes") {
+            options.useLanes = false;
+        } else if (arg == "--drop") {
+            options.dropFrames = true;
+        } else if (arg == "--compress") {
+            options.compress = true;
+        } else if (arg == "--sync-checkpoints") {
+            options.syncCheckpoints = true;
+        } else if (arg == "--mpi") {
+            options.mpi = true;
+        } else if (arg == "--bodies" || arg == "--steps" || arg == "--threads" || arg == "--seed" ||
+                   arg == "--ensemble" || arg == "--rebalance" || arg == "--every" || arg == "--segment" ||
+                   arg == "--degree" || arg == "--checkpoint-every" || arg == "--max-snapshots" ||
+                   arg == "--history" || arg == "--keyframe" || arg == "--rewind" || arg == "--reorder" ||
+                   arg == "--ring" || arg == "--cloud" || arg == "--ring-body") {
+            const char* v = value();
+            if (!v) {
+                std::cerr << "Missing value for " << arg << std::endl;
+                return false;
+            }
+            const unsigned long long n = std::strtoull(v, nullptr, 10);
+            if (arg == "--bodies") options.bodies = static_cast<size_t>(n);
+            else if (arg == "--steps") {
+                options.steps = n;
+                options.stepsGiven = true;
+            }
+            else if (arg == "--threads") options.threads = static_cast<unsigned>(n);
+            else if (arg == "--ensemble") options.ensemble = static_cast<size_t>(n);
+            else if (arg == "--rebalance") options.rebalanceInterval = n;
+            else if (arg == "--every") options.trajectoryEvery = n;
+            else if (arg == "--segment") options.segmentSteps = n;
+            else if (arg == "--degree") options.degree = static_cast<uint32_t>(n);
+            else if (arg == "--checkpoint-every") options.checkpointEvery = n;
+            else if (arg == "--max-snapshots") options.maxSnapshots = static_cast<size_t>(n);
+            else if (arg == "--history") options.historyMegabytes = static_cast<size_t>(n);
+            else if (arg == "--keyframe") options.keyframeInterval = n;
+            else if (arg == "--rewind") options.rewindStep = static_cast<int64_t>(n);
+            else if (arg == "--reorder") options.reorderInterval = n;
+            else if (arg == "--ring") options.ring = static_cast<size_t>(n);
+            else if (arg == "--cloud") options.cloud = static_cast<size_t>(n);
+            else if (arg == "--ring-body") options.ringBody = static_cast<int64_t>(n);
+            else options.seed = static_cast<uint32_t>(n);
+        } else if (arg == "--jitter-mass" || arg == "--jitter-vel" || arg == "--escape" || arg == "--theta" ||
+                   arg == "--pos-tol" || arg == "--vel-tol" || arg == "--eph-tol") {
+            const char* v = value();
+            if (!v) {
+                std::cerr << "Missing value for " << arg << std::endl;
+                return false;
+            }
+            const float f = std::strtof(v, nullptr);
+            if (arg == "--jitter-mass") options.massJitter = f;
+            else if (arg == "--jitter-vel") options.velocityJitter = f;
+            else if (arg == "--theta") options.theta = f;
+            else if (arg == "--pos-tol") options.positionTolerance = f;
+            else if (arg == "--vel-tol") options.velocityTolerance = f;
+            else if (arg == "--eph-tol") options.ephemerisTolerance = f;
+            else options.escapeRadius = f;
+        } else if (arg == "--at") {
+            const char* v = value();
+            if (!v) {
+                std::cerr << "Missing value for " << arg << std::endl;
+                return false;
+            }
+            options.lookupStep = std::strtod(v, nullptr);
+        } else if (arg == "--out" || arg == "--load" || arg == "--save" || arg == "--trajectory" ||
+                   arg == "--ephemeris" || arg == "--lookup" || arg == "--checkpoint" ||
+                   arg == "--import" || arg == "--scene" || arg == "--journal" || arg == "--model" ||
+                   arg == "--potential") {
+            const char* v = value();
+            if (!v) {
+                std::cerr << "Missing value for " << arg << std::endl;
+                return false;
+            }
+            if (arg == "--out") options.output = v;
+            else if (arg == "--load") options.loadFile = v;
+            else if (arg == "--trajectory") options.trajectoryFile = v;
+            else if (arg == "--ephemeris") options.ephemerisFile = v;
+            else if (arg == "--lookup") options.lookupFile = v;
+            else if (arg == "--checkpoint") options.checkpointFile = v;
+            else if (arg == "--import") options.importSpec = v;
+            else if (arg == "--scene") options.sceneFile = v;
+            else if (arg == "--journal") options.journalFile = v;
+            else if (arg == "--model") options.model = v;
+            else if (arg == "--potential") {
+                ExternalField::Potential field;
+                if (!ExternalField::parse(v, field)) return false;
+                options.potentials.push_back(field);
+            }
+            else options.saveFile = v;
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return false;
+        }
+    }
+    if (options.positionTolerance > 0 || options.velocityTolerance > 0) options.compress = true;
+    return true;
+}
+
+bool loadInitialConditions(SimulationEngine& engine, const HeadlessOptions& options) {
+    if (!options.loadFile.empty()) {
+        const auto start = std::chrono::steady_clock::now();
+        if (!engine.loadState(options.loadFile)) return false;
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::printf("loaded %zu bodies at step %llu from %s in %.2f ms\n", engine.bodies.size(),
+                    static_cast<unsigned long long>(engine.stepCount), options.loadFile.c_str(), ms);
+        if (options.deterministic) engine.deterministic = true;
+    } else if (!options.importSpec.empty()) {
+        std::vector<ArrayImport::Source> sources;
+        if (!ArrayImport::parseSources(options.importSpec, sources)) return false;
+        const auto start = std::chrono::steady_clock::now();
+        if (!engine.importArrays(sources)) return false;
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::printf("imported %zu bodies in %.2f ms\n", engine.bodies.size(), ms);
+    } else if (!options.sceneFile.empty()) {
+        const auto start = std::chrono::steady_clock::now();
+        if (!engine.loadScene(options.sceneFile)) return false;
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::printf("loaded %zu bodies (%zu named) from %s in %.2f ms\n", engine.bodies.size(),
+                    engine.bodies.names.size(), options.sceneFile.c_str(), ms);
+    } else if (!options.model.empty()) {
+        const size_t count = options.bodies > 0 ? options.bodies : 10000;
+        InitialConditions::Config config;
+        if (options.model != "galaxies" && !InitialConditions::parseModel(options.model, config.model)) {
+            std::cerr << "Unknown model: " << options.model << std::endl;
+            return false;
+        }
+        const auto start = std::chrono::steady_clock::now();
+        if (options.model == "galaxies") {
+            Presets::loadGalaxyCollision(engine, count, options.seed);
+        } else {
+            config.count = count;
+            config.seed = options.seed;
+            engine.clearBodies();
+            engine.addModel(config);
+        }
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::printf("generated %zu bodies (%s) in %.2f ms\n", engine.bodies.size(), options.model.c_str(), ms);
+    } else if (options.bodies > 0) {
+        Presets::loadRandomCluster(engine, options.bodies, options.seed);
+    } else {
+        Presets::loadSolarSystem(engine);
+    }
+    return true;
+}
+
+bool addParticles(SimulationEngine& engine, const HeadlessOptions& options) {
+    if (options.ring == 0 && options.cloud == 0) return true;
+    const BodyStore& bodies = engine.bodies;
+    if (bodies.size() == 0) {
+        std::cerr << "No body for the test particles to orbit" << std::endl;
+        return false;
+    }
+    size_t centre = size_t(std::max_element(bodies.mass.begin(), bodies.mass.end()) - bodies.mass.begin());
+    if (options.ringBody >= 0) centre = size_t(options.ringBody);
+    if (centre >= bodies.size()) {
+        std::cerr << "No body " << options.ringBody << " to orbit, the scene has " << bodies.size() << std::endl;
+        return false;
+    }
+
+    const float radius = bodies.radius[centre];
+    const auto start = std::chrono::steady_clock::now();
+    engine.addRing(centre, options.ring, 1.5f * radius, 3.0f * radius, options.seed);
+    engine.addCloud(centre, options.cloud, 10.0f * radius, 30.0f * radius, options.seed + 1);
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::printf("generated %zu test particles about body %zu in %.2f ms\n", engine.particles.size(), centre, ms);
+    return true;
+}
+
+std::string checkpointPath(const std::string& pattern, uint64_t step) {
+    const size_t at = pattern.find('#');
+    if (at == std::string::npos) return pattern;
+    return pattern.substr(0, at) + std::to_string(step) + pattern.substr(at + 1);
+}
+
+int runSimulation(const HeadlessOptions& options) {
+    SimulationEngine engine(options.threads);
+    engine.deterministic = options.deterministic;
+    engine.reorderInterval = options.reorderInterval;
+    if (!loadInitialConditions(engine, options)) return 1;
+    if (!addParticles(engine, options)) return 1;
+    engine.externalField = options.potentials;
+    for (ExternalField::Potential& field : engine.externalField) field.startStep = engine.stepCount;
+    for (const ExternalField::Potential& field : engine.externalField) {
+        std::printf("external %s field: mass=%.3e speed=%.1f scale=%.1f at (%.1f, %.1f, %.1f)\n",
+                    ExternalField::profileName(field.profile), field.mass, field.speed, field.scale, field.centre.x,
+                    field.centre.y, field.centre.z);
+    }
+    const size_t initialParticles = engine.particles.size();
+    double particleMs = 0.0;
+
+    TrajectoryConfig trajectoryConfig;
+    trajectoryConfig.every = options.trajectoryEvery;
+    trajectoryConfig.backpressure = options.dropFrames ? TrajectoryConfig::Backpressure::Drop
+                                                       : TrajectoryConfig::Backpressure::Block;
+    trajectoryConfig.codec = options.compress ? Trajectory::QUANTIZED : Trajectory::RAW;
+    trajectoryConfig.positionTolerance = options.positionTolerance;
+    trajectoryConfig.velocityTolerance = options.velocityTolerance;
+    TrajectoryWriter trajectory(trajectoryConfig);
+    if (!options.trajectoryFile.empty() && !trajectory.open(options.trajectoryFile)) return 1;
+
+    EphemerisConfig ephemerisConfig;
+    ephemerisConfig.segmentSteps = options.segmentSteps;
+    ephemerisConfig.degree = options.degree;
+    ephemerisConfig.positionTolerance = options.ephemerisTolerance;
+    ephemerisConfig.velocityTolerance = options.ephemerisTolerance;
+    EphemerisWriter ephemeris(ephemerisConfig);
+    if (!options.ephemerisFile.empty() && !ephemeris.open(options.ephemerisFile)) return 1;
+
+    SnapshotConfig snapshotConfig;
+    snapshotConfig.maxInFlight = options.maxSnapshots;
+    snapshotConfig.background = !options.syncCheckpoints;
+    Snapshotter snapshots(snapshotConfig);
+    const bool checkpointing = !options.checkpointFile.empty() && options.checkpointEvery > 0;
+
+    HistoryConfig historyConfig;
+    historyConfig.keyframeInterval = options.keyframeInterval;
+    historyConfig.memoryBudget = options.historyMegabytes << 20;
+    History history(historyConfig);
+    const bool keepHistory = options.historyMegabytes > 0;
+
+    // Largest drift of the conserved quantities from those of the first
+    // step: relative for energy, absolute for the momenta, which often start at zero
+    engine.trackDiagnostics = options.diagnostics;
+    Diagnostics firstDiagnostics;
+    double energyDrift = 0.0, momentumDrift = 0.0, angularDrift = 0.0;
+    auto trackDrift = [&] {
+        const Diagnostics& d = engine.diagnostics;
+        if (!firstDiagnostics.valid) firstDiagnostics = d;
+        const Diagnostics& f = firstDiagnostics;
+        if (f.total() != 0.0) energyDrift = std::max(energyDrift, std::abs((d.total() - f.total()) / f.total()));
+        momentumDrift = std::max(momentumDrift, glm::length(d.momentum - f.momentum));
+        angularDrift = std::max(angularDrift, glm::length(d.angularMomentum - f.angularMomentum));
+    };
+
+    const double initialEnergy = engine.getTotalEnergy();
+    const auto start = std::chrono::steady_clock::now();
+    trajectory.capture(engine);
+    ephemeris.capture(engine);
+    if (keepHistory) history.record(engine);
+    for (uint64_t s = 0; s < options.steps; ++s) {
+        engine.step();
+        particleMs += engine.lastParticleMs;
+        if (options.diagnostics) trackDrift();
+        trajectory.capture(engine);
+        ephemeris.capture(engine);
+        if (keepHistory) history.record(engine);
+        if (checkpointing && engine.stepCount % options.checkpointEvery == 0) {
+            snapshots.save(engine, checkpointPath(options.checkpointFile, engine.stepCount));
+        } else if (checkpointing) {
+            snapshots.poll();
+        }
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    trajectory.close();
+    ephemeris.close();
+    snapshots.wait();
+    const double finalEnergy = engine.getTotalEnergy();
+
+    std::printf("bodies=%zu steps=%llu threads=%u mode=%s\n", engine.bodies.size(),
+                static_cast<unsigned long long>(engine.stepCount), engine.getThreadCount(),
+                engine.deterministic ? "deterministic" : "fast");
+    std::printf("time=%.3fs rate=%.1f steps/s\n", seconds, seconds > 0 ? options.steps / seconds : 0.0);
+    std::printf("energy initial=%.17g final=%.17g\n", initialEnergy, finalEnergy);
+    if (initialParticles > 0) {
+        std::printf("test particles=%zu (%zu absorbed) pass=%.3f ms/step\n", engine.particles.size(),
+                    initialParticles - engine.particles.size(), options.steps > 0 ? particleMs / options.steps : 0.0);
+    }
+    if (options.reorderInterval > 0) {
+        std::printf("morton reorders=%llu, disorder now %.3f\n", static_cast<unsigned long long>(engine.reorderCount),
+                    engine.bodyDisorder());
+    }
+    if (options.diagnostics && engine.diagnostics.valid) {
+        const Diagnostics& d = engine.diagnostics;
+        std::printf("diagnostics at step %llu: energy=%.17g momentum=%.6e angular momentum=%.6e\n",
+                    static_cast<unsigned long long>(d.step), d.total(), glm::length(d.momentum),
+                    glm::length(d.angularMomentum));
+        std::printf("max drift energy=%.3e (relative) momentum=%.3e angular momentum=%.3e\n", energyDrift, momentumDrift,
+                    angularDrift);
+    }
+    std::printf("state hash=%016llx\n", static_cast<unsigned long long>(engine.stateHash()));
+    if (!options.trajectoryFile.empty()) {
+        const TrajectoryWriter::Stats stats = trajectory.stats();
+        std::printf("trajectory frames=%llu written=%llu dropped=%llu chunks=%llu bytes=%llu\n",
+                    static_cast<unsigned long long>(stats.framesCaptured),
+                    static_cast<unsigned long long>(stats.framesWritten),
+                    static_cast<unsigned long long>(stats.framesDropped),
+                    static_cast<unsigned long long>(stats.chunksWritten),
+                    static_cast<unsigned long long>(stats.bytesWritten));
+        std::printf("trajectory writer busy=%.3fs (%.1f MB/s) step blocked=%.3fs\n", stats.writeSeconds,
+                    stats.writeSeconds > 0 ? stats.bytesWritten / stats.writeSeconds / 1e6 : 0.0,
+                    stats.blockedSeconds);
+        if (options.compress) {
+            std::printf("trajectory columns %.1f MB -> %.1f MB (%.1fx)\n", stats.columnBytesIn / 1e6,
+                        stats.columnBytesOut / 1e6,
+                        stats.columnBytesOut > 0 ? double(stats.columnBytesIn) / stats.columnBytesOut : 0.0);
+        }
+    }
+
+    if (!options.ephemerisFile.empty()) {
+        const EphemerisWriter::Stats stats = ephemeris.stats();
+        std::printf("ephemeris samples=%llu (%.1f MB) records=%llu bytes=%llu\n",
+                    static_cast<unsigned long long>(stats.samples), stats.samples * 6.0 * sizeof(float) / 1e6,
+                    static_cast<unsigned long long>(stats.records), static_cast<unsigned long long>(stats.bytesWritten));
+        std::printf("ephemeris fit error position=%.3g velocity=%.3g\n", stats.positionError, stats.velocityError);
+    }
+
+    if (keepHistory) {
+        const History::Stats stats = history.stats();
+        std::printf("history steps %llu to %llu, %llu segments (%llu evicted), keyframes %.1f MB, frames %.1f MB of %.1f MB\n",
+                    static_cast<unsigned long long>(history.firstStep()),
+                    static_cast<unsigned long long>(history.lastStep()),
+                    static_cast<unsigned long long>(stats.segments),
+                    static_cast<unsigned long long>(stats.evictedSegments), stats.keyframeBytes / 1e6,
+                    stats.frameBytes / 1e6, stats.rawFrameBytes / 1e6);
+        if (options.rewindStep >= 0) {
+            const auto rewindStart = std::chrono::steady_clock::now();
+            if (!history.restore(engine, uint64_t(options.rewindStep))) {
+                std::cerr << "Step " << options.rewindStep << " is not in the history" << std::endl;
+                return 1;
+            }
+            const double ms =
+                std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - rewindStart).count();
+            std::printf("rewound to step %llu in %.2f ms, state hash=%016llx\n",
+                        static_cast<unsigned long long>(engine.stepCount), ms,
+                        static_cast<unsigned long long>(engine.bodies.hash()));
+        }
+    }
+
+    if (checkpointing) {
+        const Snapshotter::Stats stats = snapshots.stats();
+        std::printf("checkpoints started=%llu completed=%llu failed=%llu skipped=%llu\n",
+                    static_cast<unsigned long long>(stats.started), static_cast<unsigned long long>(stats.completed),
+                    static_cast<unsigned long long>(stats.failed), static_cast<unsigned long long>(stats.skipped));
+        std::printf("checkpoint pause total=%.2f ms longest=%.2f ms, longest write=%.3fs\n",
+                    stats.pauseSeconds * 1e3, stats.longestPause * 1e3, stats.longestWrite);
+    }
+
+    if (!options.saveFile.empty() && !engine.saveState(options.saveFile)) return 1;
+    return 0;
+}
+
+// Replays a recorded session from its start state: steps to every logged
+// edit and rewind and applies it at the same tick boundary, then compares
+// the final state with the one the session ended with
+int runJournal(const HeadlessOptions& options) {
+    JournalReader journal;
+    if (!journal.open(options.journalFile)) return 1;
+    const JournalHeader& header = journal.header();
+
+    SimulationEngine engine(options.threads ? options.threads : header.threads);
+    if (!engine.loadState(journal.startPath())) return 1;
+    if (engine.stepCount != header.startStep) {
+        std::cerr << journal.startPath() << " is at step " << engine.stepCount << ", the journal starts at step "
+                  << header.startStep << std::endl;
+        return 1;
+    }
+    if (!header.deterministic && engine.getThreadCount() != header.threads) {
+        std::cerr << "Recorded in fast mode on " << header.threads << " threads, replaying on "
+                  << engine.getThreadCount() << ": the state may drift in the last bits" << std::endl;
+    }
+
+    // Rewinds go through a history cut exactly like the viewer's
+    HistoryConfig historyConfig;
+    historyConfig.memoryBudget = size_t(-1);
+    History history(historyConfig);
+    history.record(engine);
+
+    std::vector<double> stepMs;
+    std::vector<SimulationCommand> batch;
+    uint64_t commands = 0, rewinds = 0, inputs = 0;
+    const JournalEntry* end = nullptr;
+
+    const auto start = std::chrono::steady_clock::now();
+    auto stepTo = [&](uint64_t step) {
+        while (engine.stepCount < step) {
+            const auto before = std::chrono::steady_clock::now();
+            engine.step();
+            stepMs.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - before).count());
+            history.record(engine);
+        }
+    };
+    auto applyBatch = [&] {
+        if (batch.empty()) return;
+        engine.applyCommands(batch.data(), batch.size());
+        history.markEdited();
+        history.record(engine);
+        commands += batch.size();
+        batch.clear();
+    };
+
+    for (const JournalEntry& entry : journal.entries()) {
+        const Journal::Kind kind = Journal::Kind(entry.kind);
+        if (kind != Journal::Kind::Command && kind != Journal::Kind::End && kind != Journal::Kind::Rewind) {
+            ++inputs;   // Camera only
+            continue;
+        }
+        // Commands the physics thread drained together are applied together
+        if (kind != Journal::Kind::Command || entry.code == 0) applyBatch();
+        stepTo(entry.step);
+
+        if (kind == Journal::Kind::Command) {
+            batch.push_back(JournalReader::toCommand(entry));
+        } else if (kind == Journal::Kind::Rewind) {
+            if (!history.restore(engine, entry.bodyId)) {
+                std::cerr << "Cannot rewind to step " << entry.bodyId << " at step " << entry.step << std::endl;
+                return 1;
+            }
+            ++rewinds;
+        } else {
+            end = &entry;
+            break;
+        }
+    }
+    applyBatch();
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::printf("replayed %s: %llu steps, %llu edits, %llu rewinds, %llu input events\n", options.journalFile.c_str(),
+                static_cast<unsigned long long>(stepMs.size()), static_cast<unsigned long long>(commands),
+                static_cast<unsigned long long>(rewinds), static_cast<unsigned long long>(inputs));
+    std::printf("bodies=%zu step=%llu threads=%u mode=%s time=%.3fs\n", engine.bodies.size(),
+                static_cast<unsigned long long>(engine.stepCount), engine.getThreadCount(),
+                engine.deterministic ? "deterministic" : "fast", seconds);
+    if (!stepMs.empty()) {
+        double total = 0.0;
+        for (double ms : stepMs) total += ms;
+        std::sort(stepMs.begin(), stepMs.end());
+        std::printf("step time mean=%.3f ms p50=%.3f ms p99=%.3f ms max=%.3f ms\n", total / stepMs.size(),
+                    stepMs[stepMs.size() / 2], stepMs[std::min(stepMs.size() - 1, stepMs.size() * 99 / 100)],
+                    stepMs.back());
+    }
+
+    const uint64_t hash = engine.stateHash();
+    std::printf("state hash=%016llx\n", static_cast<unsigned long long>(hash));
+    if (!end) {
+        std::printf("journal has no end record, the session did not finish\n");
+        return 0;
+    }
+    if (end->bodyId != hash) {
+        std::printf("replay diverged: the session ended with hash %016llx\n", static_cast<unsigned long long>(end->bodyId));
+        return 1;
+    }
+    std::printf("replay reproduced the session exactly\n");
+    return 0;
+}
+
+// Prints the state of every body alive at --at as CSV
+int runLookup(const HeadlessOptions& options) {
+    EphemerisReader ephemeris;
+    if (!ephemeris.open(options.lookupFile)) return 1;
+
+    std::vector<uint32_t> alive;
+    ephemeris.bodiesAt(options.lookupStep, alive);
+    std::printf("id,x,y,z,vx,vy,vz\n");
+    for (uint32_t i : alive) {
+        glm::dvec3 position, velocity;
+        ephemeris.state(i, options.lookupStep, position, velocity);
+        std::printf("%llu,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g\n", static_cast<unsigned long long>(ephemeris.body(i).id),
+                    position.x, position.y, position.z, velocity.x, velocity.y, velocity.z);
+    }
+    if (alive.empty()) {
+        std::cerr << "No body in " << options.lookupFile << " at step " << options.lookupStep << " (covers "
+                  << ephemeris.firstStep() << " to " << ephemeris.lastStep() << ")" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int runBenchmark(HeadlessOptions options) {
+    if (options.bodies == 0) options.bodies = 2048;
+    if (!options.stepsGiven) options.steps = 20;
+
+    SimulationEngine probe(options.threads);
+    const unsigned maxThreads = probe.getThreadCount();
+
+    std::printf("%-14s %8s %12s  %-16s  %s\n", "mode", "threads", "steps/s", "state hash", "energy");
+    double rate[2][2] = {};
+    for (int det = 0; det < 2; ++det) {
+        const unsigned threadCounts[2] = {1, maxThreads};
+        for (int t = 0; t < 2; ++t) {
+            SimulationEngine engine(threadCounts[t]);
+            engine.deterministic = det != 0;
+            if (!loadInitialConditions(engine, options)) return 1;
+            engine.deterministic = det != 0;
+
+            const auto start = std::chrono::steady_clock::now();
+            for (uint64_t s = 0; s < options.steps; ++s) engine.step();
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            const double energy = engine.getTotalEnergy();
+
+            rate[det][t] = options.steps / seconds;
+            std::printf("%-14s %8u %12.2f  %016llx  %.17g\n", det ? "deterministic" : "fast", threadCounts[t],
+                        rate[det][t], static_cast<unsigned long long>(engine.bodies.hash()), energy);
+        }
+    }
+    std::printf("deterministic mode costs %.1f%% throughput at %u thread(s)\n",
+                100.0 * (1.0 - rate[1][1] / rate[0][1]), maxThreads);
+    return 0;
+}
+
+// Counts heap allocations over steady-state steps of every force pass, with
+// and without diagnostics, after a few warm-up steps have grown the scratch
+// buffers. The steps themselves must not allocate; a rewind history
+// recording the same steps is reported alongside, since each of its
+// segments stores its compressed frames on the heap.
+int runAllocationCheck(HeadlessOptions options) {
+    if (options.bodies == 0) options.bodies = 1024;
+    if (!options.stepsGiven) options.steps = 200;
+    constexpr uint64_t WARMUP_STEPS = 4;
+
+    std::printf("%-14s %-12s %14s %20s\n", "mode", "diagnostics", "allocs/step", "with history/step");
+    bool clean = true;
+    size_t bodies = 0;
+    unsigned threads = 0;
+    for (int det = 0; det < 2; ++det) {
+        for (int diag = 0; diag < 2; ++diag) {
+            SimulationEngine engine(options.threads);
+            if (!loadInitialConditions(engine, options)) return 1;
+            engine.deterministic = det != 0;
+            engine.trackDiagnostics = diag != 0;
+            bodies = engine.bodies.size();
+            threads = engine.getThreadCount();
+            for (uint64_t s = 0; s < WARMUP_STEPS; ++s) engine.step();
+
+            const uint64_t before = AllocationCounter::count();
+            for (uint64_t s = 0; s < options.steps; ++s) engine.step();
+            const uint64_t stepAllocations = AllocationCounter::count() - before;
+
+            HistoryConfig historyConfig;
+            historyConfig.keyframeInterval = options.keyframeInterval;
+            if (options.historyMegabytes > 0) historyConfig.memoryBudget = options.historyMegabytes << 20;
+            History history(historyConfig);
+            history.record(engine);
+            const uint64_t historyBefore = AllocationCounter::count();
+            for (uint64_t s = 0; s < options.steps; ++s) {
+                engine.step();
+                history.record(engine);
+            }
+            const uint64_t historyAllocations = AllocationCounter::count() - historyBefore;
+
+            std::printf("%-14s %-12s %14.2f %20.2f\n", det ? "deterministic" : "fast", diag ? "on" : "off",
+                        double(stepAllocations) / options.steps, double(historyAllocations) / options.steps);
+            clean = clean && stepAllocations == 0;
+        }
+    }
+    std::printf("bodies=%zu threads=%u steps=%llu: %s\n", bodies, threads, static_cast<unsigned long long>(options.steps),
+                clean ? "steady-state steps make no heap allocations" : "steady-state steps allocate");
+    return clean ? 0 : 1;
+}
+
+// Times the passes that visit the bodies in index order, the Barnes-Hut
+// walk of the distributed backend and a neighbour query per body, on the
+// bodies as loaded and again after a Morton reorder. Both orders do the
+// same work, which the interaction and neighbour totals confirm.
+int runLocality(HeadlessOptions options) {
+    if (options.bodies == 0) options.bodies = 100000;
+    constexpr int REPEATS = 3;
+
+    SimulationEngine engine(options.threads);
+    if (!loadInitialConditions(engine, options)) return 1;
+    const BodyStore& b = engine.bodies;
+    const size_t n = b.size();
+    if (n < 2) {
+        std::cerr << "Nothing to reorder" << std::endl;
+        return 1;
+    }
+    ThreadPool pool(options.threads);
+
+    // Neighbour radius: about 8 bodies at the mean density of the bounding box
+    glm::vec3 lo = b.position(0), hi = b.position(0);
+    for (size_t i = 1; i < n; ++i) {
+        lo = glm::min(lo, b.position(i));
+        hi = glm::max(hi, b.position(i));
+    }
+    const glm::vec3 extent = glm::max(hi - lo, glm::vec3(1e-6f));
+    const float queryRadius = std::cbrt(8.0f * extent.x * extent.y * extent.z / float(n) / 4.18879f);
+
+    std::vector<TreeParticle> particles(n);
+    std::vector<uint64_t> workerCounts(pool.size());
+    std::vector<std::vector<uint32_t>> found(pool.size());
+    Octree tree;
+    SpatialIndex index;
+
+    struct Timing {
+        double build = 1e300, walk = 1e300, neighbours = 1e300;
+        uint64_t interactions = 0, neighbourCount = 0;
+    };
+    auto milliseconds = [](std::chrono::steady_clock::time_point since) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+    };
+    auto measure = [&] {
+        Timing t;
+        for (int r = 0; r < REPEATS; ++r) {
+            for (size_t i = 0; i < n; ++i) particles[i] = TreeParticle{b.px[i], b.py[i], b.pz[i], b.mass[i], b.radius[i]};
+            auto start = std::chrono::steady_clock::now();
+            tree.build(particles);
+            t.build = std::min(t.build, milliseconds(start));
+
+            std::fill(workerCounts.begin(), workerCounts.end(), 0);
+            start = std::chrono::steady_clock::now();
+            pool.parallelFor(n, [&](size_t begin, size_t end, unsigned worker) {
+                for (size_t i = begin; i < end; ++i) {
+                    workerCounts[worker] +=
+                        tree.evaluate(b.position(i), b.radius[i], options.theta, engine.gravitationalConstant).interactions;
+                }
+            });
+            t.walk = std::min(t.walk, milliseconds(start));
+            t.interactions = 0;
+            for (uint64_t c : workerCounts) t.interactions += c;
+
+            std::fill(workerCounts.begin(), workerCounts.end(), 0);
+            start = std::chrono::steady_clock::now();
+            index.build(b.px.data(), b.py.data(), b.pz.data(), b.radius.data(), n);
+            pool.parallelFor(n, [&](size_t begin, size_t end, unsigned worker) {
+                for (size_t i = begin; i < end; ++i) {
+                    found[worker].clear();
+                    index.radius(b.position(i), queryRadius, found[worker]);
+                    workerCounts[worker] += found[worker].size();
+                }
+            });
+            t.neighbours = std::min(t.neighbours, milliseconds(start));
+            t.neighbourCount = 0;
+            for (uint64_t c : workerCounts) t.neighbourCount += c;
+        }
+        return t;
+    };
+
+    const double disorderBefore = engine.bodyDisorder();
+    const Timing before = measure();
+    const auto reorderStart = std::chrono::steady_clock::now();
+    engine.reorderBodies();
+    const double reorderMs = milliseconds(reorderStart);
+    const double disorderAfter = engine.bodyDisorder();
+    const Timing after = measure();
+
+    std::printf("bodies=%zu threads=%u theta=%.2f disorder %.3f -> %.3f, reorder took %.2f ms\n", n, pool.size(),
+                options.theta, disorderBefore, disorderAfter, reorderMs);
+    std::printf("%-18s %12s %12s %9s\n", "pass", "as loaded", "morton", "speedup");
+    const char* names[3] = {"tree build", "tree walk", "neighbour queries"};
+    const double times[3][2] = {{before.build, after.build}, {before.walk, after.walk},
+                                {before.neighbours, after.neighbours}};
+    for (int p = 0; p < 3; ++p) {
+        std::printf("%-18s %9.2f ms %9.2f ms %8.2fx\n", names[p], times[p][0], times[p][1],
+                    times[p][1] > 0.0 ? times[p][0] / times[p][1] : 0.0);
+    }
+    std::printf("interactions %llu / %llu, neighbours %llu / %llu\n",
+                static_cast<unsigned long long>(before.interactions), static_cast<unsigned long long>(after.interactions),
+                static_cast<unsigned long long>(before.neighbourCount),
+                static_cast<unsigned long long>(after.neighbourCount));
+    return 0;
+}
+
+int runEnsemble(const HeadlessOptions& options) {
+    SimulationEngine scene(1);
+    if (!loadInitialConditions(scene, options)) return 1;
+
+    EnsembleConfig config;
+    config.instances = options.ensemble;
+    config.steps = options.steps;
+    config.seed = options.seed;
+    config.massJitter = options.massJitter;
+    config.velocityJitter = options.velocityJitter;
+    config.escapeRadius = options.escapeRadius;
+    config.threads = options.threads;
+    config.stopOnEscape = options.stopOnEscape;
+    config.useLanes = options.useLanes;
+
+    EnsembleRunner runner(scene.bodies, config);
+    const auto start = std::chrono::steady_clock::now();
+    const std::vector<EnsembleOutcome> outcomes = runner.run();
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::printf("ensemble instances=%zu bodies=%zu steps=%llu time=%.3fs (%.1f instance-steps/s)\n",
+                outcomes.size(), scene.bodies.size(), static_cast<unsigned long long>(options.steps), seconds,
+                seconds > 0 ? outcomes.size() * options.steps / seconds : 0.0);
+    EnsembleRunner::printStatistics(outcomes);
+
+    if (!options.output.empty() && !EnsembleRunner::writeStatistics(options.output, outcomes)) {
+        return 1;
+    }
+    return 0;
+}
+
+#ifdef GRAVITAS_WITH_MPI
+int runDistributed(const HeadlessOptions& options) {
+    MPI_Init(nullptr, nullptr);
+    {
+        DistributedConfig config;
+        config.theta = options.theta;
+        config.rebalanceInterval = options.rebalanceInterval;
+        config.threads = options.threads ? options.threads : 1;
+        DistributedSimulation sim(MPI_COMM_WORLD, config);
+        sim.engine.reorderInterval = options.reorderInterval;
+
+        // Initial conditions are built on rank 0 and spread from there
+        SimulationEngine scene(1);
+        if (sim.rank() == 0 && !loadInitialConditions(scene, options)) MPI_Abort(MPI_COMM_WORLD, 1);
+        sim.scatter(scene.bodies);
+
+        const double initialEnergy = sim.getTotalEnergy();
+        MPI_Barrier(MPI_COMM_WORLD);
+        const auto start = std::chrono::steady_clock::now();
+        for (uint64_t s = 0; s < options.steps; ++s) {
+            sim.step();
+        }
+        MPI_Barrier(MPI_COMM_WORLD);
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        const double finalEnergy = sim.getTotalEnergy();
+
+        const int localBodies = int(sim.engine.bodies.size());
+        std::vector<int> perRank(sim.ranks());
+        MPI_Gather(&localBodies, 1, MPI_INT, perRank.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+        unsigned long long migrated = sim.migrated, totalMigrated = 0;
+        MPI_Reduce(&migrated, &totalMigrated, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+        sim.gather(scene.bodies);
+
+        if (sim.rank() == 0) {
+            std::printf("bodies=%zu steps=%llu ranks=%d theta=%.2f\n", scene.bodies.size(),
+                        static_cast<unsigned long long>(sim.stepCount), sim.ranks(), options.theta);
+            std::printf("time=%.3fs rate=%.1f steps/s\n", seconds, seconds > 0 ? options.steps / seconds : 0.0);
+            std::printf("load imbalance=%.3f rebalances=%llu migrated=%llu bodies per rank:", sim.lastImbalance,
+                        static_cast<unsigned long long>(sim.rebalances), totalMigrated);
+            for (int count : perRank) std::printf(" %d", count);
+            std::printf("\n");
+            std::printf("energy initial=%.17g final=%.17g\n", initialEnergy, finalEnergy);
+            std::printf("state hash=%016llx\n", static_cast<unsigned long long>(scene.bodies.hash()));
+        }
+    }
+    MPI_Finalize();
+    return 0;
+}
+#endif
+
+} // namespace
+
+int runHeadless(int argc, char** argv) {
+    HeadlessOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage();
+        return 1;
+    }
+    // The lane kernel and the distributed tree walk have no external field
+    if (!options.potentials.empty() && (options.ensemble > 0 || options.mpi)) {
+        std::cerr << "--potential is not supported with " << (options.mpi ? "--mpi" : "--ensemble") << std::endl;
+        return 1;
+    }
+    if (options.mpi) {
+#ifdef GRAVITAS_WITH_MPI
+        return runDistributed(options);
+#else
+        std::cerr << "This build has no MPI support, configure with -DGRAVITAS_WITH_MPI=ON" << std::endl;
+        return 1;
+#endif
+    }
+    if (!options.lookupFile.empty()) return runLookup(options);
+    if (!options.journalFile.empty()) return runJournal(options);
+    if (options.ensemble > 0) return runEnsemble(options);
+    if (options.checkAllocs) return runAllocationCheck(options);
+    if (options.locality) return runLocality(options);
+    return options.bench ? runBenchmark(options) : runSimulation(options);
+}
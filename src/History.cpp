@@ -0,0 +1,235 @@
+#include "History.h"
+#include "Codec.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace {
+    // Keyframe columns per body, in bytes
+    constexpr size_t KEYFRAME_BODY_BYTES = 12 * sizeof(float) + sizeof(glm::vec4) + sizeof(uint8_t) + sizeof(uint64_t);
+    constexpr size_t KEYFRAME_PARTICLE_BYTES = 6 * sizeof(float);
+}
+
+History::History(const HistoryConfig& config) : config(config) {
+    if (this->config.keyframeInterval == 0) this->config.keyframeInterval = 1;
+}
+
+void History::clear() {
+    segments.clear();
+    decodedSegment = nullptr;
+    edited = false;
+}
+
+uint64_t History::firstStep() const {
+    return segments.empty() ? 0 : segments.front().firstStep;
+}
+
+uint64_t History::lastStep() const {
+    return segments.empty() ? 0 : segments.back().lastStep();
+}
+
+void History::record(const SimulationEngine& engine) {
+    const uint64_t step = engine.stepCount;
+    if (!segments.empty() && step <= lastStep()) dropFrom(step);    // Loaded or rewound behind the history
+
+    const bool continues = !segments.empty() && !edited && !segments.back().sealed() &&
+                           step == lastStep() + 1 && segments.back().frames < config.keyframeInterval &&
+                           segments.back().keyframe.topologyVersion == engine.bodies.topologyVersion;
+    if (!continues) startSegment(engine);
+
+    Segment& segment = segments.back();
+    const BodyStore& b = engine.bodies;
+    const Column<float>* columns[COLUMNS] = {&b.px, &b.py, &b.pz, &b.vx, &b.vy, &b.vz};
+    for (size_t c = 0; c < COLUMNS; ++c) {
+        segment.raw[c].insert(segment.raw[c].end(), columns[c]->begin(), columns[c]->end());
+    }
+    ++segment.frames;
+    enforceBudget();
+}
+
+void History::startSegment(const SimulationEngine& engine) {
+    if (!segments.empty() && !segments.back().sealed()) seal(segments.back());
+    edited = false;
+
+    segments.emplace_back();
+    Segment& segment = segments.back();
+    segment.firstStep = engine.stepCount;
+    segment.keyframe = std::move(spareKeyframe);
+    segment.keyframe = engine.bodies;     // Into the spare's columns, when there was one
+    segment.particles = engine.particles;
+    segment.deterministic = engine.deterministic;
+    segment.enableCollisions = engine.enableCollisions;
+    segment.timeScale = engine.timeScale;
+    segment.gravitationalConstant = engine.gravitationalConstant;
+    segment.keyframeBytes = engine.bodies.size() * KEYFRAME_BODY_BYTES +
+                            engine.particles.size() * KEYFRAME_PARTICLE_BYTES;
+
+    // Room for every frame up front, so record() never grows them mid-segment
+    const size_t frameFloats = std::min(size_t(config.keyframeInterval) * engine.bodies.size(),
+                                        config.memoryBudget / (COLUMNS * sizeof(float)));
+    for (size_t c = 0; c < COLUMNS; ++c) {
+        segment.raw[c].swap(spareFrames[c]);
+        segment.raw[c].clear();
+        segment.raw[c].reserve(frameFloats);
+    }
+}
+
+// Compresses the frames of a finished segment; the raw ones go to the next
+void History::seal(Segment& segment) {
+    const size_t bodies = segment.keyframe.size();
+    segment.encodedFrames = segment.frames;
+    if (bodies == 0 || segment.frames == 0) {
+        segment.encoded.assign(1, 0);   // Marks it sealed; there is nothing to decode
+    } else {
+        // Encoded into reused buffers, then copied out once at its final size
+        sealBuffer.clear();
+        for (size_t c = 0; c < COLUMNS; ++c) {
+            sealStream.clear();
+            const double tolerance = c < 3 ? config.positionTolerance : config.velocityTolerance;
+            Codec::encodeColumn(segment.raw[c].data(), size_t(segment.frames), bodies, tolerance, sealStream);
+            const uint64_t bytes = sealStream.size();
+            const size_t at = sealBuffer.size();
+            sealBuffer.resize(at + sizeof(bytes) + sealStream.size());
+            std::memcpy(sealBuffer.data() + at, &bytes, sizeof(bytes));
+            std::memcpy(sealBuffer.data() + at + sizeof(bytes), sealStream.data(), sealStream.size());
+        }
+        segment.encoded.assign(sealBuffer.begin(), sealBuffer.end());
+    }
+    for (size_t c = 0; c < COLUMNS; ++c) {
+        if (segment.raw[c].capacity() > spareFrames[c].capacity()) segment.raw[c].swap(spareFrames[c]);
+        std::vector<float>().swap(segment.raw[c]);
+    }
+}
+
+// Keeps a dropped segment's storage for the next one
+void History::retire(Segment& segment) {
+    if (segment.keyframe.size() > spareKeyframe.size()) spareKeyframe = std::move(segment.keyframe);
+    for (size_t c = 0; c < COLUMNS; ++c) {
+        if (segment.raw[c].capacity() > spareFrames[c].capacity()) segment.raw[c].swap(spareFrames[c]);
+    }
+}
+
+const std::vector<float>* History::framesOf(const Segment& segment) {
+    if (!segment.sealed()) return segment.raw;
+    if (decodedSegment == &segment) return decoded;
+
+    const size_t bodies = segment.keyframe.size();
+    const size_t frames = size_t(segment.encodedFrames);
+    const uint8_t* data = segment.encoded.data();
+    size_t remaining = segment.encoded.size();
+    for (size_t c = 0; c < COLUMNS; ++c) {
+        decoded[c].resize(frames * bodies);
+        if (bodies == 0 || frames == 0) continue;
+        uint64_t bytes = 0;
+        if (remaining >= sizeof(bytes)) std::memcpy(&bytes, data, sizeof(bytes));
+        if (remaining < sizeof(bytes) + bytes ||
+            !Codec::decodeColumn(data + sizeof(bytes), size_t(bytes), frames, bodies, decoded[c].data())) {
+            std::cerr << "History segment at step " << segment.firstStep << " is corrupt" << std::endl;
+            decodedSegment = nullptr;
+            return nullptr;
+        }
+        data += sizeof(bytes) + bytes;
+        remaining -= sizeof(bytes) + bytes;
+    }
+    decodedSegment = &segment;
+    return decoded;
+}
+
+// The latest segment holding step: after an edit two segments can share one
+History::Segment* History::segmentFor(uint64_t step) {
+    for (auto it = segments.rbegin(); it != segments.rend(); ++it) {
+        if (step >= it->firstStep && step <= it->lastStep()) return &*it;
+    }
+    return nullptr;
+}
+
+bool History::view(uint64_t step, BodyStore& out) {
+    const Segment* segment = segmentFor(step);
+    if (!segment) return false;
+    const std::vector<float>* frames = framesOf(*segment);
+    if (!frames) return false;
+
+    out = segment->keyframe;
+    const size_t n = out.size();
+    const size_t offset = size_t(step - segment->firstStep) * n;
+    Column<float>* columns[COLUMNS] = {&out.px, &out.py, &out.pz, &out.vx, &out.vy, &out.vz};
+    for (size_t c = 0; c < COLUMNS; ++c) {
+        columns[c]->assign(frames[c].data() + offset, frames[c].data() + offset + n);
+    }
+    return true;
+}
+
+bool History::restore(SimulationEngine& engine, uint64_t step) {
+    Segment* segment = segmentFor(step);
+    if (!segment) return false;
+
+    // A new topology version, so whoever mirrors the bodies rebuilds
+    const uint64_t topology = engine.bodies.topologyVersion + 1;
+    engine.bodies = segment->keyframe;
+    engine.bodies.topologyVersion = topology;
+    segment->keyframe.topologyVersion = topology;
+    const uint64_t particleVersion = engine.particles.version + 1;
+    engine.particles = segment->particles;
+    engine.particles.version = particleVersion;
+    engine.deterministic = segment->deterministic;
+    engine.enableCollisions = segment->enableCollisions;
+    engine.timeScale = segment->timeScale;
+    engine.gravitationalConstant = segment->gravitationalConstant;
+    engine.stepCount = segment->firstStep;
+
+    while (engine.stepCount < step) engine.step();
+    dropFrom(step + 1);
+    return true;
+}
+
+// Forgets every frame from step on
+void History::dropFrom(uint64_t step) {
+    decodedSegment = nullptr;
+    while (!segments.empty() && segments.back().firstStep >= step) {
+        retire(segments.back());
+        segments.pop_back();
+    }
+    if (segments.empty() || segments.back().lastStep() < step) return;
+
+    // Sealed frames stay encoded and are only hidden, so that lossy frames
+    // are never quantized twice; the segment then takes no more frames
+    Segment& segment = segments.back();
+    segment.frames = step - segment.firstStep;
+    if (!segment.sealed()) {
+        const size_t n = segment.keyframe.size();
+        for (auto& column : segment.raw) column.resize(size_t(segment.frames) * n);
+    }
+}
+
+size_t History::segmentBytes(const Segment& segment) const {
+    size_t bytes = segment.keyframeBytes + segment.encoded.size();
+    for (const auto& column : segment.raw) bytes += column.size() * sizeof(float);
+    return bytes;
+}
+
+// Drops the oldest segments, but never the one being written
+void History::enforceBudget() {
+    size_t total = 0;
+    for (const Segment& segment : segments) total += segmentBytes(segment);
+    while (total > config.memoryBudget && segments.size() > 1) {
+        total -= segmentBytes(segments.front());
+        if (decodedSegment == &segments.front()) decodedSegment = nullptr;
+        retire(segments.front());
+        segments.pop_front();
+        ++evicted;
+    }
+}
+
+History::Stats History::stats() const {
+    Stats stats;
+    stats.segments = segments.size();
+    stats.evictedSegments = evicted;
+    for (const Segment& segment : segments) {
+        const size_t n = segment.keyframe.size();
+        stats.frames += segment.frames;
+        stats.keyframeBytes += segment.keyframeBytes;
+        stats.frameBytes += segmentBytes(segment) - segment.keyframeBytes;
+        stats.rawFrameBytes += size_t(segment.frames) * n * COLUMNS * sizeof(float);
+    }
+    return stats;
+}
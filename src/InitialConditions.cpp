@@ -0,0 +1,481 @@
+#include "InitialConditions.h"
+#include "Random.h"
+#include "SimulationEngine.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Models are built in units with G = 1 and the scale radius 1, then scaled
+// to the config's mass and radius. Spherical ones go through a table of
+// enclosed mass, relative potential psi (positive, falling outwards) and
+// distribution function at log-spaced radii. A body takes its radius by
+// inverting the enclosed mass and its speed by rejection from
+// v^2 f(psi - v^2 / 2), against a bound tabulated per radius.
+
+namespace {
+    constexpr double PI = 3.14159265358979323846;
+    constexpr size_t TABLE_SIZE = 2048;
+    constexpr double TABLE_MIN = 1e-4;      // Innermost radius, in scale radii
+    constexpr int ENVELOPE_SAMPLES = 64;    // Speeds probed per radius for the rejection bound
+
+    struct SphericalTable {
+        std::vector<double> r, mass, psi;
+        std::vector<double> energy, df;     // f(E) at ascending E
+        std::vector<double> envelope;       // Bound on v^2 f per radius
+        double totalMass = 0.0;
+    };
+
+    std::vector<double> logRadii(double rmax) {
+        std::vector<double> r(TABLE_SIZE);
+        const double step = std::log(rmax / TABLE_MIN) / double(TABLE_SIZE - 1);
+        for (size_t k = 0; k < TABLE_SIZE; ++k) r[k] = TABLE_MIN * std::exp(step * double(k));
+        return r;
+    }
+
+    // Linear interpolation in an ascending table
+    double interpolate(const std::vector<double>& x, const std::vector<double>& y, double at) {
+        if (at <= x.front()) return y.front();
+        if (at >= x.back()) return y.back();
+        const size_t k = size_t(std::upper_bound(x.begin(), x.end(), at) - x.begin());
+        const double t = (at - x[k - 1]) / (x[k] - x[k - 1]);
+        return y[k - 1] + t * (y[k] - y[k - 1]);
+    }
+
+    double distribution(const SphericalTable& t, double e) {
+        return e <= 0.0 ? 0.0 : interpolate(t.energy, t.df, e);
+    }
+
+    // Largest v^2 f(psi - v^2 / 2) on a grid of speeds, with room for what falls between
+    void fillEnvelope(SphericalTable& t) {
+        t.envelope.resize(t.r.size());
+        for (size_t k = 0; k < t.r.size(); ++k) {
+            const double escape = std::sqrt(2.0 * std::max(t.psi[k], 0.0));
+            double largest = 0.0;
+            for (int s = 1; s <= ENVELOPE_SAMPLES; ++s) {
+                const double v = escape * s / (ENVELOPE_SAMPLES + 1);
+                largest = std::max(largest, v * v * distribution(t, t.psi[k] - 0.5 * v * v));
+            }
+            t.envelope[k] = 1.25 * largest;
+        }
+    }
+
+    // f(E) = 1 / (sqrt(8) pi^2) d/dE of the integral of (drho/dpsi) / sqrt(E - psi)
+    // over psi < E, taken over the radii outside psi = E. On each table interval
+    // psi is linear in r, so the inverse square root integrates exactly,
+    // singular end included. The constant factor does not matter for sampling.
+    void eddington(SphericalTable& t, const std::vector<double>& rho) {
+        const size_t n = t.r.size();
+        std::vector<double> falloff(n);     // -drho/dr
+        for (size_t k = 0; k < n; ++k) {
+            const size_t lo = k == 0 ? 0 : k - 1, hi = k + 1 == n ? k : k + 1;
+            falloff[k] = -(rho[hi] - rho[lo]) / (t.r[hi] - t.r[lo]);
+        }
+
+        std::vector<double> integral(n, 0.0);
+        for (size_t j = 0; j < n; ++j) {
+            const double e = t.psi[j];
+            double sum = 0.0;
+            for (size_t i = j; i + 1 < n; ++i) {
+                const double h = t.r[i + 1] - t.r[i];
+                const double slope = (t.psi[i] - t.psi[i + 1]) / h;
+                if (slope <= 0.0) continue;
+                const double a = std::max(e - t.psi[i], 0.0);
+                sum += 0.5 * (falloff[i] + falloff[i + 1]) * 2.0 * (std::sqrt(a + slope * h) - std::sqrt(a)) / slope;
+            }
+            integral[j] = sum;
+        }
+
+        // Ascending energy is descending radius
+        t.energy.resize(n);
+        t.df.resize(n);
+        for (size_t j = 0; j < n; ++j) {
+            const size_t lo = j == 0 ? 0 : j - 1, hi = j + 1 == n ? j : j + 1;
+            const double f = (integral[lo] - integral[hi]) / (t.psi[lo] - t.psi[hi]);
+            t.energy[n - 1 - j] = t.psi[j];
+            t.df[n - 1 - j] = std::max(f, 0.0);
+        }
+        fillEnvelope(t);
+    }
+
+    // Enclosed mass and potential of rho out to rmax, then its distribution function
+    template <typename Density>
+    SphericalTable tabulate(Density density, double rmax) {
+        SphericalTable t;
+        t.r = logRadii(rmax);
+        const size_t n = t.r.size();
+        const double step = std::log(t.r[1] / t.r[0]);
+
+        std::vector<double> rho(n), shell(n), outer(n);
+        for (size_t k = 0; k < n; ++k) {
+            rho[k] = density(t.r[k]);
+            shell[k] = 4.0 * PI * t.r[k] * t.r[k] * t.r[k] * rho[k];    // dM / dln r
+            outer[k] = 4.0 * PI * t.r[k] * t.r[k] * rho[k];             // d(4 pi int rho r dr) / dln r
+        }
+
+        // A uniform core inside the first radius, then trapezoids in ln r
+        t.mass.resize(n);
+        t.mass[0] = shell[0] / 3.0;
+        for (size_t k = 1; k < n; ++k) t.mass[k] = t.mass[k - 1] + 0.5 * step * (shell[k - 1] + shell[k]);
+        t.totalMass = t.mass.back();
+
+        // psi(r) = M(r) / r + 4 pi * integral of rho r' dr' from r out
+        t.psi.resize(n);
+        double beyond = 0.0;
+        for (size_t k = n; k-- > 0;) {
+            if (k + 1 < n) beyond += 0.5 * step * (outer[k] + outer[k + 1]);
+            t.psi[k] = t.mass[k] / t.r[k] + beyond;
+        }
+        eddington(t, rho);
+        return t;
+    }
+
+    SphericalTable plummer() {
+        return tabulate([](double r) { return 3.0 / (4.0 * PI) * std::pow(1.0 + r * r, -2.5); }, 200.0);
+    }
+
+    SphericalTable hernquist() {
+        return tabulate([](double r) { return 1.0 / (2.0 * PI * r * std::pow(1.0 + r, 3.0)); }, 2000.0);
+    }
+
+    // Beyond the virial radius c the profile falls off over 0.1 c with a
+    // power chosen to keep its logarithmic slope continuous (Kazantzidis et
+    // al. 2004), so the mass is finite and the distribution function positive
+    SphericalTable nfw(double c) {
+        const double decay = 0.1 * c;
+        const double edge = 1.0 / (c * (1.0 + c) * (1.0 + c));
+        const double power = -(1.0 + 3.0 * c) / (1.0 + c) + c / decay;
+        return tabulate(
+            [=](double r) {
+                if (r <= c) return 1.0 / (r * (1.0 + r) * (1.0 + r));
+                return edge * std::pow(r / c, power) * std::exp(-(r - c) / decay);
+            },
+            c + 40.0 * decay);
+    }
+
+    double kingDensity(double w) {
+        if (w <= 0.0) return 0.0;
+        return std::exp(w) * std::erf(std::sqrt(w)) - std::sqrt(4.0 * w / PI) * (1.0 + 2.0 * w / 3.0);
+    }
+
+    // Poisson's equation in King units (sigma = 1, core radius 1, G = 1):
+    // W'' + 2 W' / r = -9 rho(W) / rho(W0), from W0 outwards until W reaches
+    // 0 at the tidal radius. f(E) = exp(E) - 1 needs no inversion.
+    SphericalTable king(double w0) {
+        SphericalTable t;
+        const std::vector<double> radii = logRadii(1e4);
+        const double central = kingDensity(w0);
+        auto rhs = [&](double r, double w, double u, double& dw, double& du) {
+            dw = u;
+            du = -9.0 * kingDensity(w) / central - 2.0 * u / r;
+        };
+
+        // Series start: W = W0 - 1.5 r^2 near the centre
+        double w = w0 - 1.5 * radii[0] * radii[0], u = -3.0 * radii[0];
+        t.r.push_back(radii[0]);
+        t.psi.push_back(w);
+        t.mass.push_back(-radii[0] * radii[0] * u);
+        for (size_t k = 1; k < radii.size() && w > 0.0; ++k) {
+            const double r = radii[k - 1], h = radii[k] - r;
+            double k1w, k1u, k2w, k2u, k3w, k3u, k4w, k4u;
+            rhs(r, w, u, k1w, k1u);
+            rhs(r + 0.5 * h, w + 0.5 * h * k1w, u + 0.5 * h * k1u, k2w, k2u);
+            rhs(r + 0.5 * h, w + 0.5 * h * k2w, u + 0.5 * h * k2u, k3w, k3u);
+            rhs(r + h, w + h * k3w, u + h * k3u, k4w, k4u);
+            const double nextW = w + h / 6.0 * (k1w + 2.0 * k2w + 2.0 * k3w + k4w);
+            const double nextU = u + h / 6.0 * (k1u + 2.0 * k2u + 2.0 * k3u + k4u);
+            if (nextW <= 0.0) {
+                // The tidal radius, where the table ends
+                const double tidal = r + h * w / (w - nextW);
+                t.r.push_back(tidal);
+                t.psi.push_back(0.0);
+                t.mass.push_back(-tidal * tidal * nextU);
+                w = 0.0;
+                break;
+            }
+            w = nextW;
+            u = nextU;
+            t.r.push_back(radii[k]);
+            t.psi.push_back(w);
+            t.mass.push_back(-radii[k] * radii[k] * u);
+        }
+        t.totalMass = t.mass.back();
+
+        const size_t n = t.r.size();
+        t.energy.resize(n);
+        t.df.resize(n);
+        for (size_t j = 0; j < n; ++j) {
+            t.energy[n - 1 - j] = t.psi[j];
+            t.df[n - 1 - j] = std::expm1(t.psi[j]);
+        }
+        fillEnvelope(t);
+        return t;
+    }
+
+    glm::dvec3 isotropic(Philox& rng, double length) {
+        const double cosTheta = 2.0 * rng.uniform() - 1.0;
+        const double sinTheta = std::sqrt(std::max(0.0, 1.0 - cosTheta * cosTheta));
+        const double phi = 2.0 * PI * rng.uniform();
+        return length * glm::dvec3(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta);
+    }
+
+    // One body of a spherical model, in its table's units
+    void sampleSpherical(const SphericalTable& t, Philox& rng, glm::dvec3& position, glm::dvec3& velocity) {
+        const double m = rng.uniform() * t.totalMass;
+        const double r = m < t.mass.front() ? t.r.front() * std::cbrt(m / t.mass.front())
+                                            : interpolate(t.mass, t.r, m);
+        position = isotropic(rng, r);
+
+        const double psi = interpolate(t.r, t.psi, r);
+        const double escape = std::sqrt(2.0 * std::max(psi, 0.0));
+        const size_t k = std::min(size_t(std::upper_bound(t.r.begin(), t.r.end(), r) - t.r.begin()), t.r.size() - 1);
+        const double bound = std::max(t.envelope[k], t.envelope[k == 0 ? 0 : k - 1]);
+        double v = 0.0;
+        for (int attempt = 0; attempt < 1000 && bound > 0.0; ++attempt) {
+            v = escape * rng.uniform();
+            if (rng.uniform() * bound <= v * v * distribution(t, psi - 0.5 * v * v)) break;
+        }
+        velocity = isotropic(rng, v);
+    }
+
+    // Exponential disk of mass 1 - bulge and scale length 1 around a
+    // Hernquist bulge of mass bulge and scale bulgeRadius, G = 1
+    struct DiskTable {
+        std::vector<double> r, mass;                        // Disk mass inside cylindrical radius r
+        std::vector<double> circular2, kappa2;              // v_c^2 and the epicyclic frequency squared
+        double sigmaR0 = 0.0;                               // Radial dispersion at the centre
+        double height = 0.1;
+        double surface0 = 0.0;
+
+        double surface(double r) const { return surface0 * std::exp(-r); }
+    };
+
+    DiskTable disk(double bulge, double bulgeRadius, double height, double q) {
+        DiskTable t;
+        t.r = logRadii(15.0);
+        t.height = height;
+        const size_t n = t.r.size();
+        const double diskMass = 1.0 - bulge;
+        t.surface0 = diskMass / (2.0 * PI);
+
+        // Freeman's thin-disk rotation curve plus the bulge's enclosed mass
+        t.mass.resize(n);
+        t.circular2.resize(n);
+        for (size_t k = 0; k < n; ++k) {
+            const double r = t.r[k], y = 0.5 * r;
+            t.mass[k] = diskMass * (1.0 - (1.0 + r) * std::exp(-r));
+            const double bessel = std::cyl_bessel_i(0.0, y) * std::cyl_bessel_k(0.0, y) -
+                                  std::cyl_bessel_i(1.0, y) * std::cyl_bessel_k(1.0, y);
+            t.circular2[k] = 2.0 * diskMass * y * y * bessel + bulge * r / ((r + bulgeRadius) * (r + bulgeRadius));
+        }
+
+        // kappa^2 = 2 v_c^2 / R^2 + d(v_c^2)/dR / R
+        t.kappa2.resize(n);
+        for (size_t k = 0; k < n; ++k) {
+            const size_t lo = k == 0 ? 0 : k - 1, hi = k + 1 == n ? k : k + 1;
+            const double slope = (t.circular2[hi] - t.circular2[lo]) / (t.r[hi] - t.r[lo]);
+            t.kappa2[k] = std::max(2.0 * t.circular2[k] / (t.r[k] * t.r[k]) + slope / t.r[k], 1e-12);
+        }
+
+        // sigma_R falls as exp(-R / 2), normalised to Q at 2.43 scale lengths
+        // (Hernquist 1993), where Q = sigma_R kappa / (3.36 Sigma)
+        const double reference = 2.43;
+        const double kappa = std::sqrt(interpolate(t.r, t.kappa2, reference));
+        const double sigma = q * 3.36 * t.surface(reference) / kappa;
+        t.sigmaR0 = sigma * std::exp(0.5 * reference);
+        return t;
+    }
+
+    // One disk body in the disk's frame, spin about +z
+    void sampleDisk(const DiskTable& t, Philox& rng, glm::dvec3& position, glm::dvec3& velocity) {
+        const double m = rng.uniform() * t.mass.back();
+        const double r = interpolate(t.mass, t.r, m);
+        const double phi = 2.0 * PI * rng.uniform();
+        const double z = t.height * std::atanh(std::min(std::max(2.0 * rng.uniform() - 1.0, -0.999999), 0.999999));
+
+        const double circular2 = interpolate(t.r, t.circular2, r);
+        const double kappa2 = interpolate(t.r, t.kappa2, r);
+        const double omega2 = circular2 / (r * r);
+        const double sigmaR2 = t.sigmaR0 * t.sigmaR0 * std::exp(-r);
+        const double sigmaPhi2 = sigmaR2 * kappa2 / (4.0 * omega2);
+        const double sigmaZ2 = PI * t.surface(r) * t.height;
+        // Asymmetric drift for an exponential disk with sigma_R^2 ~ exp(-R)
+        const double mean2 = circular2 + sigmaR2 * (1.0 - kappa2 / (4.0 * omega2) - 2.0 * r);
+
+        const double vr = std::sqrt(sigmaR2) * rng.normal();
+        const double vphi = std::sqrt(std::max(mean2, 0.0)) + std::sqrt(sigmaPhi2) * rng.normal();
+        const double vz = std::sqrt(sigmaZ2) * rng.normal();
+
+        const double c = std::cos(phi), s = std::sin(phi);
+        position = glm::dvec3(r * c, r * s, z);
+        velocity = glm::dvec3(vr * c - vphi * s, vr * s + vphi * c, vz);
+    }
+}
+
+bool InitialConditions::parseModel(const std::string& name, Model& out) {
+    for (Model model : {Model::Plummer, Model::Hernquist, Model::NFW, Model::Disk, Model::King}) {
+        if (name == modelName(model)) {
+            out = model;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* InitialConditions::modelName(Model model) {
+    switch (model) {
+        case Model::Plummer:   return "plummer";
+        case Model::Hernquist: return "hernquist";
+        case Model::NFW:       return "nfw";
+        case Model::Disk:      return "disk";
+        case Model::King:      return "king";
+    }
+    return "unknown";
+}
+
+void SimulationEngine::addModel(const InitialConditions::Config& config) {
+    using InitialConditions::Model;
+    const size_t count = config.count;
+    if (count == 0) return;
+
+    // The spherical table, or the bulge's next to the disk's
+    SphericalTable sphere;
+    DiskTable flat;
+    size_t bulgeCount = 0;
+    double sphereScale = 1.0;       // Table radius unit in model units
+    switch (config.model) {
+        case Model::Plummer:   sphere = plummer(); break;
+        case Model::Hernquist: sphere = hernquist(); break;
+        case Model::NFW:       sphere = nfw(std::max(config.concentration, 1.0f)); break;
+        case Model::King:      sphere = king(std::min(std::max(config.kingW0, 0.5f), 15.0f)); break;
+        case Model::Disk: {
+            const double bulge = std::min(std::max(double(config.bulgeFraction), 0.0), 1.0);
+            flat = disk(bulge, std::max(config.bulgeRadius, 1e-3f), std::max(config.diskHeight, 1e-4f),
+                        config.toomreQ);
+            bulgeCount = size_t(std::llround(bulge * double(count)));
+            if (bulgeCount > 0) sphere = hernquist();
+            sphereScale = config.bulgeRadius;
+            break;
+        }
+    }
+
+    // Model units to scene units and stored velocities. The spherical
+    // tables carry their own total mass; the disk's is 1 with the bulge.
+    const double length = config.scaleRadius;
+    const double G = sceneGravitationalConstant();
+    const double diskVelocity = std::sqrt(G * config.totalMass / length) * Physics::TIME_SCALE;
+    double sphereVelocity = diskVelocity;
+    if (!sphere.r.empty()) {
+        const double sphereMass = config.model == Model::Disk ? std::min(std::max(double(config.bulgeFraction), 0.0), 1.0)
+                                                              : 1.0;
+        sphereVelocity = diskVelocity * std::sqrt(sphereMass / (sphere.totalMass * sphereScale));
+    }
+
+    // Disk frame: spin axis along z
+    const glm::dvec3 e3 = glm::length(config.axis) > 0.0f ? glm::normalize(glm::dvec3(config.axis)) : glm::dvec3(0, 1, 0);
+    const glm::dvec3 e1 = glm::normalize(glm::cross(e3, std::abs(e3.x) < 0.9 ? glm::dvec3(1, 0, 0) : glm::dvec3(0, 1, 0)));
+    const glm::dvec3 e2 = glm::cross(e3, e1);
+
+    const size_t first = bodies.append(count);
+    const float mass = float(config.totalMass / double(count));
+    const float radius = BodyStore::computeRadius(mass, config.density);
+
+    auto generate = [&](size_t begin, size_t end, unsigned) {
+        for (size_t i = begin; i < end; ++i) {
+            Philox rng(config.seed, i);
+            glm::dvec3 p, v;
+            bool inBulge = false;
+            if (config.model != Model::Disk) {
+                sampleSpherical(sphere, rng, p, v);
+                v *= sphereVelocity;
+            } else if (i < bulgeCount) {
+                sampleSpherical(sphere, rng, p, v);
+                p *= sphereScale;
+                v *= sphereVelocity;
+                inBulge = true;
+            } else {
+                sampleDisk(flat, rng, p, v);
+                p = e1 * p.x + e2 * p.y + e3 * p.z;
+                v = (e1 * v.x + e2 * v.y + e3 * v.z) * diskVelocity;
+            }
+            p *= length;
+
+            const size_t b = first + i;
+            bodies.px[b] = float(p.x); bodies.py[b] = float(p.y); bodies.pz[b] = float(p.z);
+            bodies.vx[b] = float(v.x); bodies.vy[b] = float(v.y); bodies.vz[b] = float(v.z);
+            bodies.mass[b] = mass;
+            bodies.density[b] = config.density;
+            bodies.radius[b] = radius;
+            bodies.color[b] = inBulge ? config.bulgeColor : config.color;
+        }
+    };
+    if (runsParallel()) {
+        pool.parallelFor(count, generate);
+    } else {
+        generate(0, count, 0);
+    }
+
+    // Into the centre-of-mass frame, summed over fixed blocks in order so
+    // the shift is the same for any thread count; equal masses drop out
+    const size_t blocks = (count + REDUCTION_BLOCK - 1) / REDUCTION_BLOCK;
+    ScratchArena::Scope scope(scratch);
+    glm::dvec3* blockSums = scratch.take<glm::dvec3>(2 * blocks, glm::dvec3(0.0));
+    runTasks(blocks, [&](size_t block, unsigned) {
+        const size_t end = std::min(count, (block + 1) * REDUCTION_BLOCK);
+        for (size_t i = first + block * REDUCTION_BLOCK; i < first + end; ++i) {
+            blockSums[2 * block] += glm::dvec3(bodies.px[i], bodies.py[i], bodies.pz[i]);
+            blockSums[2 * block + 1] += glm::dvec3(bodies.vx[i], bodies.vy[i], bodies.vz[i]);
+        }
+    });
+    glm::dvec3 centre(0.0), drift(0.0);
+    for (size_t block = 0; block < blocks; ++block) {
+        centre += blockSums[2 * block];
+        drift += blockSums[2 * block + 1];
+    }
+    const glm::vec3 shift = glm::vec3(glm::dvec3(config.position) - centre / double(count));
+    const glm::vec3 boost = glm::vec3(glm::dvec3(config.velocity) - drift / double(count));
+    auto recentre = [&](size_t begin, size_t end, unsigned) {
+        for (size_t i = first + begin; i < first + end; ++i) {
+            bodies.px[i] += shift.x; bodies.py[i] += shift.y; bodies.pz[i] += shift.z;
+            bodies.vx[i] += boost.x; bodies.vy[i] += boost.y; bodies.vz[i] += boost.z;
+        }
+    };
+    if (runsParallel()) {
+        pool.parallelFor(count, recentre);
+    } else {
+        recentre(0, count, 0);
+    }
+}
+
+// Two disk galaxies with bulges, inclined to each other, falling together
+// on a parabolic orbit that passes a few scale lengths apart
+void Presets::loadGalaxyCollision(SimulationEngine& engine, size_t count, uint64_t seed) {
+    engine.clearBodies();
+    engine.bodies.reserve(count);
+
+    InitialConditions::Config galaxy;
+    galaxy.model = InitialConditions::Model::Disk;
+    galaxy.totalMass = 1e28;
+    galaxy.scaleRadius = 1200.0f;
+    galaxy.density = 4e7f;
+
+    const float separation = 16000.0f, impact = 3000.0f;
+    const double relative = std::sqrt(2.0 * engine.sceneGravitationalConstant() * 2.0 * galaxy.totalMass /
+                                      std::sqrt(double(separation) * separation + double(impact) * impact)) *
+                            Physics::TIME_SCALE;
+
+    galaxy.count = count / 2;
+    galaxy.seed = seed;
+    galaxy.position = glm::vec3(-separation / 2, 0.0f, -impact / 2);
+    galaxy.velocity = glm::vec3(float(relative / 2), 0.0f, 0.0f);
+    galaxy.axis = glm::vec3(0.0f, 1.0f, 0.0f);
+    galaxy.color = glm::vec4(0.55f, 0.7f, 1.0f, 1.0f);
+    engine.addModel(galaxy);
+
+    galaxy.count = count - count / 2;
+    galaxy.seed = seed + 1;
+    galaxy.position = -galaxy.position;
+    galaxy.velocity = -galaxy.velocity;
+    galaxy.axis = glm::vec3(0.5f, 0.6f, 0.6f);
+    galaxy.color = glm::vec4(1.0f, 0.6f, 0.45f, 1.0f);
+    engine.addModel(galaxy);
+}
@@ -0,0 +1,161 @@
+#include "Journal.h"
+#include "MappedFile.h"
+#include <cstring>
+#include <iostream>
+
+// ---------------------------------------------------------------------------
+// JournalWriter
+// ---------------------------------------------------------------------------
+
+bool JournalWriter::open(const std::string& filename, const SimulationEngine& engine) {
+    close();
+    if (!engine.saveState(filename + ".start")) return false;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    file.open(filename, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        std::cerr << "Failed to create " << filename << std::endl;
+        return false;
+    }
+    path = filename;
+
+    JournalHeader header{};
+    std::memcpy(header.magic, Journal::MAGIC, sizeof(header.magic));
+    header.version = Journal::VERSION;
+    header.byteOrder = Journal::BYTE_ORDER_MARK;
+    header.headerSize = sizeof(JournalHeader);
+    header.entrySize = sizeof(JournalEntry);
+    header.startStep = engine.stepCount;
+    header.threads = engine.getThreadCount();
+    header.deterministic = engine.deterministic;
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    start = std::chrono::steady_clock::now();
+    entries = 0;
+    currentStep.store(engine.stepCount, std::memory_order_relaxed);
+    recording.store(true);
+    return true;
+}
+
+void JournalWriter::finish(const SimulationEngine& engine) {
+    if (!isOpen()) return;
+    JournalEntry entry = makeEntry(Journal::Kind::End, engine.stepCount);
+    entry.bodyId = engine.stateHash();
+    write(&entry, 1, true);
+    close();
+}
+
+void JournalWriter::close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!file.is_open()) return;
+    recording.store(false);
+    file.close();
+    if (!file) std::cerr << "Journal " << path << " is incomplete" << std::endl;
+}
+
+void JournalWriter::commands(uint64_t step, const SimulationCommand* commands, size_t count) {
+    if (!isOpen()) return;
+    std::vector<JournalEntry> batch(count);
+    for (size_t c = 0; c < count; ++c) {
+        const SimulationCommand& command = commands[c];
+        JournalEntry& entry = batch[c];
+        entry = makeEntry(Journal::Kind::Command, step);
+        entry.type = uint8_t(command.type);
+        entry.code = int32_t(c);
+        entry.flag = command.flag;
+        entry.preset = uint8_t(command.preset);
+        entry.bodyId = command.bodyId;
+        entry.count = command.count;
+        const float values[12] = {command.position.x, command.position.y, command.position.z,
+                                  command.velocity.x, command.velocity.y, command.velocity.z,
+                                  command.color.r,    command.color.g,    command.color.b,
+                                  command.color.a,    command.mass,       command.density};
+        std::memcpy(entry.values, values, sizeof(values));
+        if (command.type == SimulationCommand::Type::SetTimeScale) entry.values[0] = command.value;
+    }
+    // Edits are rare and the ones worth replaying, so they reach the disk at once
+    write(batch.data(), batch.size(), true);
+}
+
+void JournalWriter::rewind(uint64_t step, uint64_t target) {
+    if (!isOpen()) return;
+    JournalEntry entry = makeEntry(Journal::Kind::Rewind, step);
+    entry.bodyId = target;
+    write(&entry, 1, true);
+}
+
+void JournalWriter::input(Journal::Kind kind, int code, int action, int mods, float x, float y) {
+    if (!isOpen()) return;
+    JournalEntry entry = makeEntry(kind, currentStep.load(std::memory_order_relaxed));
+    entry.code = code;
+    entry.action = action;
+    entry.mods = mods;
+    entry.values[0] = x;
+    entry.values[1] = y;
+    write(&entry, 1, false);
+}
+
+JournalEntry JournalWriter::makeEntry(Journal::Kind kind, uint64_t step) const {
+    JournalEntry entry{};
+    entry.step = step;
+    entry.time = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+    entry.kind = uint8_t(kind);
+    return entry;
+}
+
+void JournalWriter::write(const JournalEntry* batch, size_t count, bool flush) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!file.is_open()) return;
+    file.write(reinterpret_cast<const char*>(batch), std::streamsize(count * sizeof(JournalEntry)));
+    if (flush) file.flush();
+    entries += count;
+}
+
+// ---------------------------------------------------------------------------
+// JournalReader
+// ---------------------------------------------------------------------------
+
+bool JournalReader::open(const std::string& filename) {
+    MappedFile file;
+    if (!file.open(filename)) return false;
+    path = filename;
+    list.clear();
+
+    if (file.size() < sizeof(head)) {
+        std::cerr << filename << " is not a journal" << std::endl;
+        return false;
+    }
+    std::memcpy(&head, file.data(), sizeof(head));
+    if (std::memcmp(head.magic, Journal::MAGIC, sizeof(head.magic)) != 0) {
+        std::cerr << filename << " is not a journal" << std::endl;
+        return false;
+    }
+    if (head.byteOrder != Journal::BYTE_ORDER_MARK || head.version != Journal::VERSION ||
+        head.entrySize != sizeof(JournalEntry) || head.headerSize < sizeof(head) || head.headerSize > file.size()) {
+        std::cerr << filename << " is journal version " << head.version << ", this build reads version "
+                  << Journal::VERSION << " in native byte order" << std::endl;
+        return false;
+    }
+
+    // A session that crashed leaves a partial last entry and no End
+    const size_t count = (file.size() - head.headerSize) / sizeof(JournalEntry);
+    list.resize(count);
+    std::memcpy(list.data(), file.data() + head.headerSize, count * sizeof(JournalEntry));
+    return true;
+}
+
+SimulationCommand JournalReader::toCommand(const JournalEntry& entry) {
+    SimulationCommand command;
+    command.type = SimulationCommand::Type(entry.type);
+    command.flag = entry.flag != 0;
+    command.preset = SimulationPreset(entry.preset);
+    command.bodyId = entry.bodyId;
+    command.count = entry.count;
+    command.position = glm::vec3(entry.values[0], entry.values[1], entry.values[2]);
+    command.velocity = glm::vec3(entry.values[3], entry.values[4], entry.values[5]);
+    command.color = glm::vec4(entry.values[6], entry.values[7], entry.values[8], entry.values[9]);
+    command.mass = entry.values[10];
+    command.density = entry.values[11];
+    command.value = entry.values[0];
+    return command;
+}
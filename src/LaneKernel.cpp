@@ -0,0 +1,133 @@
+#include "LaneKernel.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+LaneSystems::LaneSystems(size_t bodiesPerSystem)
+    : n(bodiesPerSystem),
+      px(n), py(n), pz(n), vx(n), vy(n), vz(n), ax(n), ay(n), az(n), mass(n), radius(n), hits(n) {
+    for (size_t l = 0; l < LANES; ++l) escapeR2.v[l] = std::numeric_limits<float>::infinity();
+}
+
+void LaneSystems::load(size_t lane, const BodyStore& system) {
+    for (size_t i = 0; i < n; ++i) {
+        px[i].v[lane] = system.px[i]; py[i].v[lane] = system.py[i]; pz[i].v[lane] = system.pz[i];
+        vx[i].v[lane] = system.vx[i]; vy[i].v[lane] = system.vy[i]; vz[i].v[lane] = system.vz[i];
+        mass[i].v[lane] = system.mass[i];
+        radius[i].v[lane] = system.radius[i];
+    }
+    active.v[lane] = 1;
+    steps[lane] = 0;
+}
+
+void LaneSystems::store(size_t lane, BodyStore& system) const {
+    for (size_t i = 0; i < n; ++i) {
+        system.px[i] = px[i].v[lane]; system.py[i] = py[i].v[lane]; system.pz[i] = pz[i].v[lane];
+        system.vx[i] = vx[i].v[lane]; system.vy[i] = vy[i].v[lane]; system.vz[i] = vz[i].v[lane];
+        system.ax[i] = ax[i].v[lane]; system.ay[i] = ay[i].v[lane]; system.az[i] = az[i].v[lane];
+    }
+}
+
+void LaneSystems::setEscape(size_t lane, const glm::vec3& centre, float escapeRadius) {
+    escapeX.v[lane] = centre.x;
+    escapeY.v[lane] = centre.y;
+    escapeZ.v[lane] = centre.z;
+    escapeR2.v[lane] = escapeRadius * escapeRadius;
+}
+
+void LaneSystems::run(uint64_t maxSteps) {
+    while (updateActive(maxSteps)) {
+        computeForces();
+        integrate();
+    }
+}
+
+// Same operations as SimulationEngine::forcesDeterministic, one lane per system
+void LaneSystems::computeForces() {
+    const float G = gravitationalConstant;
+    for (size_t i = 0; i < n; ++i) {
+        LaneFloat sx{}, sy{}, sz{};
+        LaneMask count{};
+        const LaneFloat& xi = px[i]; const LaneFloat& yi = py[i]; const LaneFloat& zi = pz[i];
+        const LaneFloat& ri = radius[i];
+
+        for (size_t j = 0; j < n; ++j) {
+            const LaneFloat& xj = px[j]; const LaneFloat& yj = py[j]; const LaneFloat& zj = pz[j];
+            const LaneFloat& mj = mass[j]; const LaneFloat& rj = radius[j];
+            for (size_t l = 0; l < LANES; ++l) {
+                const float dx = xj.v[l] - xi.v[l], dy = yj.v[l] - yi.v[l], dz = zj.v[l] - zi.v[l];
+                const float dist = std::sqrt(dx * dx + dy * dy + dz * dz);
+                const bool valid = dist > 0.0f;
+
+                const float distM = dist * Physics::METERS_PER_UNIT;
+                const float s = G / (distM * distM) / dist * mj.v[l];
+                sx.v[l] = valid ? sx.v[l] + dx * s : sx.v[l];
+                sy.v[l] = valid ? sy.v[l] + dy * s : sy.v[l];
+                sz.v[l] = valid ? sz.v[l] + dz * s : sz.v[l];
+                count.v[l] += (valid && ri.v[l] + rj.v[l] > dist) ? 1u : 0u;
+            }
+        }
+        ax[i] = sx; ay[i] = sy; az[i] = sz;
+        hits[i] = count;
+    }
+}
+
+void LaneSystems::integrate() {
+    const float kick = timeScale / Physics::ACCELERATION_DAMPING;
+    const float drift = timeScale / Physics::TIME_SCALE;
+
+    for (size_t i = 0; i < n; ++i) {
+        LaneFloat nvx, nvy, nvz;
+        uint32_t maxHits = 0;
+        for (size_t l = 0; l < LANES; ++l) {
+            nvx.v[l] = vx[i].v[l] + ax[i].v[l] * kick;
+            nvy.v[l] = vy[i].v[l] + ay[i].v[l] * kick;
+            nvz.v[l] = vz[i].v[l] + az[i].v[l] * kick;
+            maxHits = std::max(maxHits, hits[i].v[l]);
+        }
+
+        // Restitution is applied once per overlapping partner, as in the scalar engine
+        if (enableCollisions) {
+            for (uint32_t k = 0; k < maxHits; ++k) {
+                for (size_t l = 0; l < LANES; ++l) {
+                    const bool hit = k < hits[i].v[l];
+                    nvx.v[l] = hit ? nvx.v[l] * Physics::COLLISION_RESTITUTION : nvx.v[l];
+                    nvy.v[l] = hit ? nvy.v[l] * Physics::COLLISION_RESTITUTION : nvy.v[l];
+                    nvz.v[l] = hit ? nvz.v[l] * Physics::COLLISION_RESTITUTION : nvz.v[l];
+                }
+            }
+        }
+
+        for (size_t l = 0; l < LANES; ++l) {
+            const bool live = active.v[l] != 0;
+            vx[i].v[l] = live ? nvx.v[l] : vx[i].v[l];
+            vy[i].v[l] = live ? nvy.v[l] : vy[i].v[l];
+            vz[i].v[l] = live ? nvz.v[l] : vz[i].v[l];
+            px[i].v[l] = live ? px[i].v[l] + nvx.v[l] * drift : px[i].v[l];
+            py[i].v[l] = live ? py[i].v[l] + nvy.v[l] * drift : py[i].v[l];
+            pz[i].v[l] = live ? pz[i].v[l] + nvz.v[l] * drift : pz[i].v[l];
+        }
+    }
+
+    for (size_t l = 0; l < LANES; ++l) steps[l] += active.v[l];
+}
+
+// Masks out lanes that ran out of steps or had a body escape; false once none are left
+bool LaneSystems::updateActive(uint64_t maxSteps) {
+    LaneMask escaped{};
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t l = 0; l < LANES; ++l) {
+            const float dx = px[i].v[l] - escapeX.v[l];
+            const float dy = py[i].v[l] - escapeY.v[l];
+            const float dz = pz[i].v[l] - escapeZ.v[l];
+            escaped.v[l] |= (dx * dx + dy * dy + dz * dz > escapeR2.v[l]) ? 1u : 0u;
+        }
+    }
+
+    bool any = false;
+    for (size_t l = 0; l < LANES; ++l) {
+        if (escaped.v[l] || steps[l] >= maxSteps) active.v[l] = 0;
+        any = any || active.v[l];
+    }
+    return any;
+}
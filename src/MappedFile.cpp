@@ -0,0 +1,94 @@
+#include "MappedFile.h"
+#include <iostream>
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string& path) {
+    close();
+    fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                             FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (fileHandle == INVALID_HANDLE_VALUE) {
+        fileHandle = nullptr;
+        std::cerr << "Failed to open " << path << std::endl;
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0) {
+        std::cerr << "Cannot map empty file " << path << std::endl;
+        close();
+        return false;
+    }
+
+    mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+    if (!mappingHandle) {
+        std::cerr << "Failed to map " << path << std::endl;
+        close();
+        return false;
+    }
+    base = static_cast<uint8_t*>(MapViewOfFile(mappingHandle, FILE_MAP_COPY, 0, 0, 0));
+    if (!base) {
+        std::cerr << "Failed to map " << path << std::endl;
+        close();
+        return false;
+    }
+    length = static_cast<size_t>(fileSize.QuadPart);
+    return true;
+}
+
+void MappedFile::close() {
+    if (base) UnmapViewOfFile(base);
+    if (mappingHandle) CloseHandle(mappingHandle);
+    if (fileHandle) CloseHandle(fileHandle);
+    base = nullptr;
+    mappingHandle = nullptr;
+    fileHandle = nullptr;
+    length = 0;
+}
+
+#else
+
+bool MappedFile::open(const std::string& path) {
+    close();
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Failed to open " << path << std::endl;
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        std::cerr << "Cannot map empty file " << path << std::endl;
+        ::close(fd);
+        return false;
+    }
+
+    void* mapped = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);    // The mapping keeps the file alive
+    if (mapped == MAP_FAILED) {
+        std::cerr << "Failed to map " << path << std::endl;
+        return false;
+    }
+    base = static_cast<uint8_t*>(mapped);
+    length = static_cast<size_t>(info.st_size);
+    return true;
+}
+
+void MappedFile::close() {
+    if (base) munmap(base, length);
+    base = nullptr;
+    length = 0;
+}
+
+#endif
@@ -0,0 +1,182 @@
+#include "Octree.h"
+#include "SimulationEngine.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    // Spreads the low 21 bits of v so that two zero bits follow each one
+    uint64_t spreadBits(uint64_t v) {
+        v &= 0x1FFFFF;
+        v = (v | v << 32) & 0x1F00000000FFFFull;
+        v = (v | v << 16) & 0x1F0000FF0000FFull;
+        v = (v | v << 8)  & 0x100F00F00F00F00Full;
+        v = (v | v << 4)  & 0x10C30C30C30C30C3ull;
+        v = (v | v << 2)  & 0x1249249249249249ull;
+        return v;
+    }
+}
+
+uint64_t mortonKey(const glm::vec3& p, const glm::vec3& origin, float size) {
+    const float cells = float(1u << 21);
+    auto cell = [&](float v, float o) {
+        const float c = (v - o) / size * cells;
+        return uint64_t(std::min(std::max(c, 0.0f), cells - 1.0f));
+    };
+    return spreadBits(cell(p.x, origin.x)) << 2 | spreadBits(cell(p.y, origin.y)) << 1 | spreadBits(cell(p.z, origin.z));
+}
+
+float Bounds::distance2(const glm::vec3& p) const {
+    const glm::vec3 nearest = glm::clamp(p, min, max);
+    const glm::vec3 d = p - nearest;
+    return glm::dot(d, d);
+}
+
+void Octree::build(const std::vector<TreeParticle>& particles) {
+    nodes.clear();
+    sorted.clear();
+    keys.clear();
+    if (particles.empty()) return;
+
+    rootBounds.min = rootBounds.max = glm::vec3(particles[0].x, particles[0].y, particles[0].z);
+    for (const TreeParticle& p : particles) {
+        rootBounds.min = glm::min(rootBounds.min, glm::vec3(p.x, p.y, p.z));
+        rootBounds.max = glm::max(rootBounds.max, glm::vec3(p.x, p.y, p.z));
+    }
+    const glm::vec3 extent = rootBounds.max - rootBounds.min;
+    float size = std::max(extent.x, std::max(extent.y, extent.z)) * 1.0001f;
+    if (size <= 0.0f) size = 1.0f;
+
+    // Sort by Morton key so that every octant is a contiguous range
+    std::vector<std::pair<uint64_t, uint32_t>> order(particles.size());
+    for (size_t i = 0; i < particles.size(); ++i) {
+        const TreeParticle& p = particles[i];
+        order[i] = {mortonKey(glm::vec3(p.x, p.y, p.z), rootBounds.min, size), uint32_t(i)};
+    }
+    std::sort(order.begin(), order.end());
+
+    sorted.resize(particles.size());
+    keys.resize(particles.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        keys[i] = order[i].first;
+        sorted[i] = particles[order[i].second];
+    }
+
+    nodes.reserve(2 * particles.size() / LEAF_SIZE + 1);
+    nodes.resize(1);
+    buildNode(0, 0, uint32_t(sorted.size()), 0, rootBounds.min, size);
+}
+
+// Fills nodes[index] for particles [begin, end); children are appended as one contiguous run
+void Octree::buildNode(uint32_t index, uint32_t begin, uint32_t end, int depth, const glm::vec3& corner, float size) {
+    double m = 0.0, cx = 0.0, cy = 0.0, cz = 0.0;
+    for (uint32_t i = begin; i < end; ++i) {
+        m += sorted[i].mass;
+        cx += double(sorted[i].mass) * sorted[i].x;
+        cy += double(sorted[i].mass) * sorted[i].y;
+        cz += double(sorted[i].mass) * sorted[i].z;
+    }
+    Node& node = nodes[index];
+    node.mass = float(m);
+    if (m > 0.0) {
+        node.cx = float(cx / m); node.cy = float(cy / m); node.cz = float(cz / m);
+    } else {
+        node.cx = corner.x + size * 0.5f; node.cy = corner.y + size * 0.5f; node.cz = corner.z + size * 0.5f;
+    }
+    node.size = size;
+    node.begin = begin;
+    node.end = end;
+    node.firstChild = 0;
+    node.childCount = 0;
+
+    if (end - begin <= LEAF_SIZE || depth >= MAX_DEPTH) return;
+
+    // Split the range on the three key bits of this level
+    const int shift = 60 - 3 * depth;
+    uint32_t split[9];
+    split[0] = begin;
+    for (uint32_t octant = 0; octant < 8; ++octant) {
+        split[octant + 1] = uint32_t(std::upper_bound(keys.begin() + split[octant], keys.begin() + end, octant,
+                                                      [&](uint32_t o, uint64_t key) { return o < ((key >> shift) & 7); }) -
+                                     keys.begin());
+    }
+
+    uint32_t childCount = 0;
+    for (uint32_t octant = 0; octant < 8; ++octant) childCount += split[octant + 1] > split[octant];
+
+    const uint32_t firstChild = uint32_t(nodes.size());
+    nodes.resize(nodes.size() + childCount);    // Invalidates `node`
+    nodes[index].firstChild = firstChild;
+    nodes[index].childCount = childCount;
+
+    const float half = size * 0.5f;
+    uint32_t slot = firstChild;
+    for (uint32_t octant = 0; octant < 8; ++octant) {
+        if (split[octant + 1] == split[octant]) continue;
+        const glm::vec3 offset(float((octant >> 2) & 1), float((octant >> 1) & 1), float(octant & 1));
+        buildNode(slot++, split[octant], split[octant + 1], depth + 1, corner + half * offset, half);
+    }
+}
+
+Octree::Sample Octree::evaluate(const glm::vec3& target, float targetRadius, float theta, float G) const {
+    Sample sample;
+    if (nodes.empty()) return sample;
+
+    const float theta2 = theta * theta;
+    auto interact = [&](float x, float y, float z, float m, float r) {
+        const float dx = x - target.x, dy = y - target.y, dz = z - target.z;
+        const float dist = std::sqrt(dx * dx + dy * dy + dz * dz);
+        if (dist <= 0.0f) return;
+
+        const float distM = dist * Physics::METERS_PER_UNIT;
+        const float s = G / (distM * distM) / dist * m;
+        sample.ax += dx * s; sample.ay += dy * s; sample.az += dz * s;
+        sample.potential -= double(G) * m / distM;
+        if (r > 0.0f && targetRadius + r > dist) ++sample.overlaps;
+        ++sample.interactions;
+    };
+
+    uint32_t stack[8 * (MAX_DEPTH + 1)];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const Node& node = nodes[stack[--top]];
+        if (node.firstChild == 0) {
+            for (uint32_t i = node.begin; i < node.end; ++i) {
+                interact(sorted[i].x, sorted[i].y, sorted[i].z, sorted[i].mass, sorted[i].radius);
+            }
+            continue;
+        }
+
+        const float dx = node.cx - target.x, dy = node.cy - target.y, dz = node.cz - target.z;
+        if (node.size * node.size < theta2 * (dx * dx + dy * dy + dz * dz)) {
+            interact(node.cx, node.cy, node.cz, node.mass, 0.0f);
+        } else {
+            for (uint32_t c = 0; c < node.childCount; ++c) stack[top++] = node.firstChild + c;
+        }
+    }
+    return sample;
+}
+
+void Octree::exportFor(const Bounds& region, float theta, std::vector<TreeParticle>& out) const {
+    if (nodes.empty()) return;
+
+    const float theta2 = theta * theta;
+    uint32_t stack[8 * (MAX_DEPTH + 1)];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const Node& node = nodes[stack[--top]];
+        if (node.firstChild == 0) {
+            out.insert(out.end(), sorted.begin() + node.begin, sorted.begin() + node.end);
+            continue;
+        }
+
+        // Every point of the region is at least this far away, so accepting
+        // here means every target there would have accepted the node too
+        if (node.size * node.size < theta2 * region.distance2(glm::vec3(node.cx, node.cy, node.cz))) {
+            out.push_back(TreeParticle{node.cx, node.cy, node.cz, node.mass, 0.0f});
+        } else {
+            for (uint32_t c = 0; c < node.childCount; ++c) stack[top++] = node.firstChild + c;
+        }
+    }
+}
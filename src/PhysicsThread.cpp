@@ -0,0 +1,180 @@
+#include "PhysicsThread.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+PhysicsThread::PhysicsThread(SimulationEngine& engine) : engine(engine) {}
+
+PhysicsThread::~PhysicsThread() {
+    stop();
+}
+
+void PhysicsThread::start() {
+    if (running.exchange(true)) return;
+    // Energy and momenta come out of every step; only edits pay for a full O(N^2) energy sum
+    engine.trackDiagnostics = true;
+    resetEnergy();
+    history.clear();
+    history.record(engine);
+    publish();
+    worker = std::thread([this] { run(); });
+}
+
+void PhysicsThread::stop() {
+    if (!running.exchange(false)) return;
+    worker.join();
+}
+
+void PhysicsThread::run() {
+    using Clock = std::chrono::steady_clock;
+    auto nextTick = Clock::now();
+    auto rateWindowStart = Clock::now();
+    uint64_t rateWindowTicks = 0;
+
+    while (running.load()) {
+        const float rate = targetRate.load();
+        const auto tickLength = std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(rate > 0.0f ? 1.0 / rate : 0.0));
+
+        const int64_t seek = seekRequest.exchange(-1);
+        if (seek >= 0) showStep(uint64_t(seek));
+
+        if (drainCommands()) {
+            history.markEdited();
+            history.record(engine);
+            resetEnergy();
+            publish();
+        }
+        if (shownStep >= 0 && !engine.isPaused) rewindToShown();
+
+        if (engine.isPaused) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            nextTick = Clock::now();
+            continue;
+        }
+
+        engine.step();
+        history.record(engine);
+        if (journal) journal->setStep(engine.stepCount);
+        if (engine.diagnostics.valid) {
+            totalEnergy = engine.diagnostics.total();
+            // Drift is measured against the tracked sum too, so both carry the same rounding
+            if (referencePending) referenceEnergy = totalEnergy;
+            referencePending = false;
+        }
+
+        ++rateWindowTicks;
+        const auto now = Clock::now();
+        const double windowSeconds = std::chrono::duration<double>(now - rateWindowStart).count();
+        if (windowSeconds >= 0.5) {
+            measuredRate = rateWindowTicks / windowSeconds;
+            rateWindowStart = now;
+            rateWindowTicks = 0;
+        }
+
+        publish();
+
+        // Fixed tick rate; a slow tick is not made up for with a burst of catch-up ticks
+        nextTick += tickLength;
+        if (nextTick < now) {
+            nextTick = now;
+        } else {
+            std::this_thread::sleep_until(nextTick);
+        }
+    }
+}
+
+// Applies everything queued so far, in submission order
+bool PhysicsThread::drainCommands() {
+    bool applied = false;
+    for (size_t count; (count = commands.popBatch(batch.data(), batch.size())) > 0;) {
+        // Edits made while looking at the past apply to the past
+        for (size_t c = 0; c < count && shownStep >= 0; ++c) {
+            const bool pausing = batch[c].type == SimulationCommand::Type::SetPaused && batch[c].flag;
+            if (!pausing) rewindToShown();
+        }
+        logCommands(batch.data(), count);
+        engine.applyCommands(batch.data(), count);
+        applied = true;
+    }
+    return applied;
+}
+
+// Publishes a past step from the history without touching the engine
+void PhysicsThread::showStep(uint64_t step) {
+    if (!engine.isPaused) {
+        const SimulationCommand pause = SimulationCommand::setPaused(true);
+        logCommands(&pause, 1);
+        engine.isPaused = true;
+    }
+    if (history.empty()) return;
+    step = std::min(std::max(step, history.firstStep()), history.lastStep());
+    if (step == engine.stepCount) {
+        shownStep = -1;
+        publish();
+    } else if (history.view(step, pastBodies)) {
+        shownStep = int64_t(step);
+        publish(pastBodies, step);
+    }
+}
+
+// Makes the step on display the engine's state, dropping the steps after it
+void PhysicsThread::rewindToShown() {
+    const uint64_t step = uint64_t(shownStep);
+    shownStep = -1;
+    const uint64_t from = engine.stepCount;
+    if (!history.restore(engine, step)) return;
+    resetEnergy();
+    if (journal) {
+        journal->rewind(from, step);
+        journal->setStep(step);
+    }
+    publish();
+}
+
+// The state changed outside the integrator: measure it from scratch and drift from here
+void PhysicsThread::resetEnergy() {
+    totalEnergy = engine.getTotalEnergy();
+    referenceEnergy = 0.0;
+    referencePending = true;
+    engine.diagnostics.valid = false;
+}
+
+void PhysicsThread::publish(const BodyStore& bodies, uint64_t step) {
+    SimulationSnapshot& snapshot = snapshots.writeBuffer();
+    const size_t n = bodies.size();
+
+    snapshot.positions.resize(n);
+    snapshot.velocities.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        snapshot.positions[i] = bodies.position(i);
+        snapshot.velocities[i] = bodies.velocity(i);
+    }
+    snapshot.mass.assign(bodies.mass.begin(), bodies.mass.end());
+    snapshot.radius.assign(bodies.radius.begin(), bodies.radius.end());
+    if (snapshot.topologyVersion != bodies.topologyVersion) {
+        snapshot.density.assign(bodies.density.begin(), bodies.density.end());
+        snapshot.color.assign(bodies.color.begin(), bodies.color.end());
+        snapshot.glow.assign(bodies.glow.begin(), bodies.glow.end());
+        snapshot.ids.assign(bodies.id.begin(), bodies.id.end());
+        snapshot.topologyVersion = bodies.topologyVersion;
+    }
+    const TestParticles& particles = engine.particles;
+    snapshot.particles.resize(particles.size());
+    for (size_t i = 0; i < particles.size(); ++i) snapshot.particles[i] = particles.position(i);
+    snapshot.step = step;
+    snapshot.paused = engine.isPaused;
+    snapshot.deterministic = engine.deterministic;
+    snapshot.timeScale = engine.timeScale;
+    snapshot.lastForceMs = engine.lastForceMs;
+    snapshot.lastParticleMs = engine.lastParticleMs;
+    snapshot.totalEnergy = totalEnergy;
+    snapshot.energyDrift = referenceEnergy != 0.0 ? (totalEnergy - referenceEnergy) / std::abs(referenceEnergy) : 0.0;
+    snapshot.diagnostics = engine.diagnostics;
+    snapshot.ticksPerSecond = measuredRate;
+    snapshot.historyFirst = history.firstStep();
+    snapshot.historyLast = history.lastStep();
+    snapshot.rewound = shownStep >= 0;
+
+    snapshots.publish();
+}
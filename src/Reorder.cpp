@@ -0,0 +1,136 @@
+#include "Octree.h"
+#include "SimulationEngine.h"
+#include <algorithm>
+#include <cmath>
+
+// Morton (Z-order) reordering of the engine's bodies.
+//
+// Keys are the top KEY_BITS bits of mortonKey() (Octree.h) in the bodies'
+// bounding cube, 10 per axis. They are sorted with a stable LSD radix sort,
+// a byte per pass, and the resulting permutation is applied to every column
+// and to the id slot map in one go (BodyStore::permute). All temporaries
+// come from the engine's scratch arena, so a reorder inside step() does not
+// allocate either.
+
+namespace {
+    constexpr int KEY_BITS = 30;
+    constexpr int DIGIT_BITS = 8;
+    constexpr size_t RADIX = size_t(1) << DIGIT_BITS;
+
+    // Key bits for about one body per cell: whole octree levels, 8^levels >= n
+    int cellBits(size_t n) {
+        int bits = 3;
+        while (bits < KEY_BITS && (uint64_t(1) << bits) < n) bits += 3;
+        return bits;
+    }
+}
+
+void SimulationEngine::mortonKeys(uint32_t* keys, int bits) const {
+    const size_t n = bodies.size();
+    if (n == 0) return;
+
+    Bounds bounds;
+    bounds.min = bounds.max = bodies.position(0);
+    for (size_t i = 1; i < n; ++i) {
+        bounds.min = glm::min(bounds.min, bodies.position(i));
+        bounds.max = glm::max(bounds.max, bodies.position(i));
+    }
+    const glm::vec3 extent = bounds.max - bounds.min;
+    float size = std::max(extent.x, std::max(extent.y, extent.z)) * 1.0001f;
+    if (size <= 0.0f) size = 1.0f;
+
+    const int shift = 63 - bits;
+    auto fill = [&](size_t begin, size_t end, unsigned) {
+        for (size_t i = begin; i < end; ++i) keys[i] = uint32_t(mortonKey(bodies.position(i), bounds.min, size) >> shift);
+    };
+    if (runsParallel()) {
+        pool.parallelFor(n, fill);
+    } else {
+        fill(0, n, 0);
+    }
+}
+
+double SimulationEngine::bodyDisorder() const {
+    const size_t n = bodies.size();
+    if (n < 2) return 0.0;
+
+    ScratchArena::Scope scope(scratch);
+    uint32_t* keys = scratch.take<uint32_t>(n);
+    mortonKeys(keys, cellBits(n));
+    size_t descents = 0;
+    for (size_t i = 1; i < n; ++i) descents += keys[i] < keys[i - 1];
+    return double(descents) / double(n - 1);
+}
+
+// Each thread counts and scatters one contiguous slice of every pass, and
+// slices take their places in slice order, so the sort is stable and comes
+// out the same for any thread count
+const uint32_t* SimulationEngine::mortonOrder() {
+    const size_t n = bodies.size();
+    uint32_t* keys = scratch.take<uint32_t>(n);
+    uint32_t* order = scratch.take<uint32_t>(n);
+    uint32_t* keysOut = scratch.take<uint32_t>(n);
+    uint32_t* orderOut = scratch.take<uint32_t>(n);
+    mortonKeys(keys, KEY_BITS);
+    for (size_t i = 0; i < n; ++i) order[i] = uint32_t(i);
+
+    const size_t slices = runsParallel() ? pool.size() : 1;
+    size_t* counts = scratch.take<size_t>(slices * RADIX);
+    for (int shift = 0; shift < KEY_BITS; shift += DIGIT_BITS) {
+        std::fill(counts, counts + slices * RADIX, size_t(0));
+        runTasks(slices, [&](size_t slice, unsigned) {
+            size_t* count = counts + slice * RADIX;
+            for (size_t i = n * slice / slices; i < n * (slice + 1) / slices; ++i) {
+                ++count[(keys[i] >> shift) & (RADIX - 1)];
+            }
+        });
+
+        // Counts become the first position of each slice's run of each digit
+        bool shared = false;
+        size_t at = 0;
+        for (size_t digit = 0; digit < RADIX; ++digit) {
+            size_t total = 0;
+            for (size_t slice = 0; slice < slices; ++slice) {
+                const size_t count = counts[slice * RADIX + digit];
+                counts[slice * RADIX + digit] = at;
+                at += count;
+                total += count;
+            }
+            shared = shared || total == n;
+        }
+        if (shared) continue;     // Every key has this digit: the pass would not move anything
+
+        runTasks(slices, [&](size_t slice, unsigned) {
+            size_t* next = counts + slice * RADIX;
+            for (size_t i = n * slice / slices; i < n * (slice + 1) / slices; ++i) {
+                const size_t to = next[(keys[i] >> shift) & (RADIX - 1)]++;
+                keysOut[to] = keys[i];
+                orderOut[to] = order[i];
+            }
+        });
+        std::swap(keys, keysOut);
+        std::swap(order, orderOut);
+    }
+    return order;
+}
+
+void SimulationEngine::reorderBodies() {
+    if (bodies.size() < 2) return;
+    ScratchArena::Scope scope(scratch);
+    bodies.permute(mortonOrder(), scratch);
+    ++reorderCount;
+}
+
+void SimulationEngine::reorderBodies(std::vector<uint32_t>& order) {
+    const size_t n = bodies.size();
+    order.resize(n);
+    if (n < 2) {
+        for (size_t i = 0; i < n; ++i) order[i] = uint32_t(i);
+        return;
+    }
+    ScratchArena::Scope scope(scratch);
+    const uint32_t* sorted = mortonOrder();
+    std::copy(sorted, sorted + n, order.begin());
+    bodies.permute(order.data(), scratch);
+    ++reorderCount;
+}
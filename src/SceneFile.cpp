@@ -0,0 +1,183 @@
+#include "MappedFile.h"
+#include "SimulationEngine.h"
+#include <algorithm>
+#include <charconv>
+#include <iostream>
+#include <string>
+
+// SimulationEngine::loadScene lives here, next to the format it reads.
+//
+// Text scenes hold one body per line:
+//
+//   mass density x y z vx vy vz [r g b [a]] [name]
+//
+// Fields are separated by spaces, tabs or commas, so both whitespace tables
+// and CSV work. The name is everything from the first field that is not a
+// number to the end of the line, without surrounding quotes. '#' starts a
+// comment, and a first line without numbers is taken as a column header.
+// Masses must not be negative and densities must be positive.
+//
+// The file is mapped and cut into blocks of whole lines, which the engine's
+// threads parse with std::from_chars into per-block arrays. The bodies are
+// then copied into freshly sized columns in one batch.
+
+namespace {
+    constexpr size_t VALUES_PER_BODY = 12;      // mass density x y z vx vy vz r g b a
+    constexpr size_t MIN_BLOCK_BYTES = 1 << 16;
+
+    struct Block {
+        const char* begin = nullptr;
+        const char* end = nullptr;
+        std::vector<float> values;
+        std::vector<std::pair<size_t, std::string>> names;     // Body within the block, name
+        size_t lines = 0;
+        size_t errorLine = 0;       // Within the block, 1-based; 0 when it parsed
+        std::string error;
+
+        size_t bodies() const { return values.size() / VALUES_PER_BODY; }
+    };
+
+    bool isSeparator(char c) { return c == ' ' || c == '\t' || c == ',' || c == '\r'; }
+
+    std::string trimmedName(const char* begin, const char* end) {
+        while (end > begin && isSeparator(end[-1])) --end;
+        if (end - begin >= 2 && (*begin == '"' || *begin == '\'') && end[-1] == *begin) {
+            ++begin;
+            --end;
+        }
+        return std::string(begin, end);
+    }
+
+    void parseBlock(Block& block, bool allowHeader) {
+        float row[VALUES_PER_BODY];
+        bool sawContent = false;
+        for (const char* line = block.begin; line < block.end;) {
+            const char* lineEnd = std::find(line, block.end, '\n');
+            ++block.lines;
+
+            size_t count = 0;
+            const char* nameBegin = nullptr;
+            const char* p = line;
+            while (p < lineEnd) {
+                while (p < lineEnd && isSeparator(*p)) ++p;
+                if (p == lineEnd || *p == '#') break;
+
+                const char* start = *p == '+' ? p + 1 : p;
+                float value;
+                const auto result = std::from_chars(start, lineEnd, value);
+                const bool number = result.ec == std::errc() &&
+                                    (result.ptr == lineEnd || isSeparator(*result.ptr) || *result.ptr == '#');
+                if (!number || count == VALUES_PER_BODY) {
+                    nameBegin = p;
+                    break;
+                }
+                row[count++] = value;
+                p = result.ptr;
+            }
+
+            const bool blank = count == 0 && !nameBegin;
+            if (!blank) {
+                const bool header = count == 0 && allowHeader && !sawContent;
+                sawContent = true;
+                if (!header) {
+                    if (count != 8 && count != 11 && count != 12) {
+                        block.errorLine = block.lines;
+                        block.error = "expected mass density x y z vx vy vz [r g b [a]] [name], found " +
+                                      std::to_string(count) + " numbers";
+                        return;
+                    }
+                    // Negated so NaN fails too; a zero density has no radius
+                    if (!(row[0] >= 0.0f) || !(row[1] > 0.0f)) {
+                        block.errorLine = block.lines;
+                        block.error = row[0] >= 0.0f ? "density must be positive" : "mass must not be negative";
+                        return;
+                    }
+                    if (count == 8) std::fill(row + 8, row + 12, 1.0f);
+                    if (count == 11) row[11] = 1.0f;
+                    if (nameBegin) block.names.emplace_back(block.bodies(), trimmedName(nameBegin, lineEnd));
+                    block.values.insert(block.values.end(), row, row + VALUES_PER_BODY);
+                }
+            }
+            line = lineEnd + 1;
+        }
+    }
+}
+
+bool SimulationEngine::loadScene(const std::string& filename) {
+    MappedFile file;
+    if (!file.open(filename)) return false;
+    const char* text = reinterpret_cast<const char*>(file.data());
+    const size_t size = file.size();
+
+    // Blocks end after a newline, so no line is split between two of them
+    const size_t wanted = std::max<size_t>(1, std::min<size_t>(size_t(pool.size()) * 4, size / MIN_BLOCK_BYTES));
+    std::vector<Block> blocks;
+    const char* cursor = text;
+    for (size_t b = 0; b < wanted && cursor < text + size; ++b) {
+        const char* end = b + 1 == wanted ? text + size : text + size * (b + 1) / wanted;
+        end = std::max(end, cursor);
+        end = end < text + size ? std::find(end, text + size, '\n') : end;
+        if (end < text + size) ++end;
+        Block block;
+        block.begin = cursor;
+        block.end = end;
+        blocks.push_back(std::move(block));
+        cursor = end;
+    }
+
+    pool.run(blocks.size(), [&](size_t b, unsigned) { parseBlock(blocks[b], b == 0); });
+
+    size_t line = 0;
+    std::vector<size_t> firstBody(blocks.size() + 1, 0);
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        if (blocks[b].errorLine) {
+            std::cerr << filename << ":" << line + blocks[b].errorLine << ": " << blocks[b].error << std::endl;
+            return false;
+        }
+        line += blocks[b].lines;
+        firstBody[b + 1] = firstBody[b] + blocks[b].bodies();
+    }
+    const size_t n = firstBody.back();
+
+    BodyStore loaded;
+    for (auto* column : {&loaded.px, &loaded.py, &loaded.pz, &loaded.vx, &loaded.vy, &loaded.vz, &loaded.ax,
+                         &loaded.ay, &loaded.az, &loaded.mass, &loaded.density, &loaded.radius}) {
+        column->resize(n);
+    }
+    loaded.color.resize(n);
+    loaded.glow.resize(n);
+    loaded.id.resize(n);
+
+    pool.run(blocks.size(), [&](size_t b, unsigned) {
+        const float* v = blocks[b].values.data();
+        for (size_t i = firstBody[b]; i < firstBody[b + 1]; ++i, v += VALUES_PER_BODY) {
+            loaded.mass[i] = v[0];
+            loaded.density[i] = v[1];
+            loaded.px[i] = v[2];
+            loaded.py[i] = v[3];
+            loaded.pz[i] = v[4];
+            loaded.vx[i] = v[5];
+            loaded.vy[i] = v[6];
+            loaded.vz[i] = v[7];
+            loaded.color[i] = glm::vec4(v[8], v[9], v[10], v[11]);
+            loaded.radius[i] = BodyStore::computeRadius(v[0], v[1]);
+            loaded.id[i] = uint64_t(i) + 1;
+        }
+    });
+
+    size_t nameCount = 0;
+    for (const Block& block : blocks) nameCount += block.names.size();
+    loaded.names.reserve(nameCount);
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        for (auto& named : blocks[b].names) {
+            loaded.names.emplace(uint64_t(firstBody[b] + named.first) + 1, std::move(named.second));
+        }
+    }
+
+    loaded.nextId = uint64_t(n) + 1;
+    loaded.topologyVersion = bodies.topologyVersion + 1;
+    bodies = std::move(loaded);
+    particles.clear();
+    stepCount = 0;
+    return true;
+}
@@ -0,0 +1,787 @@
+#include "SimulationEngine.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <random>
+
+// ---------------------------------------------------------------------------
+// BodyStore
+// ---------------------------------------------------------------------------
+
+namespace {
+    constexpr uint32_t FREE_SLOT = UINT32_MAX;
+    constexpr uint64_t SLOT_MASK = 0xFFFFFFFFull;
+}
+
+size_t BodyStore::add(const glm::vec3& pos, const glm::vec3& vel, float m, float d,
+                      const glm::vec4& c, bool isGlowing) {
+    // Before any column grows, so a rebuild of the slots sees a consistent store
+    const uint64_t bodyId = issueId(uint32_t(size()));
+    px.push_back(pos.x); py.push_back(pos.y); pz.push_back(pos.z);
+    vx.push_back(vel.x); vy.push_back(vel.y); vz.push_back(vel.z);
+    ax.push_back(0.0f);  ay.push_back(0.0f);  az.push_back(0.0f);
+    mass.push_back(m);
+    density.push_back(d);
+    radius.push_back(computeRadius(m, d));
+    color.push_back(c);
+    glow.push_back(isGlowing ? 1 : 0);
+    id.push_back(bodyId);
+    ++topologyVersion;
+    slotsVersion = topologyVersion;
+    return size() - 1;
+}
+
+// The smallest id from nextId on whose low bits are the lowest free slot
+uint64_t BodyStore::issueId(uint32_t index) {
+    ensureSlots();
+    if (!slotted) return nextId++;
+
+    uint32_t slot;
+    if (!freeSlots.empty()) {
+        std::pop_heap(freeSlots.begin(), freeSlots.end(), std::greater<uint32_t>());
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+    } else {
+        if (slotIndex.empty()) slotIndex.push_back(FREE_SLOT);
+        slot = uint32_t(slotIndex.size());
+        slotIndex.push_back(FREE_SLOT);
+    }
+    slotIndex[slot] = index;
+
+    uint64_t value = (nextId & ~SLOT_MASK) | slot;
+    if (value < nextId) value += SLOT_MASK + 1;
+    nextId = value + 1;
+    return value;
+}
+
+void BodyStore::ensureSlots() const {
+    if (slotsVersion == topologyVersion) return;
+    slotsVersion = topologyVersion;
+    slotIndex.clear();
+    freeSlots.clear();
+
+    const size_t n = size();
+    uint64_t largest = 0;
+    for (size_t i = 0; i < n; ++i) largest = std::max(largest, id[i] & SLOT_MASK);
+    // Foreign ids can name any slot; do not let them blow up the table
+    slotted = largest < std::max<uint64_t>(4 * uint64_t(n), uint64_t(1) << 16);
+    if (slotted) {
+        slotIndex.assign(size_t(largest) + 1, FREE_SLOT);
+        for (size_t i = 0; i < n && slotted; ++i) {
+            const uint64_t slot = id[i] & SLOT_MASK;
+            slotted = slot != 0 && slotIndex[slot] == FREE_SLOT;
+            slotIndex[slot] = uint32_t(i);
+        }
+    }
+    if (!slotted) {
+        slotIndex.clear();
+        return;
+    }
+    for (uint32_t slot = 1; slot < slotIndex.size(); ++slot) {
+        if (slotIndex[slot] == FREE_SLOT) freeSlots.push_back(slot);
+    }
+    std::make_heap(freeSlots.begin(), freeSlots.end(), std::greater<uint32_t>());
+}
+
+size_t BodyStore::indexOf(uint64_t bodyId) const {
+    ensureSlots();
+    if (!slotted) {
+        for (size_t i = 0; i < size(); ++i) {
+            if (id[i] == bodyId) return i;
+        }
+        return npos;
+    }
+    const uint64_t slot = bodyId & SLOT_MASK;
+    if (slot >= slotIndex.size() || slotIndex[slot] == FREE_SLOT) return npos;
+    const size_t index = slotIndex[slot];
+    return id[index] == bodyId ? index : npos;
+}
+
+void BodyStore::reserve(size_t n) {
+    for (auto* column : {&px, &py, &pz, &vx, &vy, &vz, &ax, &ay, &az, &mass, &density, &radius}) {
+        column->reserve(n);
+    }
+    color.reserve(n);
+    glow.reserve(n);
+    id.reserve(n);
+}
+
+size_t BodyStore::append(size_t count) {
+    const size_t first = size();
+    id.reserve(first + count);
+    // Ids first, while the slot map still matches the columns
+    for (size_t i = 0; i < count; ++i) id.push_back(issueId(uint32_t(first + i)));
+    for (auto* column : {&px, &py, &pz, &vx, &vy, &vz, &ax, &ay, &az, &mass, &density, &radius}) {
+        column->resize(first + count, 0.0f);
+    }
+    color.resize(first + count, glm::vec4(1.0f));
+    glow.resize(first + count, 0);
+    ++topologyVersion;
+    slotsVersion = topologyVersion;
+    return first;
+}
+
+void BodyStore::clear() {
+    for (auto* column : {&px, &py, &pz, &vx, &vy, &vz, &ax, &ay, &az, &mass, &density, &radius}) {
+        column->clear();
+    }
+    color.clear();
+    glow.clear();
+    id.clear();
+    names.clear();
+    ++topologyVersion;
+    // Callers may refill the columns directly, so the map is rebuilt on next use
+    slotsVersion = UINT64_MAX;
+}
+
+namespace {
+    template <typename Column>
+    void compactColumn(Column& column, const std::vector<uint8_t>& flagged) {
+        size_t kept = 0;
+        for (size_t i = 0; i < column.size(); ++i) {
+            if (!flagged[i]) column[kept++] = column[i];
+        }
+        column.resize(kept);
+    }
+
+    template <typename Column>
+    void gatherColumn(Column& column, const uint32_t* order, ScratchArena& scratch) {
+        using T = typename Column::value_type;
+        ScratchArena::Scope scope(scratch);
+        const size_t n = column.size();
+        T* moved = scratch.take<T>(n);
+        for (size_t i = 0; i < n; ++i) moved[i] = column[order[i]];
+        std::copy(moved, moved + n, column.data());
+    }
+}
+
+void BodyStore::removeFlagged(const std::vector<uint8_t>& flagged) {
+    ensureSlots();
+    if (slotted) {
+        for (size_t i = 0, kept = 0; i < size(); ++i) {
+            const uint32_t slot = uint32_t(id[i] & SLOT_MASK);
+            if (flagged[i]) {
+                slotIndex[slot] = FREE_SLOT;
+                freeSlots.push_back(slot);
+                std::push_heap(freeSlots.begin(), freeSlots.end(), std::greater<uint32_t>());
+            } else {
+                slotIndex[slot] = uint32_t(kept++);
+            }
+        }
+    }
+    if (!names.empty()) {
+        for (size_t i = 0; i < size(); ++i) {
+            if (flagged[i]) names.erase(id[i]);
+        }
+    }
+    for (auto* column : {&px, &py, &pz, &vx, &vy, &vz, &ax, &ay, &az, &mass, &density, &radius}) {
+        compactColumn(*column, flagged);
+    }
+    compactColumn(color, flagged);
+    compactColumn(glow, flagged);
+    compactColumn(id, flagged);
+    ++topologyVersion;
+    slotsVersion = topologyVersion;
+}
+
+void BodyStore::permute(const uint32_t* order, ScratchArena& scratch) {
+    ensureSlots();
+    for (auto* column : {&px, &py, &pz, &vx, &vy, &vz, &ax, &ay, &az, &mass, &density, &radius}) {
+        gatherColumn(*column, order, scratch);
+    }
+    gatherColumn(color, order, scratch);
+    gatherColumn(glow, order, scratch);
+    gatherColumn(id, order, scratch);
+    if (slotted) {
+        for (size_t i = 0; i < size(); ++i) slotIndex[id[i] & SLOT_MASK] = uint32_t(i);
+    }
+    ++topologyVersion;
+    slotsVersion = topologyVersion;
+}
+
+uint64_t BodyStore::hash() const {
+    uint64_t value = 1469598103934665603ull;
+    for (const auto* column : {&px, &py, &pz, &vx, &vy, &vz}) {
+        const auto* bytes = reinterpret_cast<const unsigned char*>(column->data());
+        for (size_t i = 0; i < column->size() * sizeof(float); ++i) {
+            value = (value ^ bytes[i]) * 1099511628211ull;
+        }
+    }
+    return value;
+}
+
+float BodyStore::computeRadius(float mass, float density) {
+    return std::pow(((3 * mass / density) / (4 * 3.14159265359f)), (1.0f / 3.0f)) / Physics::SIZE_RATIO;
+}
+
+// ---------------------------------------------------------------------------
+// SimulationCommand
+// ---------------------------------------------------------------------------
+
+SimulationCommand SimulationCommand::addBody(const glm::vec3& pos, const glm::vec3& vel, float mass, float density,
+                                             const glm::vec4& color, bool isGlowing) {
+    SimulationCommand command;
+    command.type = Type::AddBody;
+    command.position = pos;
+    command.velocity = vel;
+    command.mass = mass;
+    command.density = density;
+    command.color = color;
+    command.flag = isGlowing;
+    return command;
+}
+
+SimulationCommand SimulationCommand::removeBody(uint64_t id) {
+    SimulationCommand command;
+    command.type = Type::RemoveBody;
+    command.bodyId = id;
+    return command;
+}
+
+SimulationCommand SimulationCommand::loadPreset(SimulationPreset preset) {
+    SimulationCommand command;
+    command.type = Type::LoadPreset;
+    command.preset = preset;
+    return command;
+}
+
+SimulationCommand SimulationCommand::setPaused(bool paused) {
+    SimulationCommand command;
+    command.type = Type::SetPaused;
+    command.flag = paused;
+    return command;
+}
+
+SimulationCommand SimulationCommand::setTimeScale(float scale) {
+    SimulationCommand command;
+    command.type = Type::SetTimeScale;
+    command.value = scale;
+    return command;
+}
+
+SimulationCommand SimulationCommand::setDeterministic(bool enabled) {
+    SimulationCommand command;
+    command.type = Type::SetDeterministic;
+    command.flag = enabled;
+    return command;
+}
+
+SimulationCommand SimulationCommand::addRing(uint64_t centreId, uint32_t count, float innerRadius, float outerRadius) {
+    SimulationCommand command;
+    command.type = Type::AddRing;
+    command.bodyId = centreId;
+    command.count = count;
+    command.position = glm::vec3(innerRadius, outerRadius, 0.0f);
+    return command;
+}
+
+SimulationCommand SimulationCommand::clearParticles() {
+    SimulationCommand command;
+    command.type = Type::ClearParticles;
+    return command;
+}
+
+// ---------------------------------------------------------------------------
+// SimulationEngine
+// ---------------------------------------------------------------------------
+
+SimulationEngine::SimulationEngine(unsigned threadCount) : pool(threadCount) {}
+
+void SimulationEngine::setThreadCount(unsigned threadCount) {
+    pool.resize(threadCount);
+}
+
+void SimulationEngine::clearBodies() {
+    bodies.clear();
+    particles.clear();
+    stepCount = 0;
+}
+
+void SimulationEngine::removeBody(uint64_t id) {
+    const size_t index = bodies.indexOf(id);
+    if (index == BodyStore::npos) return;
+    removalFlags.assign(bodies.size(), 0);
+    removalFlags[index] = 1;
+    bodies.removeFlagged(removalFlags);
+}
+
+void SimulationEngine::loadPreset(SimulationPreset preset) {
+    switch (preset) {
+        case SimulationPreset::SOLAR_SYSTEM: Presets::loadSolarSystem(*this); break;
+        case SimulationPreset::BINARY_STARS: Presets::loadBinaryStars(*this); break;
+        case SimulationPreset::GALAXY_COLLISION: Presets::loadGalaxyCollision(*this); break;
+        case SimulationPreset::EMPTY:        clearBodies(); break;
+        default:
+            std::cerr << "Preset not available without a scene file" << std::endl;
+            break;
+    }
+}
+
+void SimulationEngine::applyCommands(const SimulationCommand* commands, size_t count) {
+    using Type = SimulationCommand::Type;
+
+    size_t additions = 0;
+    for (size_t c = 0; c < count; ++c) {
+        if (commands[c].type == Type::AddBody) ++additions;
+    }
+    if (additions) bodies.reserve(bodies.size() + additions);
+
+    bool pendingRemovals = false;
+    auto flushRemovals = [&] {
+        if (pendingRemovals) bodies.removeFlagged(removalFlags);
+        pendingRemovals = false;
+    };
+
+    for (size_t c = 0; c < count; ++c) {
+        const SimulationCommand& command = commands[c];
+        switch (command.type) {
+            case Type::AddBody:
+                flushRemovals();
+                bodies.add(command.position, command.velocity, command.mass, command.density,
+                           command.color, command.flag);
+                break;
+            case Type::RemoveBody: {
+                const size_t index = bodies.indexOf(command.bodyId);
+                if (index == BodyStore::npos) break;
+                if (!pendingRemovals) removalFlags.assign(bodies.size(), 0);
+                removalFlags[index] = 1;
+                pendingRemovals = true;
+                break;
+            }
+            case Type::LoadPreset:
+                pendingRemovals = false;
+                loadPreset(command.preset);
+                break;
+            case Type::SetPaused:
+                isPaused = command.flag;
+                break;
+            case Type::SetTimeScale:
+                timeScale = command.value;
+                break;
+            case Type::SetDeterministic:
+                deterministic = command.flag;
+                break;
+            case Type::AddRing: {
+                flushRemovals();
+                const size_t centre = bodies.indexOf(command.bodyId);
+                if (centre == BodyStore::npos) break;
+                // Seeded by the centre, the step and the particles so far, all of which a
+                // replayed journal reproduces; the count keeps same-step rings apart
+                addRing(centre, command.count, command.position.x, command.position.y,
+                        (command.bodyId * 0x9E3779B97F4A7C15ull + stepCount) * 0xBF58476D1CE4E5B9ull +
+                            particles.size());
+                break;
+            }
+            case Type::ClearParticles:
+                particles.clear();
+                break;
+        }
+    }
+    flushRemovals();
+}
+
+void SimulationEngine::runTasks(size_t taskCount, const ThreadPool::Task& fn) const {
+    if (runsParallel()) {
+        pool.run(taskCount, fn);
+    } else {
+        for (size_t t = 0; t < taskCount; ++t) fn(t, 0);
+    }
+}
+
+void SimulationEngine::step() {
+    if (reorderInterval > 0 && stepCount % reorderInterval == 0 && bodies.size() > 1 &&
+        bodyDisorder() > reorderThreshold) {
+        reorderBodies();
+    }
+    calculateGravitationalForces();
+    stepParticles();
+    integrate(overlaps, trackDiagnostics ? &potential : nullptr);
+    ++stepCount;
+}
+
+void SimulationEngine::calculateGravitationalForces() {
+    const auto start = std::chrono::steady_clock::now();
+    const size_t n = bodies.size();
+    overlaps.assign(n, 0);
+
+    if (trackDiagnostics) {
+        potential.assign(n, 0.0);
+        if (deterministic) {
+            forcesDeterministic<true>();
+        } else if (runsParallel()) {
+            forcesSymmetricParallel<true>();
+        } else {
+            forcesSymmetricSerial<true>();
+        }
+    } else if (deterministic) {
+        forcesDeterministic<false>();
+    } else if (runsParallel()) {
+        forcesSymmetricParallel<false>();
+    } else {
+        forcesSymmetricSerial<false>();
+    }
+    applyExternalField();
+
+    lastForceMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Visits each pair once and applies the force to both bodies
+template <bool Potential>
+void SimulationEngine::forcesSymmetricSerial() {
+    const size_t n = bodies.size();
+    const float G = gravitationalConstant;
+    const float* px = bodies.px.data(); const float* py = bodies.py.data(); const float* pz = bodies.pz.data();
+    const float* m = bodies.mass.data(); const float* r = bodies.radius.data();
+    float* ax = bodies.ax.data(); float* ay = bodies.ay.data(); float* az = bodies.az.data();
+    double* phi = potential.data();
+
+    std::fill(bodies.ax.begin(), bodies.ax.end(), 0.0f);
+    std::fill(bodies.ay.begin(), bodies.ay.end(), 0.0f);
+    std::fill(bodies.az.begin(), bodies.az.end(), 0.0f);
+
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t j = i + 1; j < n; ++j) {
+            const float dx = px[j] - px[i], dy = py[j] - py[i], dz = pz[j] - pz[i];
+            const float dist = std::sqrt(dx * dx + dy * dy + dz * dz);
+            if (dist <= 0.0f) continue;
+
+            const float distM = dist * Physics::METERS_PER_UNIT;
+            const float s = G / (distM * distM) / dist;
+            ax[i] += dx * s * m[j]; ay[i] += dy * s * m[j]; az[i] += dz * s * m[j];
+            ax[j] -= dx * s * m[i]; ay[j] -= dy * s * m[i]; az[j] -= dz * s * m[i];
+            if constexpr (Potential) {
+                const double g = s * dist * distM;  // G / r
+                phi[i] -= g * m[j];
+                phi[j] -= g * m[i];
+            }
+
+            if (r[i] + r[j] > dist) {
+                ++overlaps[i];
+                ++overlaps[j];
+            }
+        }
+    }
+}
+
+// Symmetric pass with per-worker accumulators. Row blocks are scheduled
+// dynamically, so the summation order depends on thread count and timing.
+template <bool Potential>
+void SimulationEngine::forcesSymmetricParallel() {
+    const size_t n = bodies.size();
+    const unsigned workers = pool.size();
+    const float G = gravitationalConstant;
+    const float* px = bodies.px.data(); const float* py = bodies.py.data(); const float* pz = bodies.pz.data();
+    const float* m = bodies.mass.data(); const float* r = bodies.radius.data();
+
+    ScratchArena::Scope scope(scratch);
+    float* workerAcc = scratch.take<float>(size_t(workers) * n * 3, 0.0f);
+    uint32_t* workerOverlaps = scratch.take<uint32_t>(size_t(workers) * n, 0u);
+    double* workerPotential = Potential ? scratch.take<double>(size_t(workers) * n, 0.0) : nullptr;
+
+    const size_t blocks = (n + REDUCTION_BLOCK - 1) / REDUCTION_BLOCK;
+    pool.run(blocks, [&](size_t block, unsigned worker) {
+        float* ax = workerAcc + size_t(worker) * n * 3;
+        float* ay = ax + n;
+        float* az = ay + n;
+        uint32_t* hits = workerOverlaps + size_t(worker) * n;
+        double* phi = Potential ? workerPotential + size_t(worker) * n : nullptr;
+
+        const size_t end = std::min(n, (block + 1) * REDUCTION_BLOCK);
+        for (size_t i = block * REDUCTION_BLOCK; i < end; ++i) {
+            for (size_t j = i + 1; j < n; ++j) {
+                const float dx = px[j] - px[i], dy = py[j] - py[i], dz = pz[j] - pz[i];
+                const float dist = std::sqrt(dx * dx + dy * dy + dz * dz);
+                if (dist <= 0.0f) continue;
+
+                const float distM = dist * Physics::METERS_PER_UNIT;
+                const float s = G / (distM * distM) / dist;
+                ax[i] += dx * s * m[j]; ay[i] += dy * s * m[j]; az[i] += dz * s * m[j];
+                ax[j] -= dx * s * m[i]; ay[j] -= dy * s * m[i]; az[j] -= dz * s * m[i];
+                if constexpr (Potential) {
+                    const double g = s * dist * distM;
+                    phi[i] -= g * m[j];
+                    phi[j] -= g * m[i];
+                }
+
+                if (r[i] + r[j] > dist) {
+                    ++hits[i];
+                    ++hits[j];
+                }
+            }
+        }
+    });
+
+    pool.parallelFor(n, [&](size_t begin, size_t end, unsigned) {
+        for (size_t i = begin; i < end; ++i) {
+            float sx = 0.0f, sy = 0.0f, sz = 0.0f;
+            uint32_t hits = 0;
+            for (unsigned w = 0; w < workers; ++w) {
+                const float* acc = workerAcc + size_t(w) * n * 3;
+                sx += acc[i]; sy += acc[n + i]; sz += acc[2 * n + i];
+                hits += workerOverlaps[size_t(w) * n + i];
+            }
+            bodies.ax[i] = sx; bodies.ay[i] = sy; bodies.az[i] = sz;
+            overlaps[i] = hits;
+            if constexpr (Potential) {
+                double sum = 0.0;
+                for (unsigned w = 0; w < workers; ++w) sum += workerPotential[size_t(w) * n + i];
+                potential[i] = sum;
+            }
+        }
+    });
+}
+
+// Every row owns its result and sums its partners in ascending index order,
+// so no partial sums ever cross a thread boundary
+template <bool Potential>
+void SimulationEngine::forcesDeterministic() {
+    const size_t n = bodies.size();
+    const float G = gravitationalConstant;
+    const float* px = bodies.px.data(); const float* py = bodies.py.data(); const float* pz = bodies.pz.data();
+    const float* m = bodies.mass.data(); const float* r = bodies.radius.data();
+
+    const size_t blocks = (n + REDUCTION_BLOCK - 1) / REDUCTION_BLOCK;
+    runTasks(blocks, [&](size_t block, unsigned) {
+        const size_t end = std::min(n, (block + 1) * REDUCTION_BLOCK);
+        for (size_t i = block * REDUCTION_BLOCK; i < end; ++i) {
+            float sx = 0.0f, sy = 0.0f, sz = 0.0f;
+            double phi = 0.0;
+            uint32_t hits = 0;
+            for (size_t j = 0; j < n; ++j) {
+                const float dx = px[j] - px[i], dy = py[j] - py[i], dz = pz[j] - pz[i];
+                const float dist = std::sqrt(dx * dx + dy * dy + dz * dz);
+                if (dist <= 0.0f) continue;
+
+                const float distM = dist * Physics::METERS_PER_UNIT;
+                const float s = G / (distM * distM) / dist * m[j];
+                sx += dx * s; sy += dy * s; sz += dz * s;
+                if constexpr (Potential) phi -= double(s) * dist * distM;
+                if (r[i] + r[j] > dist) ++hits;
+            }
+            bodies.ax[i] = sx; bodies.ay[i] = sy; bodies.az[i] = sz;
+            overlaps[i] = hits;
+            if constexpr (Potential) potential[i] = phi;
+        }
+    });
+}
+
+void SimulationEngine::integrate(const std::vector<uint32_t>& overlapCounts, const std::vector<double>* potentials) {
+    const size_t n = bodies.size();
+    const float kick = timeScale / Physics::ACCELERATION_DAMPING;
+    const float drift = timeScale / Physics::TIME_SCALE;
+
+    const size_t blocks = (n + REDUCTION_BLOCK - 1) / REDUCTION_BLOCK;
+    const bool measure = trackDiagnostics;
+    const double* phi = potentials && potentials->size() == n ? potentials->data() : nullptr;
+    ScratchArena::Scope scope(scratch);
+    Diagnostics* diagnosticBlocks = measure ? scratch.take<Diagnostics>(blocks, Diagnostics()) : nullptr;
+
+    runTasks(blocks, [&](size_t block, unsigned) {
+        const size_t end = std::min(n, (block + 1) * REDUCTION_BLOCK);
+        for (size_t i = block * REDUCTION_BLOCK; i < end; ++i) {
+            if (measure) {
+                // The state before this step's kick, matching the potential
+                Diagnostics& d = diagnosticBlocks[block];
+                const double m = bodies.mass[i];
+                const glm::dvec3 v(bodies.vx[i], bodies.vy[i], bodies.vz[i]);
+                const glm::dvec3 p(bodies.px[i], bodies.py[i], bodies.pz[i]);
+                d.mass += m;
+                d.kinetic += 0.5 * m * glm::dot(v, v);
+                if (phi) d.potential += 0.5 * m * phi[i];
+                d.momentum += m * v;
+                d.angularMomentum += m * glm::cross(p * double(Physics::METERS_PER_UNIT), v);
+                d.centerOfMass += m * p;
+            }
+
+            bodies.vx[i] += bodies.ax[i] * kick;
+            bodies.vy[i] += bodies.ay[i] * kick;
+            bodies.vz[i] += bodies.az[i] * kick;
+
+            if (enableCollisions) {
+                for (uint32_t k = 0; k < overlapCounts[i]; ++k) {
+                    bodies.vx[i] *= Physics::COLLISION_RESTITUTION;
+                    bodies.vy[i] *= Physics::COLLISION_RESTITUTION;
+                    bodies.vz[i] *= Physics::COLLISION_RESTITUTION;
+                }
+            }
+
+            bodies.px[i] += bodies.vx[i] * drift;
+            bodies.py[i] += bodies.vy[i] * drift;
+            bodies.pz[i] += bodies.vz[i] * drift;
+        }
+    });
+
+    if (measure) {
+        Diagnostics total;
+        for (size_t block = 0; block < blocks; ++block) {
+            const Diagnostics& d = diagnosticBlocks[block];
+            total.mass += d.mass;
+            total.kinetic += d.kinetic;
+            total.potential += d.potential;
+            total.momentum += d.momentum;
+            total.angularMomentum += d.angularMomentum;
+            total.centerOfMass += d.centerOfMass;
+        }
+        if (total.mass > 0.0) total.centerOfMass /= total.mass;
+        total.step = stepCount;
+        total.valid = true;
+        diagnostics = total;
+    }
+}
+
+// Kinetic plus pairwise and external potential energy, in SI with velocities as stored
+double SimulationEngine::getTotalEnergy() const {
+    const size_t n = bodies.size();
+    const double G = gravitationalConstant;
+    const size_t blocks = (n + REDUCTION_BLOCK - 1) / REDUCTION_BLOCK;
+
+    auto rowEnergy = [&](size_t i) {
+        const double v2 = double(bodies.vx[i]) * bodies.vx[i] + double(bodies.vy[i]) * bodies.vy[i] +
+                          double(bodies.vz[i]) * bodies.vz[i];
+        double e = 0.5 * bodies.mass[i] * v2;
+        if (!externalField.empty()) e += bodies.mass[i] * externalPotential(bodies.position(i));
+        for (size_t j = i + 1; j < n; ++j) {
+            const double dx = double(bodies.px[j]) - bodies.px[i];
+            const double dy = double(bodies.py[j]) - bodies.py[i];
+            const double dz = double(bodies.pz[j]) - bodies.pz[i];
+            const double dist = std::sqrt(dx * dx + dy * dy + dz * dz) * Physics::METERS_PER_UNIT;
+            if (dist > 0.0) e -= G * bodies.mass[i] * bodies.mass[j] / dist;
+        }
+        return e;
+    };
+
+    ScratchArena::Scope scope(scratch);
+    if (!deterministic) {
+        // One running sum per worker: cheap, but the result depends on the schedule
+        double* workerSums = scratch.take<double>(pool.size(), 0.0);
+        runTasks(blocks, [&](size_t block, unsigned worker) {
+            const size_t end = std::min(n, (block + 1) * REDUCTION_BLOCK);
+            for (size_t i = block * REDUCTION_BLOCK; i < end; ++i) workerSums[worker] += rowEnergy(i);
+        });
+        double total = 0.0;
+        for (unsigned w = 0; w < pool.size(); ++w) total += workerSums[w];
+        return total;
+    }
+
+    // One partial per fixed block, then a pairwise tree over the blocks in index order
+    double* blockSums = scratch.take<double>(blocks, 0.0);
+    runTasks(blocks, [&](size_t block, unsigned) {
+        const size_t end = std::min(n, (block + 1) * REDUCTION_BLOCK);
+        double sum = 0.0;
+        for (size_t i = block * REDUCTION_BLOCK; i < end; ++i) sum += rowEnergy(i);
+        blockSums[block] = sum;
+    });
+    for (size_t width = 1; width < blocks; width *= 2) {
+        for (size_t b = 0; b + width < blocks; b += 2 * width) {
+            blockSums[b] += blockSums[b + width];
+        }
+    }
+    return blocks ? blockSums[0] : 0.0;
+}
+
+glm::vec3 SimulationEngine::calculateCenterOfMass() const {
+    double totalMass = 0.0, cx = 0.0, cy = 0.0, cz = 0.0;
+    for (size_t i = 0; i < bodies.size(); ++i) {
+        totalMass += bodies.mass[i];
+        cx += double(bodies.mass[i]) * bodies.px[i];
+        cy += double(bodies.mass[i]) * bodies.py[i];
+        cz += double(bodies.mass[i]) * bodies.pz[i];
+    }
+    if (totalMass <= 0.0) return glm::vec3(0.0f);
+    return glm::vec3(float(cx / totalMass), float(cy / totalMass), float(cz / totalMass));
+}
+
+double SimulationEngine::sceneGravitationalConstant() const {
+    return double(gravitationalConstant) /
+           (double(Physics::METERS_PER_UNIT) * Physics::METERS_PER_UNIT * Physics::TIME_SCALE * Physics::ACCELERATION_DAMPING);
+}
+
+// Positions only change through step(), loads and edits that also move
+// the step count or topology version, so those two identify the state
+const SpatialIndex& SimulationEngine::spatialIndex() {
+    if (indexStep != stepCount || indexTopology != bodies.topologyVersion || index.size() != bodies.size()) {
+        index.build(bodies.px.data(), bodies.py.data(), bodies.pz.data(), bodies.radius.data(), bodies.size());
+        indexStep = stepCount;
+        indexTopology = bodies.topologyVersion;
+    }
+    return index;
+}
+
+void SimulationEngine::getBodiesInRadius(const glm::vec3& centre, float radius, std::vector<uint32_t>& out) {
+    out.clear();
+    spatialIndex().radius(centre, radius, out);
+}
+
+// ---------------------------------------------------------------------------
+// Presets
+// ---------------------------------------------------------------------------
+
+void Presets::loadSolarSystem(SimulationEngine& engine) {
+    BodyStore& b = engine.bodies;
+    engine.clearBodies();
+
+    const float earthMass = static_cast<float>(5.97219 * std::pow(10, 23));
+    const float giantMass = static_cast<float>(5.97219 * std::pow(10, 23.5));
+    const float moonMass  = static_cast<float>(5.97219 * std::pow(10, 21));
+    const glm::vec4 white(1.0f, 1.0f, 1.0f, 1.0f);
+
+    // Sun
+    b.add(glm::vec3(0, 0, 0), glm::vec3(0, 0, 0), static_cast<float>(1.989 * std::pow(10, 25)), 1414, glm::vec4(1.0f, 0.929f, 0.176f, 1.0f), true);
+
+    // Mars
+    b.add(glm::vec3(-3000, 650, 0), glm::vec3(0, 0, 500), earthMass, 5515, glm::vec4(1.0f, 0.25f, 0.56f, 1.0f));
+
+    // Earth
+    b.add(glm::vec3(5000, 650, 0), glm::vec3(0, 0, -500), earthMass, 5515, glm::vec4(0.0f, 1.0f, 1.0f, 1.0f));
+
+    // Moon
+    b.add(glm::vec3(5250, 650, 0), glm::vec3(0, 0, -50), moonMass, 5515, white);
+
+    // Jupiter
+    b.add(glm::vec3(0, 500, 9000), glm::vec3(-500, 50, 0), giantMass, 5515, glm::vec4(1.0f, 0.5f, 0.15f, 1.0f));
+    b.add(glm::vec3(0, 550, 9500), glm::vec3(0, 0, -50), moonMass, 5515, white);
+    b.add(glm::vec3(0, 450, 8500), glm::vec3(0, 0, -50), moonMass, 5515, white);
+    b.add(glm::vec3(100, 500, 9000), glm::vec3(50, 0, 0), moonMass, 5515, white);
+
+    // Neptune
+    b.add(glm::vec3(0, -500, -10500), glm::vec3(-350, 50, 0), giantMass, 5515, glm::vec4(0.35f, 0.85f, 0.99f, 1.0f));
+    b.add(glm::vec3(350, -450, -10500), glm::vec3(0, 0, -550), moonMass, 5515, white);
+    b.add(glm::vec3(-350, -450, -10500), glm::vec3(0, 0, -550), moonMass, 5515, white);
+    b.add(glm::vec3(0, -450, -11050), glm::vec3(-550, 0, 0), moonMass, 5515, white);
+}
+
+// Two sun-like stars on a circular orbit around their barycentre
+void Presets::loadBinaryStars(SimulationEngine& engine) {
+    engine.clearBodies();
+
+    const float starMass = static_cast<float>(1.989 * std::pow(10, 25));
+    const float separation = 3000.0f;
+
+    // Circular speed of each star about the barycentre, in stored velocity units
+    const double unitsPerTick = std::sqrt(engine.sceneGravitationalConstant() * starMass / (2.0 * separation));
+    const float circular = static_cast<float>(unitsPerTick * Physics::TIME_SCALE);
+
+    engine.bodies.add(glm::vec3(-separation / 2, 0, 0), glm::vec3(0, 0, -circular), starMass, 1414,
+                      glm::vec4(1.0f, 0.929f, 0.176f, 1.0f), true);
+    engine.bodies.add(glm::vec3(separation / 2, 0, 0), glm::vec3(0, 0, circular), starMass, 1414,
+                      glm::vec4(0.55f, 0.7f, 1.0f, 1.0f), true);
+}
+
+// Uniform sphere of equal-mass bodies at rest, used for benchmarking
+void Presets::loadRandomCluster(SimulationEngine& engine, size_t count, uint32_t seed) {
+    engine.clearBodies();
+    engine.bodies.reserve(count);
+
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    const float extent = 10000.0f;
+    const float moonMass = static_cast<float>(5.97219 * std::pow(10, 21));
+
+    while (engine.bodies.size() < count) {
+        const glm::vec3 p(unit(rng), unit(rng), unit(rng));
+        if (glm::dot(p, p) > 1.0f) continue;
+        engine.bodies.add(p * extent, glm::vec3(0.0f), moonMass, 5515);
+    }
+}
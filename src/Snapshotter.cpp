@@ -0,0 +1,139 @@
+#include "Snapshotter.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#ifndef _WIN32
+    #include <sys/types.h>
+    #include <sys/wait.h>
+    #include <unistd.h>
+#endif
+
+Snapshotter::Snapshotter(const SnapshotConfig& config) : config(config) {
+    if (this->config.maxInFlight == 0) this->config.maxInFlight = 1;
+#ifdef _WIN32
+    this->config.background = false;
+#endif
+}
+
+Snapshotter::~Snapshotter() {
+    wait();
+}
+
+bool Snapshotter::save(const SimulationEngine& engine, const std::string& path) {
+    const Clock::time_point start = Clock::now();
+    if (!config.background) return saveInProcess(engine, path);
+
+    poll();
+    // Two children writing one path would share its temporary file
+    auto samePath = [&]() {
+        return std::find_if(pending.begin(), pending.end(), [&](const Pending& p) { return p.path == path; });
+    };
+    if (config.whenBusy == SnapshotConfig::WhenBusy::Skip &&
+        (pending.size() >= config.maxInFlight || samePath() != pending.end())) {
+        ++counters.skipped;
+        return false;
+    }
+    for (auto it = samePath(); it != pending.end(); it = samePath()) reap(size_t(it - pending.begin()), true);
+    while (pending.size() >= config.maxInFlight) reap(0, true);
+
+#ifdef _WIN32
+    return false;
+#else
+    // Buffered output would otherwise be written again by the child's exit
+    std::fflush(nullptr);
+    const pid_t pid = fork();
+    if (pid < 0) {
+        std::cerr << "Cannot fork for checkpoint " << path << " (" << std::strerror(errno)
+                  << "), writing it in place" << std::endl;
+        return saveInProcess(engine, path);
+    }
+    if (pid == 0) {
+        // Only this thread exists here, so skip destructors and atexit
+        // handlers that would join or lock on threads left in the parent
+        _exit(engine.saveState(path) ? 0 : 1);
+    }
+
+    pending.push_back(Pending{int(pid), path, start});
+    ++counters.started;
+    recordPause(start);
+    return true;
+#endif
+}
+
+void Snapshotter::poll() {
+    for (size_t i = 0; i < pending.size();) {
+        if (!reap(i, false)) ++i;
+    }
+}
+
+void Snapshotter::wait() {
+    while (!pending.empty()) reap(0, true);
+}
+
+bool Snapshotter::saveInProcess(const SimulationEngine& engine, const std::string& path) {
+    const Clock::time_point start = Clock::now();
+    ++counters.started;
+    const bool ok = engine.saveState(path);
+    if (ok) {
+        ++counters.completed;
+    } else {
+        ++counters.failed;
+    }
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    counters.longestWrite = std::max(counters.longestWrite, seconds);
+    recordPause(start);
+    return ok;
+}
+
+bool Snapshotter::reap(size_t index, bool block) {
+#ifdef _WIN32
+    (void)block;
+    finish(index, false, "cannot be tracked");
+    return true;
+#else
+    int status = 0;
+    pid_t done;
+    do {
+        done = waitpid(pid_t(pending[index].pid), &status, block ? 0 : WNOHANG);
+    } while (done < 0 && errno == EINTR);
+
+    if (done == 0) return false;
+    if (done < 0) {
+        // Reaped elsewhere (a SIGCHLD handler, say); the file tells whether it worked
+        finish(index, false, std::string("was lost: ") + std::strerror(errno));
+    } else if (WIFEXITED(status)) {
+        finish(index, WEXITSTATUS(status) == 0, "failed to write");
+    } else if (WIFSIGNALED(status)) {
+        finish(index, false, "was killed by signal " + std::to_string(WTERMSIG(status)));
+    } else {
+        return false;   // Stopped, not finished
+    }
+    return true;
+#endif
+}
+
+void Snapshotter::finish(size_t index, bool ok, const std::string& reason) {
+    const Pending done = pending[index];
+    pending.erase(pending.begin() + std::ptrdiff_t(index));
+
+    const double seconds = std::chrono::duration<double>(Clock::now() - done.start).count();
+    counters.longestWrite = std::max(counters.longestWrite, seconds);
+    if (ok) {
+        ++counters.completed;
+        return;
+    }
+    ++counters.failed;
+    // saveState only renames a finished file over the target, so a child that
+    // failed or was killed leaves the previous checkpoint, if any, intact
+    std::remove((done.path + ".tmp").c_str());
+    std::cerr << "Checkpoint " << done.path << " " << reason << std::endl;
+}
+
+void Snapshotter::recordPause(Clock::time_point start) {
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    counters.pauseSeconds += seconds;
+    counters.longestPause = std::max(counters.longestPause, seconds);
+}
@@ -0,0 +1,227 @@
+#include "SpatialIndex.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+namespace {
+    // Deep enough for any median-split tree over 2^32 points
+    constexpr int STACK_SIZE = 64;
+
+    // Entry distance of the ray into the box, or a negative value if it misses
+    float rayBox(const glm::vec3& origin, const glm::vec3& inverse, const glm::vec3& lo, const glm::vec3& hi) {
+        const glm::vec3 t0 = (lo - origin) * inverse;
+        const glm::vec3 t1 = (hi - origin) * inverse;
+        const glm::vec3 near = glm::min(t0, t1), far = glm::max(t0, t1);
+        const float enter = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+        const float exit = std::min(far.x, std::min(far.y, far.z));
+        return enter <= exit ? enter : -1.0f;
+    }
+}
+
+void SpatialIndex::clear() {
+    points.clear();
+    nodes.clear();
+}
+
+void SpatialIndex::build(const std::vector<glm::vec3>& positions, const std::vector<float>& radii) {
+    points.resize(positions.size());
+    for (size_t i = 0; i < positions.size(); ++i) {
+        points[i] = Point{positions[i].x, positions[i].y, positions[i].z, i < radii.size() ? radii[i] : 0.0f,
+                          uint32_t(i)};
+    }
+    buildTree();
+}
+
+void SpatialIndex::build(const float* x, const float* y, const float* z, const float* radius, size_t count) {
+    points.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        points[i] = Point{x[i], y[i], z[i], radius ? radius[i] : 0.0f, uint32_t(i)};
+    }
+    buildTree();
+}
+
+void SpatialIndex::buildTree() {
+    nodes.clear();
+    if (points.empty()) return;
+    nodes.reserve(2 * points.size() / LEAF_SIZE + 1);
+    nodes.resize(1);
+    buildNode(0, 0, uint32_t(points.size()));
+}
+
+// Fills nodes[index] for points [begin, end), splitting at the median of the widest axis
+void SpatialIndex::buildNode(uint32_t index, uint32_t begin, uint32_t end) {
+    Bounds bounds;
+    bounds.min = bounds.max = glm::vec3(points[begin].x, points[begin].y, points[begin].z);
+    float maxRadius = 0.0f;
+    for (uint32_t i = begin; i < end; ++i) {
+        const glm::vec3 p(points[i].x, points[i].y, points[i].z);
+        bounds.min = glm::min(bounds.min, p);
+        bounds.max = glm::max(bounds.max, p);
+        maxRadius = std::max(maxRadius, points[i].radius);
+    }
+    nodes[index] = Node{bounds, maxRadius, begin, end, 0};
+    if (end - begin <= LEAF_SIZE) return;
+
+    const glm::vec3 extent = bounds.max - bounds.min;
+    const int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+    const uint32_t middle = begin + (end - begin) / 2;
+    std::nth_element(points.begin() + begin, points.begin() + middle, points.begin() + end,
+                     [axis](const Point& a, const Point& b) { return (&a.x)[axis] < (&b.x)[axis]; });
+
+    const uint32_t firstChild = uint32_t(nodes.size());
+    nodes.resize(nodes.size() + 2);     // Invalidates references into nodes
+    nodes[index].firstChild = firstChild;
+    buildNode(firstChild, begin, middle);
+    buildNode(firstChild + 1, middle, end);
+}
+
+void SpatialIndex::radius(const glm::vec3& centre, float radius, std::vector<uint32_t>& out) const {
+    if (nodes.empty()) return;
+    const float r2 = radius * radius;
+
+    uint32_t stack[STACK_SIZE];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const Node& node = nodes[stack[--top]];
+        if (node.bounds.distance2(centre) > r2) continue;
+        if (node.firstChild == 0) {
+            for (uint32_t i = node.begin; i < node.end; ++i) {
+                const float dx = points[i].x - centre.x, dy = points[i].y - centre.y, dz = points[i].z - centre.z;
+                if (dx * dx + dy * dy + dz * dz <= r2) out.push_back(points[i].index);
+            }
+            continue;
+        }
+        stack[top++] = node.firstChild;
+        stack[top++] = node.firstChild + 1;
+    }
+}
+
+void SpatialIndex::nearest(const glm::vec3& p, size_t k, std::vector<uint32_t>& out) const {
+    out.clear();
+    if (nodes.empty() || k == 0) return;
+
+    // Max-heap of the best k so far, held in out as slots into points so the
+    // query needs no storage of its own; the worst is always on top
+    auto distance2 = [&](uint32_t slot) {
+        const float dx = points[slot].x - p.x, dy = points[slot].y - p.y, dz = points[slot].z - p.z;
+        return dx * dx + dy * dy + dz * dz;
+    };
+    auto nearer = [&](uint32_t a, uint32_t b) {
+        const float da = distance2(a), db = distance2(b);
+        return da < db || (da == db && points[a].index < points[b].index);
+    };
+    out.reserve(k + 1);
+    float worst = std::numeric_limits<float>::infinity();
+
+    uint32_t stack[STACK_SIZE];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const Node& node = nodes[stack[--top]];
+        if (node.bounds.distance2(p) > worst) continue;
+        if (node.firstChild == 0) {
+            for (uint32_t i = node.begin; i < node.end; ++i) {
+                if (distance2(i) >= worst) continue;
+                out.push_back(i);
+                std::push_heap(out.begin(), out.end(), nearer);
+                if (out.size() > k) {
+                    std::pop_heap(out.begin(), out.end(), nearer);
+                    out.pop_back();
+                }
+                if (out.size() == k) worst = distance2(out.front());
+            }
+            continue;
+        }
+        // Nearer child last, so it is searched first and tightens the bound early
+        const uint32_t a = node.firstChild, b = node.firstChild + 1;
+        const bool aNearer = nodes[a].bounds.distance2(p) <= nodes[b].bounds.distance2(p);
+        stack[top++] = aNearer ? b : a;
+        stack[top++] = aNearer ? a : b;
+    }
+
+    std::sort_heap(out.begin(), out.end(), nearer);
+    for (uint32_t& slot : out) slot = points[slot].index;
+}
+
+void SpatialIndex::box(const Bounds& region, std::vector<uint32_t>& out) const {
+    if (nodes.empty()) return;
+    auto overlaps = [&](const Bounds& b) {
+        return b.min.x <= region.max.x && b.max.x >= region.min.x && b.min.y <= region.max.y &&
+               b.max.y >= region.min.y && b.min.z <= region.max.z && b.max.z >= region.min.z;
+    };
+
+    uint32_t stack[STACK_SIZE];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const Node& node = nodes[stack[--top]];
+        if (!overlaps(node.bounds)) continue;
+        if (node.firstChild == 0) {
+            for (uint32_t i = node.begin; i < node.end; ++i) {
+                const Point& q = points[i];
+                if (q.x >= region.min.x && q.x <= region.max.x && q.y >= region.min.y && q.y <= region.max.y &&
+                    q.z >= region.min.z && q.z <= region.max.z) {
+                    out.push_back(q.index);
+                }
+            }
+            continue;
+        }
+        stack[top++] = node.firstChild;
+        stack[top++] = node.firstChild + 1;
+    }
+}
+
+bool SpatialIndex::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, Hit& hit) const {
+    const float length = glm::length(direction);
+    if (nodes.empty() || length <= 0.0f) return false;
+    const glm::vec3 dir = direction / length;
+    const glm::vec3 inverse = 1.0f / dir;   // Infinite components are fine for the slab test
+
+    float closest = maxDistance;
+    bool found = false;
+    auto entry = [&](const Node& node) {
+        const glm::vec3 pad(node.maxRadius);
+        return rayBox(origin, inverse, node.bounds.min - pad, node.bounds.max + pad);
+    };
+
+    uint32_t stack[STACK_SIZE];
+    int top = 0;
+    if (entry(nodes[0]) >= 0.0f) stack[top++] = 0;
+    while (top > 0) {
+        const Node& node = nodes[stack[--top]];
+        if (node.firstChild == 0) {
+            for (uint32_t i = node.begin; i < node.end; ++i) {
+                const Point& q = points[i];
+                const glm::vec3 oc = glm::vec3(q.x, q.y, q.z) - origin;
+                const float along = glm::dot(oc, dir);
+                const glm::vec3 miss = oc - along * dir;    // Not |oc|^2 - along^2, which cancels badly far away
+                const float miss2 = glm::dot(miss, miss);
+                const float r2 = q.radius * q.radius;
+                if (miss2 > r2) continue;
+                const float half = std::sqrt(r2 - miss2);
+                float t = along - half;
+                if (t < 0.0f) t = along + half >= 0.0f ? 0.0f : -1.0f;   // Starting inside counts as distance 0
+                if (t < 0.0f || t >= closest) continue;
+                closest = t;
+                hit = Hit{q.index, t};
+                found = true;
+            }
+            continue;
+        }
+        // Nearer child last so it is tested first; boxes beyond the best hit are skipped
+        const uint32_t a = node.firstChild, b = node.firstChild + 1;
+        const float ta = entry(nodes[a]), tb = entry(nodes[b]);
+        const bool aValid = ta >= 0.0f && ta < closest, bValid = tb >= 0.0f && tb < closest;
+        if (aValid && bValid) {
+            stack[top++] = ta <= tb ? b : a;
+            stack[top++] = ta <= tb ? a : b;
+        } else if (aValid) {
+            stack[top++] = a;
+        } else if (bValid) {
+            stack[top++] = b;
+        }
+    }
+    return found;
+}
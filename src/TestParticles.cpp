@@ -0,0 +1,252 @@
+#include "Random.h"
+#include "SimulationEngine.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+// Restricted N-body stepping: test particles feel the bodies and nothing
+// else. The bodies with mass are gathered once per step into a packed
+// source list, then each block of PARTICLE_BLOCK particles sums every source
+// into local accumulators. The inner loop runs over the particles of the
+// block and vectorizes (it needs the math flags set in CMakeLists.txt), and
+// each particle's sum runs in source order, so the result does not depend
+// on the thread count.
+
+namespace {
+    constexpr size_t PARTICLE_BLOCK = 256;
+    constexpr double TWO_PI = 6.28318530717958647692;
+
+    // Packed bodies with mass
+    struct Sources {
+        const float* x; const float* y; const float* z;
+        const float* mass; const float* radius;
+        size_t count;
+    };
+
+    // Sums the pull of every source on count particles, in source order.
+    // The constants come in by value so the loop body has no loads that
+    // could fault, which lets the compiler turn the branch into a select.
+    void accelerate(const Sources& source, float G, const float* x, const float* y, const float* z, size_t count,
+                    float* ax, float* ay, float* az, uint32_t* inside) {
+        for (size_t k = 0; k < source.count; ++k) {
+            const float cx = source.x[k], cy = source.y[k], cz = source.z[k];
+            const float m = source.mass[k], r = source.radius[k];
+            for (size_t i = 0; i < count; ++i) {
+                const float dx = cx - x[i], dy = cy - y[i], dz = cz - z[i];
+                const float dist = std::sqrt(dx * dx + dy * dy + dz * dz);
+                const float distM = dist * Physics::METERS_PER_UNIT;
+                const float s = dist > 0.0f ? G / (distM * distM) / dist * m : 0.0f;
+                ax[i] += dx * s; ay[i] += dy * s; az[i] += dz * s;
+                inside[i] |= uint32_t(r > dist);
+            }
+        }
+    }
+
+    // Kick then drift along one axis, as SimulationEngine::integrate does
+    void advance(float* x, float* v, const float* a, size_t count, float kick, float drift) {
+        for (size_t i = 0; i < count; ++i) {
+            v[i] += a[i] * kick;
+            x[i] += v[i] * drift;
+        }
+    }
+
+    // Unit vectors completing axis to a right-handed frame
+    void frame(const glm::vec3& axis, glm::dvec3& e1, glm::dvec3& e2, glm::dvec3& e3) {
+        e3 = glm::length(axis) > 0.0f ? glm::normalize(glm::dvec3(axis)) : glm::dvec3(0, 1, 0);
+        e1 = glm::normalize(glm::cross(e3, std::abs(e3.x) < 0.9 ? glm::dvec3(1, 0, 0) : glm::dvec3(0, 1, 0)));
+        e2 = glm::cross(e3, e1);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// TestParticles
+// ---------------------------------------------------------------------------
+
+void TestParticles::add(const glm::vec3& pos, const glm::vec3& vel) {
+    px.push_back(pos.x); py.push_back(pos.y); pz.push_back(pos.z);
+    vx.push_back(vel.x); vy.push_back(vel.y); vz.push_back(vel.z);
+    ++version;
+}
+
+size_t TestParticles::append(size_t count) {
+    const size_t first = size();
+    for (auto* column : {&px, &py, &pz, &vx, &vy, &vz}) column->resize(first + count, 0.0f);
+    ++version;
+    return first;
+}
+
+void TestParticles::reserve(size_t n) {
+    for (auto* column : {&px, &py, &pz, &vx, &vy, &vz}) column->reserve(n);
+}
+
+void TestParticles::clear() {
+    for (auto* column : {&px, &py, &pz, &vx, &vy, &vz}) column->clear();
+    ++version;
+}
+
+void TestParticles::removeFlagged(const std::vector<uint8_t>& flagged) {
+    for (auto* column : {&px, &py, &pz, &vx, &vy, &vz}) {
+        size_t kept = 0;
+        for (size_t i = 0; i < column->size(); ++i) {
+            if (!flagged[i]) (*column)[kept++] = (*column)[i];
+        }
+        column->resize(kept);
+    }
+    ++version;
+}
+
+uint64_t TestParticles::hash(uint64_t value) const {
+    for (const auto* column : {&px, &py, &pz, &vx, &vy, &vz}) {
+        const auto* bytes = reinterpret_cast<const unsigned char*>(column->data());
+        for (size_t i = 0; i < column->size() * sizeof(float); ++i) {
+            value = (value ^ bytes[i]) * 1099511628211ull;
+        }
+    }
+    return value;
+}
+
+// ---------------------------------------------------------------------------
+// Stepping
+// ---------------------------------------------------------------------------
+
+void SimulationEngine::stepParticles() {
+    const size_t n = particles.size();
+    if (n == 0) {
+        lastParticleMs = 0.0;
+        return;
+    }
+    const auto start = std::chrono::steady_clock::now();
+
+    // Massless bodies pull on nothing either
+    ScratchArena::Scope scope(scratch);
+    const size_t bodyCount = bodies.size();
+    float* sx = scratch.take<float>(bodyCount);
+    float* sy = scratch.take<float>(bodyCount);
+    float* sz = scratch.take<float>(bodyCount);
+    float* sm = scratch.take<float>(bodyCount);
+    float* sr = scratch.take<float>(bodyCount);
+    size_t sources = 0;
+    for (size_t j = 0; j < bodyCount; ++j) {
+        if (bodies.mass[j] <= 0.0f) continue;
+        sx[sources] = bodies.px[j]; sy[sources] = bodies.py[j]; sz[sources] = bodies.pz[j];
+        sm[sources] = bodies.mass[j];
+        sr[sources] = bodies.radius[j];
+        ++sources;
+    }
+    const Sources source{sx, sy, sz, sm, sr, sources};
+
+    const float G = gravitationalConstant;
+    const float kick = timeScale / Physics::ACCELERATION_DAMPING;
+    const float drift = timeScale / Physics::TIME_SCALE;
+    const bool absorb = enableCollisions;
+    if (absorb) absorbed.assign(n, 0);
+
+    float* px = particles.px.data(); float* py = particles.py.data(); float* pz = particles.pz.data();
+    float* vx = particles.vx.data(); float* vy = particles.vy.data(); float* vz = particles.vz.data();
+    uint8_t* hits = absorb ? absorbed.data() : nullptr;
+
+    const size_t blocks = (n + PARTICLE_BLOCK - 1) / PARTICLE_BLOCK;
+    auto stepBlock = [&](size_t block, unsigned) {
+        const size_t begin = block * PARTICLE_BLOCK;
+        const size_t count = std::min(n - begin, PARTICLE_BLOCK);
+        float* x = px + begin; float* y = py + begin; float* z = pz + begin;
+        float ax[PARTICLE_BLOCK] = {}, ay[PARTICLE_BLOCK] = {}, az[PARTICLE_BLOCK] = {};
+        uint32_t inside[PARTICLE_BLOCK] = {};
+
+        accelerate(source, G, x, y, z, count, ax, ay, az, inside);
+        addExternalField(x, y, z, count, ax, ay, az, nullptr);
+        advance(x, vx + begin, ax, count, kick, drift);
+        advance(y, vy + begin, ay, count, kick, drift);
+        advance(z, vz + begin, az, count, kick, drift);
+        if (hits) {
+            for (size_t i = 0; i < count; ++i) hits[begin + i] = uint8_t(inside[i]);
+        }
+    };
+    if (pool.size() > 1 && n >= PARALLEL_THRESHOLD) {
+        pool.run(blocks, stepBlock);
+    } else {
+        for (size_t block = 0; block < blocks; ++block) stepBlock(block, 0);
+    }
+
+    if (absorb && std::find(absorbed.begin(), absorbed.end(), uint8_t(1)) != absorbed.end()) {
+        particles.removeFlagged(absorbed);
+    }
+
+    lastParticleMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// ---------------------------------------------------------------------------
+// Generators
+// ---------------------------------------------------------------------------
+
+void SimulationEngine::addRing(size_t centre, size_t count, float inner, float outer, uint64_t seed,
+                               const glm::vec3& axis, float thickness) {
+    if (centre >= bodies.size() || count == 0) return;
+    glm::dvec3 e1, e2, e3;
+    frame(axis, e1, e2, e3);
+    const glm::dvec3 c(bodies.position(centre));
+    const glm::dvec3 cv(bodies.vx[centre], bodies.vy[centre], bodies.vz[centre]);
+    const double GM = sceneGravitationalConstant() * bodies.mass[centre];
+    const double inner2 = double(inner) * inner;
+    const double outer2 = double(outer) * outer;
+
+    const size_t first = particles.append(count);
+    auto generate = [&](size_t begin, size_t end, unsigned) {
+        for (size_t i = begin; i < end; ++i) {
+            Philox rng(seed, i);
+            // Uniform in area over the annulus
+            const double r = std::sqrt(inner2 + rng.uniform() * (outer2 - inner2));
+            const double angle = TWO_PI * rng.uniform();
+            const double h = rng.normal() * thickness * r;
+            const glm::dvec3 radial = e1 * std::cos(angle) + e2 * std::sin(angle);
+            const glm::dvec3 p = c + radial * r + e3 * h;
+            const glm::dvec3 v = cv + glm::cross(e3, radial) * (std::sqrt(GM / r) * Physics::TIME_SCALE);
+
+            const size_t k = first + i;
+            particles.px[k] = float(p.x); particles.py[k] = float(p.y); particles.pz[k] = float(p.z);
+            particles.vx[k] = float(v.x); particles.vy[k] = float(v.y); particles.vz[k] = float(v.z);
+        }
+    };
+    if (pool.size() > 1 && count >= PARALLEL_THRESHOLD) {
+        pool.parallelFor(count, generate);
+    } else {
+        generate(0, count, 0);
+    }
+}
+
+void SimulationEngine::addCloud(size_t centre, size_t count, float inner, float outer, uint64_t seed) {
+    if (centre >= bodies.size() || count == 0) return;
+    const glm::dvec3 c(bodies.position(centre));
+    const glm::dvec3 cv(bodies.vx[centre], bodies.vy[centre], bodies.vz[centre]);
+    const double GM = sceneGravitationalConstant() * bodies.mass[centre];
+    const double inner3 = double(inner) * inner * inner;
+    const double outer3 = double(outer) * outer * outer;
+
+    const size_t first = particles.append(count);
+    auto generate = [&](size_t begin, size_t end, unsigned) {
+        for (size_t i = begin; i < end; ++i) {
+            Philox rng(seed, i);
+            const double r = std::cbrt(inner3 + rng.uniform() * (outer3 - inner3));
+            const double cosTheta = 2.0 * rng.uniform() - 1.0;
+            const double sinTheta = std::sqrt(std::max(0.0, 1.0 - cosTheta * cosTheta));
+            const double azimuth = TWO_PI * rng.uniform();
+            const glm::dvec3 radial(sinTheta * std::cos(azimuth), cosTheta, sinTheta * std::sin(azimuth));
+            // Direction of motion uniform in the plane normal to the radius
+            glm::dvec3 e1, e2, e3;
+            frame(glm::vec3(radial), e1, e2, e3);
+            const double heading = TWO_PI * rng.uniform();
+            const glm::dvec3 along = e1 * std::cos(heading) + e2 * std::sin(heading);
+            const glm::dvec3 p = c + radial * r;
+            const glm::dvec3 v = cv + along * (std::sqrt(GM / r) * Physics::TIME_SCALE);
+
+            const size_t k = first + i;
+            particles.px[k] = float(p.x); particles.py[k] = float(p.y); particles.pz[k] = float(p.z);
+            particles.vx[k] = float(v.x); particles.vy[k] = float(v.y); particles.vz[k] = float(v.z);
+        }
+    };
+    if (pool.size() > 1 && count >= PARALLEL_THRESHOLD) {
+        pool.parallelFor(count, generate);
+    } else {
+        generate(0, count, 0);
+    }
+}
@@ -0,0 +1,204 @@
+#include "TrajectoryReader.h"
+#include "Codec.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iostream>
+
+namespace {
+    uint64_t alignUp(uint64_t offset) {
+        return (offset + Trajectory::CHUNK_ALIGNMENT - 1) / Trajectory::CHUNK_ALIGNMENT * Trajectory::CHUNK_ALIGNMENT;
+    }
+
+    // Reads the chunk header at offset. False unless the chunk lies inside
+    // the file, aligned, and its payload holds everything its codec needs;
+    // QUANTIZED streams are checked when they are decoded
+    bool readChunk(const MappedFile& file, uint64_t offset, TrajectoryChunk& chunk) {
+        const uint64_t size = file.size();
+        if (offset % 8 != 0 || offset > size || size - offset < sizeof(chunk)) return false;
+        std::memcpy(&chunk, file.data() + offset, sizeof(chunk));
+        if (chunk.frameCount == 0 || chunk.bytes > size - offset - sizeof(chunk)) return false;
+
+        // Steps, ids, mass, density, color and padded glow; none can wrap
+        const uint64_t frames = chunk.frameCount, n = chunk.bodyCount;
+        const uint64_t attributes = frames * sizeof(uint64_t) + n * (sizeof(uint64_t) + 2 * sizeof(float) +
+                                                                     sizeof(glm::vec4)) + n + (8 - n % 8) % 8;
+        if (chunk.bytes < attributes) return false;
+        if (chunk.codec != Trajectory::RAW) return true;
+        return frames * n <= (chunk.bytes - attributes) / (Trajectory::COLUMN_COUNT * sizeof(float));
+    }
+}
+
+bool TrajectoryReader::open(const std::string& path) {
+    close();
+    if (!file.open(path)) return false;
+
+    TrajectoryHeader header;
+    if (file.size() < sizeof(header)) {
+        std::cerr << path << " is not a trajectory" << std::endl;
+        close();
+        return false;
+    }
+    std::memcpy(&header, file.data(), sizeof(header));
+
+    if (std::memcmp(header.magic, Trajectory::MAGIC, sizeof(header.magic)) != 0) {
+        std::cerr << path << " is not a trajectory" << std::endl;
+        close();
+        return false;
+    }
+    if (header.byteOrder != Trajectory::BYTE_ORDER_MARK || header.version != Trajectory::VERSION) {
+        std::cerr << path << " is trajectory version " << header.version << ", this build reads version "
+                  << Trajectory::VERSION << " in native byte order" << std::endl;
+        close();
+        return false;
+    }
+    strideSteps = header.stride ? header.stride : 1;
+
+    // Compared by division so a huge chunkCount cannot wrap
+    if (header.indexOffset != 0 && header.indexOffset <= file.size() &&
+        header.chunkCount <= (file.size() - header.indexOffset) / sizeof(TrajectoryIndexEntry)) {
+        chunks.resize(size_t(header.chunkCount));
+        std::memcpy(chunks.data(), file.data() + header.indexOffset,
+                    size_t(header.chunkCount * sizeof(TrajectoryIndexEntry)));
+    } else {
+        std::cerr << path << " was not closed cleanly, recovering its chunks" << std::endl;
+        recoverIndex(alignUp(header.headerSize));
+    }
+
+    // Every entry must match the chunk it points at, which must fit the file
+    frameChunk.clear();
+    for (size_t c = 0; c < chunks.size(); ++c) {
+        const TrajectoryIndexEntry& entry = chunks[c];
+        TrajectoryChunk chunk;
+        if (entry.firstFrame != frameChunk.size() || !readChunk(file, entry.offset, chunk) ||
+            chunk.firstFrame != entry.firstFrame || chunk.frameCount != entry.frameCount ||
+            chunk.bodyCount != entry.bodyCount) {
+            std::cerr << path << " has a broken chunk index" << std::endl;
+            close();
+            return false;
+        }
+        frameChunk.insert(frameChunk.end(), chunks[c].frameCount, uint32_t(c));
+    }
+    return true;
+}
+
+void TrajectoryReader::close() {
+    file.close();
+    chunks.clear();
+    frameChunk.clear();
+    strideSteps = 1;
+    for (auto& slot : cache) slot = DecodedChunk();
+}
+
+// Walks the chunk headers from the first one until the data runs out
+void TrajectoryReader::recoverIndex(uint64_t offset) {
+    chunks.clear();
+    uint64_t nextFrame = 0;
+    while (offset + sizeof(TrajectoryChunk) <= file.size()) {
+        TrajectoryChunk chunk;
+        if (!readChunk(file, offset, chunk) || chunk.firstFrame != nextFrame) break;
+        const uint64_t end = offset + sizeof(chunk) + chunk.bytes;
+
+        // The payload starts with the step numbers
+        TrajectoryIndexEntry entry{offset, chunk.firstFrame, 0, chunk.frameCount, chunk.bodyCount,
+                                   chunk.topologyVersion};
+        std::memcpy(&entry.firstStep, file.data() + offset + sizeof(chunk), sizeof(uint64_t));
+        chunks.push_back(entry);
+
+        nextFrame += chunk.frameCount;
+        offset = alignUp(end);
+    }
+}
+
+bool TrajectoryReader::frame(size_t index, TrajectoryFrame& out) const {
+    if (index >= frameChunk.size()) return false;
+    const TrajectoryIndexEntry& entry = chunks[frameChunk[index]];
+
+    TrajectoryChunk chunk;
+    std::memcpy(&chunk, file.data() + entry.offset, sizeof(chunk));
+    if (chunk.codec != Trajectory::RAW && chunk.codec != Trajectory::QUANTIZED) {
+        std::cerr << "Unsupported trajectory codec " << chunk.codec << std::endl;
+        return false;
+    }
+
+    const size_t frames = chunk.frameCount;
+    const size_t n = chunk.bodyCount;
+    const size_t local = index - size_t(chunk.firstFrame);
+    const uint8_t* payload = file.data() + entry.offset + sizeof(chunk);
+
+    const auto* steps = reinterpret_cast<const uint64_t*>(payload);
+    out.step = steps[local];
+    out.topologyVersion = chunk.topologyVersion;
+    out.bodyCount = n;
+
+    const uint8_t* cursor = payload + frames * sizeof(uint64_t);
+    out.ids = reinterpret_cast<const uint64_t*>(cursor);     cursor += n * sizeof(uint64_t);
+    out.mass = reinterpret_cast<const float*>(cursor);       cursor += n * sizeof(float);
+    out.density = reinterpret_cast<const float*>(cursor);    cursor += n * sizeof(float);
+    out.color = reinterpret_cast<const glm::vec4*>(cursor);  cursor += n * sizeof(glm::vec4);
+    out.glow = cursor;                                       cursor += n + (8 - n % 8) % 8;
+
+    const float* columns = reinterpret_cast<const float*>(cursor);
+    if (chunk.codec == Trajectory::QUANTIZED) {
+        columns = decodeChunk(frameChunk[index], cursor, payload + chunk.bytes);
+        if (!columns) return false;
+    }
+    const float** targets[Trajectory::COLUMN_COUNT] = {&out.px, &out.py, &out.pz, &out.vx, &out.vy, &out.vz};
+    for (uint32_t c = 0; c < Trajectory::COLUMN_COUNT; ++c) {
+        *targets[c] = columns + (c * frames + local) * n;
+    }
+    return true;
+}
+
+// Decodes every column of a QUANTIZED chunk into the least recently used cache slot
+const float* TrajectoryReader::decodeChunk(size_t chunkIndex, const uint8_t* cursor, const uint8_t* end) const {
+    ++cacheClock;
+    DecodedChunk* slot = &cache[0];
+    for (auto& candidate : cache) {
+        if (candidate.chunk == chunkIndex) {
+            candidate.lastUse = cacheClock;
+            return candidate.columns.data();
+        }
+        if (candidate.lastUse < slot->lastUse) slot = &candidate;
+    }
+
+    const TrajectoryIndexEntry& entry = chunks[chunkIndex];
+    const size_t plane = size_t(entry.frameCount) * entry.bodyCount;
+
+    // Find every column stream first, then decode them side by side
+    const uint8_t* streams[Trajectory::COLUMN_COUNT] = {};
+    uint64_t sizes[Trajectory::COLUMN_COUNT] = {};
+    const size_t available = size_t(end - cursor);
+    size_t offset = 0;
+    bool valid = true;
+    for (uint32_t c = 0; c < Trajectory::COLUMN_COUNT && valid; ++c) {
+        valid = available - offset >= sizeof(uint64_t);
+        if (!valid) break;
+        std::memcpy(&sizes[c], cursor + offset, sizeof(uint64_t));
+        offset += sizeof(uint64_t);
+        streams[c] = cursor + offset;
+        valid = sizes[c] <= available - offset;
+        offset = std::min<uint64_t>(offset + sizes[c] + (8 - sizes[c] % 8) % 8, available);
+    }
+
+    slot->chunk = SIZE_MAX;
+    slot->columns.resize(Trajectory::COLUMN_COUNT * plane);
+    if (valid) {
+        if (!decoders) decoders = std::make_unique<ThreadPool>(Trajectory::COLUMN_COUNT);
+        std::atomic<bool> decoded{true};
+        decoders->run(Trajectory::COLUMN_COUNT, [&](size_t c, unsigned) {
+            if (!Codec::decodeColumn(streams[c], size_t(sizes[c]), entry.frameCount, entry.bodyCount,
+                                     slot->columns.data() + c * plane)) {
+                decoded = false;
+            }
+        });
+        valid = decoded;
+    }
+    if (!valid) {
+        std::cerr << "Trajectory chunk " << chunkIndex << " is corrupt" << std::endl;
+        return nullptr;
+    }
+    slot->chunk = chunkIndex;
+    slot->lastUse = cacheClock;
+    return slot->columns.data();
+}
@@ -0,0 +1,272 @@
+#include "TrajectoryWriter.h"
+#include "Codec.h"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+TrajectoryWriter::TrajectoryWriter(const TrajectoryConfig& config) : config(config) {
+    if (this->config.every == 0) this->config.every = 1;
+    if (this->config.queueDepth == 0) this->config.queueDepth = 1;
+    if (this->config.framesPerChunk == 0) this->config.framesPerChunk = 1;
+}
+
+TrajectoryWriter::~TrajectoryWriter() {
+    close();
+}
+
+bool TrajectoryWriter::open(const std::string& filename) {
+    close();
+    file.open(filename, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        std::cerr << "Failed to create " << filename << std::endl;
+        return false;
+    }
+    path = filename;
+
+    frames.clear();
+    freeFrames.clear();
+    pendingFrames.clear();
+    for (size_t i = 0; i < config.queueDepth; ++i) {
+        frames.push_back(std::make_unique<Frame>());
+        freeFrames.push_back(frames.back().get());
+    }
+
+    chunkSteps.clear();
+    chunkBodies = BodySet();
+    sentBodies = false;
+    for (auto& column : chunkColumns) column.clear();
+    index.clear();
+    frameCount = 0;
+    fileOffset = 0;
+    failed = false;
+    stopping = false;
+    framesCaptured = framesWritten = framesDropped = chunksWritten = bytesWritten = 0;
+    columnBytesIn = columnBytesOut = 0;
+    blockedSeconds = writeSeconds = 0.0;
+
+    // Placeholder until close() knows where the index went; chunks start on
+    // the alignment boundary after it
+    const TrajectoryHeader header = makeHeader(0);
+    write(&header, sizeof(header));
+    padToAlignment();
+
+    worker = std::thread([this] { run(); });
+    return true;
+}
+
+void TrajectoryWriter::close() {
+    if (!worker.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    frameQueued.notify_one();
+    worker.join();
+
+    // The writer has drained the queue; finish the file on this thread
+    flushChunk();
+    const uint64_t indexOffset = fileOffset;
+    write(index.data(), index.size() * sizeof(TrajectoryIndexEntry));
+
+    file.seekp(0);
+    const TrajectoryHeader header = makeHeader(indexOffset);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.close();
+    if (failed || !file) std::cerr << "Trajectory " << path << " is incomplete" << std::endl;
+}
+
+bool TrajectoryWriter::capture(const SimulationEngine& engine) {
+    if (!worker.joinable() || engine.stepCount % config.every != 0) return true;
+    ++framesCaptured;
+
+    Frame* frame = nullptr;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (freeFrames.empty()) {
+            if (config.backpressure == TrajectoryConfig::Backpressure::Drop) {
+                ++framesDropped;
+                return false;
+            }
+            const auto start = std::chrono::steady_clock::now();
+            frameFreed.wait(lock, [this] { return !freeFrames.empty(); });
+            blockedSeconds = blockedSeconds.load() +
+                             std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        frame = freeFrames.front();
+        freeFrames.pop_front();
+    }
+
+    // The copy happens outside the lock; this is all the step pays per frame
+    const BodyStore& bodies = engine.bodies;
+    frame->step = engine.stepCount;
+    frame->topologyVersion = bodies.topologyVersion;
+    frame->hasBodies = !sentBodies || sentTopology != bodies.topologyVersion;
+    if (frame->hasBodies) {
+        frame->bodies.ids.assign(bodies.id.begin(), bodies.id.end());
+        frame->bodies.mass.assign(bodies.mass.begin(), bodies.mass.end());
+        frame->bodies.density.assign(bodies.density.begin(), bodies.density.end());
+        frame->bodies.color.assign(bodies.color.begin(), bodies.color.end());
+        frame->bodies.glow.assign(bodies.glow.begin(), bodies.glow.end());
+        sentBodies = true;
+        sentTopology = bodies.topologyVersion;
+    }
+    const Column<float>* sources[Trajectory::COLUMN_COUNT] = {&bodies.px, &bodies.py, &bodies.pz,
+                                                               &bodies.vx, &bodies.vy, &bodies.vz};
+    for (uint32_t c = 0; c < Trajectory::COLUMN_COUNT; ++c) {
+        frame->columns[c].assign(sources[c]->begin(), sources[c]->end());
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pendingFrames.push_back(frame);
+    }
+    frameQueued.notify_one();
+    return true;
+}
+
+TrajectoryWriter::Stats TrajectoryWriter::stats() const {
+    Stats s;
+    s.framesCaptured = framesCaptured;
+    s.framesWritten = framesWritten;
+    s.framesDropped = framesDropped;
+    s.chunksWritten = chunksWritten;
+    s.bytesWritten = bytesWritten;
+    s.columnBytesIn = columnBytesIn;
+    s.columnBytesOut = columnBytesOut;
+    s.blockedSeconds = blockedSeconds;
+    s.writeSeconds = writeSeconds;
+    return s;
+}
+
+void TrajectoryWriter::run() {
+    for (;;) {
+        Frame* frame = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            frameQueued.wait(lock, [this] { return stopping || !pendingFrames.empty(); });
+            if (pendingFrames.empty()) return;
+            frame = pendingFrames.front();
+            pendingFrames.pop_front();
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        append(*frame);
+        writeSeconds = writeSeconds.load() +
+                       std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            freeFrames.push_back(frame);
+        }
+        frameFreed.notify_one();
+    }
+}
+
+void TrajectoryWriter::append(const Frame& frame) {
+    // A chunk holds one fixed set of bodies
+    if (!chunkSteps.empty() && frame.topologyVersion != chunkTopology) flushChunk();
+
+    if (frame.hasBodies) chunkBodies = frame.bodies;
+    chunkTopology = frame.topologyVersion;
+    chunkSteps.push_back(frame.step);
+    for (uint32_t c = 0; c < Trajectory::COLUMN_COUNT; ++c) {
+        chunkColumns[c].insert(chunkColumns[c].end(), frame.columns[c].begin(), frame.columns[c].end());
+    }
+    ++framesWritten;
+
+    if (chunkSteps.size() >= config.framesPerChunk) flushChunk();
+}
+
+void TrajectoryWriter::flushChunk() {
+    if (chunkSteps.empty()) return;
+
+    const size_t frames = chunkSteps.size();
+    const size_t n = chunkBodies.ids.size();
+    const size_t glowPadding = (8 - n % 8) % 8;
+    const bool quantized = config.codec == Trajectory::QUANTIZED;
+
+    // Coded columns go back to back into one buffer, each behind its size
+    if (quantized) {
+        encoded.clear();
+        for (uint32_t c = 0; c < Trajectory::COLUMN_COUNT; ++c) {
+            const size_t at = encoded.size();
+            encoded.resize(at + sizeof(uint64_t));
+            const double tolerance = c < 3 ? config.positionTolerance : config.velocityTolerance;
+            Codec::encodeColumn(chunkColumns[c].data(), frames, n, tolerance, encoded);
+            const uint64_t bytes = encoded.size() - at - sizeof(uint64_t);
+            std::memcpy(encoded.data() + at, &bytes, sizeof(bytes));
+            encoded.resize(encoded.size() + (8 - encoded.size() % 8) % 8);
+        }
+    }
+
+    TrajectoryChunk chunk{};
+    chunk.firstFrame = frameCount;
+    chunk.frameCount = uint32_t(frames);
+    chunk.bodyCount = uint32_t(n);
+    chunk.codec = quantized ? Trajectory::QUANTIZED : Trajectory::RAW;
+    chunk.topologyVersion = chunkTopology;
+    chunk.bytes = (frames + n) * sizeof(uint64_t) + n * (2 * sizeof(float) + sizeof(glm::vec4)) + n + glowPadding;
+    uint64_t rawColumnBytes = 0;
+    for (const auto& column : chunkColumns) rawColumnBytes += column.size() * sizeof(float);
+    const uint64_t columnBytes = quantized ? encoded.size() : rawColumnBytes;
+    chunk.bytes += columnBytes;
+    columnBytesIn += rawColumnBytes;
+    columnBytesOut += columnBytes;
+
+    index.push_back(TrajectoryIndexEntry{fileOffset, frameCount, chunkSteps.front(), chunk.frameCount,
+                                         chunk.bodyCount, chunkTopology});
+
+    static const char padding[8] = {};
+    write(&chunk, sizeof(chunk));
+    write(chunkSteps.data(), frames * sizeof(uint64_t));
+    write(chunkBodies.ids.data(), n * sizeof(uint64_t));
+    write(chunkBodies.mass.data(), n * sizeof(float));
+    write(chunkBodies.density.data(), n * sizeof(float));
+    write(chunkBodies.color.data(), n * sizeof(glm::vec4));
+    write(chunkBodies.glow.data(), n);
+    write(padding, glowPadding);
+    if (quantized) {
+        write(encoded.data(), encoded.size());
+    } else {
+        for (const auto& column : chunkColumns) write(column.data(), column.size() * sizeof(float));
+    }
+
+    padToAlignment();
+
+    frameCount += frames;
+    ++chunksWritten;
+    chunkSteps.clear();
+    for (auto& column : chunkColumns) column.clear();
+}
+
+void TrajectoryWriter::write(const void* data, size_t bytes) {
+    if (bytes == 0 || failed) return;
+    file.write(static_cast<const char*>(data), std::streamsize(bytes));
+    if (!file) {
+        std::cerr << "Failed to write trajectory " << path << std::endl;
+        failed = true;
+        return;
+    }
+    fileOffset += bytes;
+    bytesWritten += bytes;
+}
+
+void TrajectoryWriter::padToAlignment() {
+    static const char padding[Trajectory::CHUNK_ALIGNMENT] = {};
+    const uint64_t remainder = fileOffset % Trajectory::CHUNK_ALIGNMENT;
+    if (remainder) write(padding, size_t(Trajectory::CHUNK_ALIGNMENT - remainder));
+}
+
+TrajectoryHeader TrajectoryWriter::makeHeader(uint64_t indexOffset) const {
+    TrajectoryHeader header{};
+    std::memcpy(header.magic, Trajectory::MAGIC, sizeof(header.magic));
+    header.version = Trajectory::VERSION;
+    header.byteOrder = Trajectory::BYTE_ORDER_MARK;
+    header.headerSize = sizeof(TrajectoryHeader);
+    header.framesPerChunk = config.framesPerChunk;
+    header.stride = config.every;
+    header.frameCount = frameCount;
+    header.chunkCount = index.size();
+    header.indexOffset = indexOffset;
+    return header;
+}